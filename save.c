@@ -97,16 +97,24 @@ static void getsavedir(char *savedir, int maxlen) {
   SDL_free(prefpath);
 }
 
+/* fills path with the full path of the save file of level levcrc32 with extension ext. returns 0 on success, non-zero otherwise. */
+int savefile_path(char *path, int maxlen, unsigned long levcrc32, char *ext) {
+  char crcstr[16];
+  if ((ext == NULL) || (strlen(ext) > 6)) return(-1);
+  getsavedir(path, maxlen);
+  if (path[0] == 0) return(-1);
+  sprintf(crcstr, "%08lX.%s", levcrc32, ext);
+  strcat(path, crcstr);
+  return(0);
+}
+
 /* returns a malloc()'ed, null-terminated string with the solution to level levcrc32. if no solution available, returns NULL. */
 char *solution_load(unsigned long levcrc32, char *ext) {
-  char rootdir[4096], crcstr[16], *solution, *solutionfinal;
+  char rootdir[4096], *solution, *solutionfinal;
   int bytebuff, rlecounter;
   long solutionpos = 0, solution_alloc = 16;
   FILE *fd;
-  getsavedir(rootdir, sizeof(rootdir));
-  if (rootdir[0] == 0) return(NULL);
-  sprintf(crcstr, "%08lX.%s", levcrc32, ext);
-  strcat(rootdir, crcstr);
+  if (savefile_path(rootdir, sizeof(rootdir), levcrc32, ext) != 0) return(NULL);
   fd = fopen(rootdir, "rb");
   if (fd == NULL) return(NULL);
 
@@ -159,13 +167,10 @@ char *solution_load(unsigned long levcrc32, char *ext) {
 
 /* saves the solution for levcrc32 */
 void solution_save(unsigned long levcrc32, char *solution, char *ext) {
-  char rootdir[4096], crcstr[16];
+  char rootdir[4096];
   int curbyte, lastbyte = -1, lastbytecount = 0;
   FILE *fd;
-  getsavedir(rootdir, sizeof(rootdir));
-  if ((rootdir[0] == 0) || (solution == NULL)) return;
-  sprintf(crcstr, "%08lX.%s", levcrc32, ext);
-  strcat(rootdir, crcstr);
+  if ((solution == NULL) || (savefile_path(rootdir, sizeof(rootdir), levcrc32, ext) != 0)) return;
   fd = fopen(rootdir, "wb");
   if (fd == NULL) return;
   for (;;) {
@@ -23,6 +23,10 @@
 #ifndef save_h_sentinel
 #define save_h_sentinel
 
+/* fills path with the full path of the save file of level levcrc32 with extension ext (at most 6 characters long), in the same
+ * directory as solutions. returns 0 on success, non-zero otherwise. */
+int savefile_path(char *path, int maxlen, unsigned long levcrc32, char *ext);
+
 /* saves the solution for levcrc32 */
 void solution_save(unsigned long levcrc32, char *solution, char *ext);
 
@@ -22,6 +22,7 @@
 #include <time.h>
 #include <SDL2/SDL.h>           /* SDL       */
 #include "sok_core.h"
+#include "sok_hint.h"
 #include "save.h"
 #include "data_lev.h"           /* embedded image files */
 #include "data_img.h"           /* embedded level files */
@@ -39,7 +40,6 @@
 
 #define debugmode 0
 
-#define MAXLEVELS 4096
 #define SCREEN_DEFAULT_WIDTH 800
 #define SCREEN_DEFAULT_HEIGHT 600
 
@@ -51,6 +51,7 @@
 #define DRAWSCREEN_PUSH 4
 #define DRAWSCREEN_NOBG 8
 #define DRAWSCREEN_NOTXT 16
+#define DRAWSCREEN_HINT 32
 
 #define DRAWSTRING_CENTER -1
 #define DRAWSTRING_RIGHT -2
@@ -97,6 +98,7 @@ enum normalizedkeys {
   KEY_F12,
   KEY_S,
   KEY_R,
+  KEY_H,
   KEY_CTRL_C,
   KEY_CTRL_V,
   KEY_UNKNOWN
@@ -261,6 +263,9 @@ static int normalizekeys(SDL_Keycode key) {
     case SDLK_r:
       return(KEY_R);
       break;
+    case SDLK_h:
+      return(KEY_H);
+      break;
     case SDLK_c:
       if (SDL_GetModState() & KMOD_CTRL) return(KEY_CTRL_C);
       break;
@@ -618,26 +623,26 @@ static int getWallCap(struct sokgame *game, int x, int y, SDL_Rect *dstrect, SDL
     case TOPLEFT: /* top left corner */
       dstrect->w = width[TOPLEFT];
       dstrect->h = height[TOPLEFT];
-      if ((x > 0) && (y > 0) && (game->field[x - 1][y] & game->field[x][y - 1] & game->field[x - 1][y - 1] & field_wall)) return(1);
+      if ((x > 0) && (y > 0) && (sok_field(game, x - 1, y) & sok_field(game, x, y - 1) & sok_field(game, x - 1, y - 1) & field_wall)) return(1);
       return(0);
     case TOPRIGHT: /* top right corner */
       dstrect->w = width[TOPRIGHT];
       dstrect->h = height[TOPRIGHT];
       dstrect->x += width[TOPLEFT];
-      if ((y > 0) && (game->field[x + 1][y] & game->field[x][y - 1] & game->field[x + 1][y - 1] & field_wall)) return(1);
+      if ((y > 0) && (sok_field(game, x + 1, y) & sok_field(game, x, y - 1) & sok_field(game, x + 1, y - 1) & field_wall)) return(1);
       return(0);
     case BOTTOMLEFT: /* bottom left corner */
       dstrect->w = width[BOTTOMLEFT];
       dstrect->h = height[BOTTOMLEFT];
       dstrect->y += height[TOPLEFT];
-      if ((x > 0) && (game->field[x - 1][y] & game->field[x][y + 1] & game->field[x - 1][y + 1] & field_wall)) return(1);
+      if ((x > 0) && (sok_field(game, x - 1, y) & sok_field(game, x, y + 1) & sok_field(game, x - 1, y + 1) & field_wall)) return(1);
       return(0);
     case BOTTOMRIGHT: /* bottom right corner */
       dstrect->w = width[BOTTOMRIGHT];
       dstrect->h = height[BOTTOMRIGHT];
       dstrect->x += width[TOPRIGHT];
       dstrect->y += height[TOPRIGHT];
-      if ((game->field[x + 1][y] & game->field[x][y + 1] & game->field[x + 1][y + 1] & field_wall)) return(1);
+      if ((sok_field(game, x + 1, y) & sok_field(game, x, y + 1) & sok_field(game, x + 1, y + 1) & field_wall)) return(1);
       return(0);
   }
   return(0);
@@ -646,10 +651,10 @@ static int getWallCap(struct sokgame *game, int x, int y, SDL_Rect *dstrect, SDL
 /* get an 'id' for a wall on a given position. this is a 4-bits bitfield that indicates where the wall has neighbors (up/right/down/left). */
 static int getwallid(struct sokgame *game, int x, int y) {
   int res = 0;
-  if ((y > 0) && (game->field[x][y - 1] & field_wall)) res |= 1;
-  if ((x < 63) && (game->field[x + 1][y] & field_wall)) res |= 2;
-  if ((y < 63) && (game->field[x][y + 1] & field_wall)) res |= 4;
-  if ((x > 0) && (game->field[x - 1][y] & field_wall)) res |= 8;
+  if ((y > 0) && (sok_field(game, x, y - 1) & field_wall)) res |= 1;
+  if ((x < 63) && (sok_field(game, x + 1, y) & field_wall)) res |= 2;
+  if ((y < 63) && (sok_field(game, x, y + 1) & field_wall)) res |= 4;
+  if ((x > 0) && (sok_field(game, x - 1, y) & field_wall)) res |= 8;
   return(res);
 }
 
@@ -663,9 +668,9 @@ static void draw_playfield_tile(struct sokgame *game, int x, int y, struct sprit
   rect.h = settings->tilesize;
 
   if ((flags & DRAWPLAYFIELDTILE_DRAWATOM) == 0) {
-      if (game->field[x][y] & field_floor) SDL_RenderCopy(renderer, sprites->floor, NULL, &rect);
-      if (game->field[x][y] & field_goal) SDL_RenderCopy(renderer, sprites->goal, NULL, &rect);
-      if (game->field[x][y] & field_wall) {
+      if (sok_field(game, x, y) & field_floor) SDL_RenderCopy(renderer, sprites->floor, NULL, &rect);
+      if (sok_field(game, x, y) & field_goal) SDL_RenderCopy(renderer, sprites->goal, NULL, &rect);
+      if (sok_field(game, x, y) & field_wall) {
         SDL_Rect srcrect, dstrect;
         srcrect.x = 2;
         srcrect.y = 2;
@@ -681,18 +686,18 @@ static void draw_playfield_tile(struct sokgame *game, int x, int y, struct sprit
       }
     } else {
       int atomongoal = 0;
-      if ((game->field[x][y] & field_goal) && (game->field[x][y] & field_atom)) {
+      if ((sok_field(game, x, y) & field_goal) && (sok_field(game, x, y) & field_atom)) {
         atomongoal = 1;
         if (flags & DRAWPLAYFIELDTILE_PUSH) {
-          if ((game->positionx == x - 1) && (game->positiony == y) && (moveoffsetx > 0) && ((game->field[x + 1][y] & field_goal) == 0)) atomongoal = 0;
-          if ((game->positionx == x + 1) && (game->positiony == y) && (moveoffsetx < 0) && ((game->field[x - 1][y] & field_goal) == 0)) atomongoal = 0;
-          if ((game->positionx == x) && (game->positiony == y - 1) && (moveoffsety > 0) && ((game->field[x][y + 1] & field_goal) == 0)) atomongoal = 0;
-          if ((game->positionx == x) && (game->positiony == y + 1) && (moveoffsety < 0) && ((game->field[x][y - 1] & field_goal) == 0)) atomongoal = 0;
+          if ((game->positionx == x - 1) && (game->positiony == y) && (moveoffsetx > 0) && ((sok_field(game, x + 1, y) & field_goal) == 0)) atomongoal = 0;
+          if ((game->positionx == x + 1) && (game->positiony == y) && (moveoffsetx < 0) && ((sok_field(game, x - 1, y) & field_goal) == 0)) atomongoal = 0;
+          if ((game->positionx == x) && (game->positiony == y - 1) && (moveoffsety > 0) && ((sok_field(game, x, y + 1) & field_goal) == 0)) atomongoal = 0;
+          if ((game->positionx == x) && (game->positiony == y + 1) && (moveoffsety < 0) && ((sok_field(game, x, y - 1) & field_goal) == 0)) atomongoal = 0;
         }
       }
       if (atomongoal != 0) {
           SDL_RenderCopy(renderer, sprites->atom_on_goal, NULL, &rect);
-        } else if (game->field[x][y] & field_atom) {
+        } else if (sok_field(game, x, y) & field_atom) {
           SDL_RenderCopy(renderer, sprites->atom, NULL, &rect);
       }
   }
@@ -803,19 +808,29 @@ static void draw_screen(struct sokgame *game, struct sokgamestates *states, stru
     sprintf(stringbuff, "%s, level %d", levelname, game->level);
     draw_string(stringbuff, 100, 255, sprites, renderer, 10, DRAWSTRING_BOTTOM, window, 1, 0);
     if (game->solution != NULL) {
-        sprintf(stringbuff, "best score: %ld/%ld", sok_history_getlen(game->solution), sok_history_getpushes(game->solution));
+        sprintf(stringbuff, "best score: %ld/%ld", game->solutionlen, game->solutionpushes);
       } else {
         sprintf(stringbuff, "best score: -");
     }
     draw_string(stringbuff, 100, 255, sprites, renderer, DRAWSTRING_RIGHT, 0, window, 1, 0);
-    sprintf(stringbuff, "moves: %ld / pushes: %ld", sok_history_getlen(states->history), sok_history_getpushes(states->history));
+    sprintf(stringbuff, "moves: %ld / pushes: %ld", states->history.len, states->history.pushes);
     draw_string(stringbuff, 100, 255, sprites, renderer, 10, 0, window, 1, 0);
   }
   if ((flags & DRAWSCREEN_PLAYBACK) && (time(NULL) % 2 == 0)) draw_string("*** PLAYBACK ***", 100, 255, sprites, renderer, DRAWSTRING_CENTER, 32, window, 1, 0);
+  if (((flags & DRAWSCREEN_NOTXT) == 0) && (states->deadlocked != 0)) draw_string("deadlock! (backspace to undo)", 100, 255, sprites, renderer, DRAWSTRING_CENTER, 64, window, 1, 0);
+  if (flags & DRAWSCREEN_HINT) draw_string("looking for a hint...", 100, 255, sprites, renderer, DRAWSTRING_CENTER, 96, window, 1, 0);
   /* Update the screen */
   if (flags & DRAWSCREEN_REFRESH) SDL_RenderPresent(renderer);
 }
 
+/* draws the screen with a message over it, and waits up to timeout seconds for a key. returns non-zero if the user wants to quit. */
+static int draw_message(char *message, int timeout, struct sokgame *game, struct sokgamestates *states, struct spritesstruct *sprites, SDL_Renderer *renderer, SDL_Window *window, struct videosettings *settings, int flags, char *levelname) {
+  draw_screen(game, states, sprites, renderer, window, settings, 0, 0, 0, flags & ~DRAWSCREEN_REFRESH, levelname);
+  draw_string(message, 100, 255, sprites, renderer, DRAWSTRING_CENTER, DRAWSTRING_CENTER, window, 1, 0);
+  SDL_RenderPresent(renderer);
+  return(wait_for_a_key(timeout, renderer));
+}
+
 static int rotatePlayer(struct spritesstruct *sprites, struct sokgame *game, struct sokgamestates *states, enum SOKMOVE dir, SDL_Renderer *renderer, SDL_Window *window, struct videosettings *settings, char *levelname, int drawscreenflags) {
   int srcangle = states->angle;
   int dstangle = 0, dirmotion, winw, winh;
@@ -889,9 +904,10 @@ static int scrollneeded(struct sokgame *game, SDL_Window *window, int tilesize,
   return(result);
 }
 
-static void loadlevel(struct sokgame *togame, struct sokgame *fromgame, struct sokgamestates *states) {
-  memcpy(togame, fromgame, sizeof(struct sokgame));
+/* loads a level of the set into togame, and resets states. returns 0 on success, non-zero otherwise. */
+static int loadlevel(struct sokgame *togame, struct soklevelset *levelset, int level, struct sokgamestates *states) {
   sok_resetstates(states);
+  return(sok_getlevel(levelset, level, togame));
 }
 
 static char *processDropFileEvent(SDL_Event *event, char **levelfile) {
@@ -1035,8 +1051,8 @@ static void blit_levelmap(struct sokgame *game, struct spritesstruct *sprites, i
       srcrect.w = nativetilesize - 2;
       srcrect.h = nativetilesize - 2;
       /* draw the tile */
-      if (game->field[x][y] & field_floor) SDL_RenderCopy(renderer, sprites->floor, NULL, &rect);
-      if (game->field[x][y] & field_wall) {
+      if (sok_field(game, x, y) & field_floor) SDL_RenderCopy(renderer, sprites->floor, NULL, &rect);
+      if (sok_field(game, x, y) & field_wall) {
         int i;
         SDL_Rect dstrect;
         SDL_RenderCopy(renderer, sprites->walls[getwallid(game, x, y)], &srcrect, &rect);
@@ -1047,11 +1063,11 @@ static void blit_levelmap(struct sokgame *game, struct spritesstruct *sprites, i
           }
         }
       }
-      if ((game->field[x][y] & field_goal) && (game->field[x][y] & field_atom)) { /* atom on goal */
+      if ((sok_field(game, x, y) & field_goal) && (sok_field(game, x, y) & field_atom)) { /* atom on goal */
           SDL_RenderCopy(renderer, sprites->atom_on_goal, NULL, &rect);
-        } else if (game->field[x][y] & field_goal) { /* goal */
+        } else if (sok_field(game, x, y) & field_goal) { /* goal */
           SDL_RenderCopy(renderer, sprites->goal, NULL, &rect);
-        } else if (game->field[x][y] & field_atom) { /* atom */
+        } else if (sok_field(game, x, y) & field_atom) { /* atom */
           SDL_RenderCopy(renderer, sprites->atom, NULL, &rect);
       }
     }
@@ -1101,20 +1117,22 @@ static int fade2texture(SDL_Renderer *renderer, SDL_Window *window, SDL_Texture
   return(exitflag);
 }
 
-static int selectlevel(struct sokgame **gameslist, struct spritesstruct *sprites, SDL_Renderer *renderer, SDL_Window *window, struct videosettings *settings, char *levcomment, int levelscount, int selection, char **levelfile) {
-  int i, winw, winh, maxallowedlevel;
+static int selectlevel(struct soklevelset *levelset, struct spritesstruct *sprites, SDL_Renderer *renderer, SDL_Window *window, struct videosettings *settings, char *levcomment, int selection, char **levelfile) {
+  int i, winw, winh, maxallowedlevel, levelscount = levelset->count;
   char levelnum[64];
+  struct sokgame game;
   SDL_Event event;
-  /* reload all solutions for levels, in case they changed (for ex. because we just solved a level..) */
-  sok_loadsolutions(gameslist, levelscount);
+  /* reload solutions of the levels seen so far, in case they changed (for ex. because we just solved a level..) - levels that haven't
+   * been parsed yet are checked straight from their id, so that browsing a huge set only ever parses the levels being displayed */
+  sok_loadsolutions(levelset);
 
   /* if no current level is selected, then preselect the first unsolved level */
   if (selection < 0) {
     for (i = 0; i < levelscount; i++) {
-      if (gameslist[i]->solution != NULL) {
-          if (debugmode != 0) printf("Level %d [%08lX] has solution: %s\n", i + 1, gameslist[i]->crc32, gameslist[i]->solution);
+      if (sok_issolved(levelset, i) != 0) {
+          if (debugmode != 0) printf("Level %d [%08lX] has a solution\n", i + 1, levelset->levels[i].crc32);
         } else {
-          if (debugmode != 0) printf("Level %d [%08lX] has NO solution\n", i + 1, gameslist[i]->crc32);
+          if (debugmode != 0) printf("Level %d [%08lX] has NO solution\n", i + 1, levelset->levels[i].crc32);
           selection = i;
           break;
       }
@@ -1127,7 +1145,7 @@ static int selectlevel(struct sokgame **gameslist, struct spritesstruct *sprites
   /* compute the last allowed level */
   i = 0; /* i will temporarily store the number of unsolved levels */
   for (maxallowedlevel = 0; maxallowedlevel < levelscount; maxallowedlevel++) {
-    if (gameslist[maxallowedlevel]->solution == NULL) i++;
+    if (sok_issolved(levelset, maxallowedlevel) == 0) i++;
     if (i > 3) break; /* user can see up to 3 unsolved levels */
   }
 
@@ -1138,11 +1156,11 @@ static int selectlevel(struct sokgame **gameslist, struct spritesstruct *sprites
     /* draw the screen */
     SDL_RenderClear(renderer);
     /* draw the level before */
-    if (selection > 0) blit_levelmap(gameslist[selection - 1], sprites, winw / 5, winh / 2, renderer, settings->nativetilesize, settings->tilesize / 4, 96, 0);
+    if ((selection > 0) && (sok_getlevel(levelset, selection - 1, &game) == 0)) blit_levelmap(&game, sprites, winw / 5, winh / 2, renderer, settings->nativetilesize, settings->tilesize / 4, 96, 0);
     /* draw the level after */
-    if (selection + 1 < maxallowedlevel) blit_levelmap(gameslist[selection + 1], sprites, winw * 4 / 5,  winh / 2, renderer, settings->nativetilesize, settings->tilesize / 4, 96, 0);
+    if ((selection + 1 < maxallowedlevel) && (sok_getlevel(levelset, selection + 1, &game) == 0)) blit_levelmap(&game, sprites, winw * 4 / 5,  winh / 2, renderer, settings->nativetilesize, settings->tilesize / 4, 96, 0);
     /* draw the selected level */
-    blit_levelmap(gameslist[selection], sprites,  winw / 2,  winh / 2, renderer, settings->nativetilesize, settings->tilesize / 3, 210, BLIT_LEVELMAP_BACKGROUND);
+    if (sok_getlevel(levelset, selection, &game) == 0) blit_levelmap(&game, sprites,  winw / 2,  winh / 2, renderer, settings->nativetilesize, settings->tilesize / 3, 210, BLIT_LEVELMAP_BACKGROUND);
     /* draw strings, etc */
     draw_string(levcomment, 100, 255, sprites, renderer, DRAWSTRING_CENTER, winh / 8, window, 1, 0);
     draw_string("(choose a level)", 100, 255, sprites, renderer, DRAWSTRING_CENTER, winh / 8 + 40, window, 1, 0);
@@ -1220,12 +1238,12 @@ static void setsokicon(SDL_Window *window) {
 }
 
 /* returns 1 if curlevel is the last level to solve in the set. returns 0 otherwise. */
-static int islevelthelastleft(struct sokgame **gamelist, int curlevel, int levelscount) {
+static int islevelthelastleft(struct soklevelset *levelset, int curlevel) {
   int x;
   if (curlevel < 0) return(0);
-  if (gamelist[curlevel]->solution != NULL) return(0);
-  for (x = 0; x < levelscount; x++) {
-    if ((gamelist[x]->solution == NULL) && (x != curlevel)) return(0);
+  if (sok_issolved(levelset, curlevel) != 0) return(0);
+  for (x = 0; x < levelset->count; x++) {
+    if ((x != curlevel) && (sok_issolved(levelset, x) == 0)) return(0);
   }
   return(1);
 }
@@ -1234,14 +1252,14 @@ static void dumplevel2clipboard(struct sokgame *game, char *history) {
   char *txt;
   long solutionlen = 0, playfieldsize;
   int x, y;
-  if (game->solution != NULL) solutionlen = strlen(game->solution);
+  if (history != NULL) solutionlen = strlen(history);
   playfieldsize = (game->field_width + 1) * game->field_height;
   txt = malloc(solutionlen + playfieldsize + 4096);
   if (txt == NULL) return;
   sprintf(txt, "; Level id: %lX\n\n", game->crc32);
   for (y = 0; y < game->field_height; y++) {
     for (x = 0; x < game->field_width; x++) {
-      switch (game->field[x][y] & ~field_floor) {
+      switch (sok_field(game, x, y) & ~field_floor) {
         case field_wall:
           strcat(txt, "#");
           break;
@@ -1447,12 +1465,14 @@ static int selectinternetlevel(SDL_Renderer *renderer, SDL_Window *window, struc
 }
 
 int main(int argc, char **argv) {
-  struct sokgame **gameslist, game;
+  struct soklevelset levelset;
+  struct sokgame game;
   struct sokgamestates *states;
+  struct sokhint *hint;
   struct spritesstruct spritesdata;
   struct spritesstruct *sprites = &spritesdata;
   int levelscount, curlevel, exitflag = 0, showhelp = 0, x, lastlevelleft;
-  int playsolution, drawscreenflags;
+  int playsolution, drawscreenflags, hintwait = 0;
   char *levelfile = NULL;
   char *playsource = NULL;
   char *levelslist = NULL;
@@ -1653,20 +1673,20 @@ int main(int argc, char **argv) {
   if ((settings.framedelay < 0) || (settings.framedelay > 64000)) settings.framedelay = 10500;
   if ((settings.framefreq < 1) || (settings.framefreq > 1000000)) settings.framefreq = 15000;
 
-  gameslist = malloc(sizeof(struct sokgame *) * MAXLEVELS);
-  if (gameslist == NULL) {
-    puts("Memory allocation failed!");
-    return(1);
-  }
+  memset(&levelset, 0, sizeof(levelset));
 
   states = sok_newstates();
   if (states == NULL) return(1);
 
+  /* hints are searched in the background, if the hint engine can't start the H key is simply ignored */
+  hint = sok_hint_new();
+
   GametypeSelectMenu:
   if (levelslist != NULL) {
     free(levelslist);
     levelslist = NULL;
   }
+  sok_freefile(&levelset);
   curlevel = -1;
   levelscount = -1;
   settings.tilesize = settings.nativetilesize;
@@ -1697,9 +1717,9 @@ int main(int argc, char **argv) {
 
   LoadLevelFile:
   if ((levelfile != NULL) && (exitflag == 0)) {
-      levelscount = sok_loadfile(gameslist, MAXLEVELS, levelfile, NULL, 0, levcomment, LEVCOMMENTMAXLEN);
+      levelscount = sok_loadfile(&levelset, levelfile, NULL, 0, levcomment, LEVCOMMENTMAXLEN, 0);
     } else if (exitflag == 0) {
-      levelscount = sok_loadfile(gameslist, MAXLEVELS, NULL, xsblevelptr, xsblevelptrlen, levcomment, LEVCOMMENTMAXLEN);
+      levelscount = sok_loadfile(&levelset, NULL, xsblevelptr, xsblevelptrlen, levcomment, LEVCOMMENTMAXLEN, 0);
   }
 
   if ((levelscount < 1) && (exitflag == 0)) {
@@ -1717,7 +1737,7 @@ int main(int argc, char **argv) {
   if (exitflag == 0) exitflag = flush_events();
 
   if (exitflag == 0) {
-    curlevel = selectlevel(gameslist, sprites, renderer, window, &settings, levcomment, levelscount, curlevel, &levelfile);
+    curlevel = selectlevel(&levelset, sprites, renderer, window, &settings, levcomment, curlevel, &levelfile);
     if (curlevel == SELECTLEVEL_BACK) {
         if (levelfile == NULL) {
             if (levelsource == LEVEL_INTERNET) goto LoadInternetLevels;
@@ -1732,15 +1752,19 @@ int main(int argc, char **argv) {
     }
   }
   if (exitflag == 0) fade2texture(renderer, window, sprites->black);
-  if (exitflag == 0) loadlevel(&game, gameslist[curlevel], states);
+  if ((exitflag == 0) && (loadlevel(&game, &levelset, curlevel, states) != 0)) {
+    puts("Memory allocation failed!");
+    exitflag = 1;
+  }
 
   /* here we start the actual game */
 
   settings.tilesize = settings.nativetilesize;
   if ((curlevel == 0) && (game.solution == NULL)) showhelp = 1;
   playsolution = 0;
+  hintwait = 0;
   drawscreenflags = 0;
-  if (exitflag == 0) lastlevelleft = islevelthelastleft(gameslist, curlevel, levelscount);
+  if (exitflag == 0) lastlevelleft = islevelthelastleft(&levelset, curlevel);
 
   while (exitflag == 0) {
     if (playsolution > 0) {
@@ -1748,20 +1772,26 @@ int main(int argc, char **argv) {
       } else {
         drawscreenflags &= ~DRAWSCREEN_PLAYBACK;
     }
+    if (hintwait != 0) {
+        drawscreenflags |= DRAWSCREEN_HINT;
+      } else {
+        drawscreenflags &= ~DRAWSCREEN_HINT;
+    }
     draw_screen(&game, states, sprites, renderer, window, &settings, 0, 0, 0, DRAWSCREEN_REFRESH | drawscreenflags, levcomment);
     if (showhelp != 0) {
       exitflag = displaytexture(renderer, sprites->help, window, -1, DISPLAYCENTERED, 255);
       draw_screen(&game, states, sprites, renderer, window, &settings, 0, 0, 0, DRAWSCREEN_REFRESH | drawscreenflags, levcomment);
       showhelp = 0;
     }
-    if (debugmode != 0) printf("history: %s\n", states->history);
+    if (debugmode != 0) printf("history: %s\n", states->history.moves);
 
     /* Wait for an event - but ignore 'KEYUP' and 'MOUSEMOTION' events, since they are worthless in this game */
     for (;;) {
       if (SDL_WaitEventTimeout(&event, 80) == 0) {
-        if (playsolution == 0) continue;
+        if ((playsolution == 0) && (hintwait == 0)) continue;
         event.type = SDL_KEYDOWN;
         event.key.keysym.sym = SDLK_F10;
+        if (playsolution == 0) event.key.keysym.sym = SDLK_h; /* ask the hint engine again */
       }
       if ((event.type != SDL_KEYUP) && (event.type != SDL_MOUSEMOTION)) break;
     }
@@ -1775,8 +1805,10 @@ int main(int argc, char **argv) {
           goto GametypeSelectMenu;
         }
       } else if (event.type == SDL_KEYDOWN) {
-        int res = 0, movedir = 0;
-        switch (normalizekeys(event.key.keysym.sym)) {
+        int res = 0, movedir = 0, key;
+        key = normalizekeys(event.key.keysym.sym);
+        if (key != KEY_H) hintwait = 0; /* any other key stops waiting for a hint (the search still goes on in the background) */
+        switch (key) {
           case KEY_LEFT:
             movedir = sokmoveLEFT;
             break;
@@ -1800,14 +1832,38 @@ int main(int argc, char **argv) {
             break;
           case KEY_R:
             playsolution = 0;
-            loadlevel(&game, gameslist[curlevel], states);
+            loadlevel(&game, &levelset, curlevel, states);
+            break;
+          case KEY_H: /* play the next push toward a solution */
+            if ((playsolution == 0) && (hint != NULL)) {
+              char *hintmoves;
+              enum SOKHINT hintres;
+              hintres = sok_hint_get(hint, &game, &hintmoves);
+              hintwait = 0;
+              if (hintres == sokhintREADY) {
+                  if (playsource != NULL) free(playsource);
+                  playsource = hintmoves;
+                  playsolution = 1;
+                } else if (hintres == sokhintBUSY) {
+                  hintwait = 1;
+                } else if (hintres == sokhintUNSOLVABLE) {
+                  exitflag = draw_message("no solution from here (backspace to undo)", 3, &game, states, sprites, renderer, window, &settings, drawscreenflags, levcomment);
+                } else if (hintres == sokhintGAVEUP) {
+                  exitflag = draw_message("no hint found, this position is too hard", 3, &game, states, sprites, renderer, window, &settings, drawscreenflags, levcomment);
+              }
+            }
             break;
           case KEY_F3: /* dump level & solution (if any) to clipboard */
-            dumplevel2clipboard(gameslist[curlevel], gameslist[curlevel]->solution);
+            {
+            struct sokgame *levelgame;
+            levelgame = malloc(sizeof(struct sokgame)); /* the level as it was before any move */
+            if ((levelgame != NULL) && (sok_getlevel(&levelset, curlevel, levelgame) == 0)) dumplevel2clipboard(levelgame, levelgame->solution);
+            if (levelgame != NULL) free(levelgame);
+            }
             exitflag = displaytexture(renderer, sprites->copiedtoclipboard, window, 2, DISPLAYCENTERED, 255);
             break;
           case KEY_CTRL_C:
-            dumplevel2clipboard(&game, states->history);
+            dumplevel2clipboard(&game, states->history.moves);
             exitflag = displaytexture(renderer, sprites->snapshottoclipboard, window, 2, DISPLAYCENTERED, 255);
             break;
           case KEY_CTRL_V:
@@ -1816,7 +1872,7 @@ int main(int argc, char **argv) {
             solFromClipboard = SDL_GetClipboardText();
             trimstr(solFromClipboard);
             if (isLegalSokoSolution(solFromClipboard) != 0) {
-                loadlevel(&game, gameslist[curlevel], states);
+                loadlevel(&game, &levelset, curlevel, states);
                 exitflag = displaytexture(renderer, sprites->playfromclipboard, window, 2, DISPLAYCENTERED, 255);
                 playsolution = 1;
                 if (playsource != NULL) free(playsource);
@@ -1833,7 +1889,7 @@ int main(int argc, char **argv) {
                   if (playsource != NULL) free(playsource);
                   playsource = unRLE(game.solution); /* I duplicate the solution string, because I want to free it later, since it can originate both from the game's solution as well as from a clipboard string */
                   if (playsource != NULL) {
-                    loadlevel(&game, gameslist[curlevel], states);
+                    loadlevel(&game, &levelset, curlevel, states);
                     playsolution = 1;
                   }
                 } else {
@@ -1859,7 +1915,7 @@ int main(int argc, char **argv) {
           case KEY_F5:
             if (playsolution == 0) {
               exitflag = displaytexture(renderer, sprites->saved, window, 1, DISPLAYCENTERED, 255);
-              solution_save(game.crc32, states->history, "sav");
+              solution_save(game.crc32, states->history.moves, "sav");
             }
             break;
           case KEY_F7:
@@ -1871,7 +1927,7 @@ int main(int argc, char **argv) {
               } else {
                 exitflag = displaytexture(renderer, sprites->loaded, window, 1, DISPLAYCENTERED, 255);
                 playsolution = 0;
-                loadlevel(&game, gameslist[curlevel], states);
+                loadlevel(&game, &levelset, curlevel, states);
                 sok_play(&game, states, loadsol);
                 free(loadsol);
             }
@@ -1979,8 +2035,10 @@ int main(int argc, char **argv) {
     if (exitflag != 0) break;
   }
 
-  /* free the states struct */
+  /* stop the hint engine and free the states struct */
+  sok_hint_free(hint);
   sok_freestates(states);
+  sok_freefile(&levelset);
 
   if (levelfile != NULL) free(levelfile);
 
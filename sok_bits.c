@@ -0,0 +1,218 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+#include <string.h>   /* memset() */
+#include "sok_core.h"
+#include "sok_bits.h"
+
+#define BIT(x) (((uint64_t)1) << (x))
+
+/* returns the number of bits set in a row */
+static int bitcount(uint64_t row) {
+  int res = 0;
+  while (row != 0) {
+    row &= row - 1;
+    res += 1;
+  }
+  return(res);
+}
+
+uint64_t sok_bits_rowfill(uint64_t seed, uint64_t free) {
+  uint64_t left = seed, right = seed, proleft = free, proright = free;
+  left |= proleft & (left << 1);
+  proleft &= proleft << 1;
+  left |= proleft & (left << 2);
+  proleft &= proleft << 2;
+  left |= proleft & (left << 4);
+  proleft &= proleft << 4;
+  left |= proleft & (left << 8);
+  proleft &= proleft << 8;
+  left |= proleft & (left << 16);
+  proleft &= proleft << 16;
+  left |= proleft & (left << 32);
+  right |= proright & (right >> 1);
+  proright &= proright >> 1;
+  right |= proright & (right >> 2);
+  proright &= proright >> 2;
+  right |= proright & (right >> 4);
+  proright &= proright >> 4;
+  right |= proright & (right >> 8);
+  proright &= proright >> 8;
+  right |= proright & (right >> 16);
+  proright &= proright >> 16;
+  right |= proright & (right >> 32);
+  return(left | right);
+}
+
+void sok_bits_fromgame(struct sokbitboard *bits, struct sokgame *game) {
+  int x, y;
+  unsigned char *tile = game->field;
+  memset(bits, 0, sizeof(struct sokbitboard));
+  bits->field_width = game->field_width;
+  bits->field_height = game->field_height;
+  bits->positionx = game->positionx;
+  bits->positiony = game->positiony;
+  for (y = 0; y < 64; y++) {
+    for (x = 0; x < field_stride; x++) {
+      if (*tile & field_floor) bits->floor[y] |= BIT(x);
+      if (*tile & field_atom) bits->atom[y] |= BIT(x);
+      if (*tile & field_goal) bits->goal[y] |= BIT(x);
+      if ((*tile & (field_goal | field_atom)) == field_goal) bits->goalsleft += 1;
+      if (*tile & field_wall) bits->wall[y] |= BIT(x);
+      tile += 1;
+    }
+  }
+}
+
+void sok_bits_togame(struct sokgame *game, struct sokbitboard *bits) {
+  int x, y;
+  unsigned char *tile = game->field;
+  game->field_width = bits->field_width;
+  game->field_height = bits->field_height;
+  game->positionx = bits->positionx;
+  game->positiony = bits->positiony;
+  game->goalsleft = bits->goalsleft;
+  game->atoms = 0;
+  game->goals = 0;
+  game->deadatoms = 0;
+  for (y = 0; y < 64; y++) {
+    for (x = 0; x < field_stride; x++) {
+      *tile = 0;
+      if (bits->floor[y] & BIT(x)) *tile |= field_floor;
+      if (bits->atom[y] & BIT(x)) *tile |= field_atom;
+      if (bits->goal[y] & BIT(x)) *tile |= field_goal;
+      if (bits->wall[y] & BIT(x)) *tile |= field_wall;
+      tile += 1;
+    }
+    game->atoms += bitcount(bits->atom[y]);
+    game->goals += bitcount(bits->goal[y]);
+    game->deadatoms += bitcount(bits->atom[y] & game->deadsquares[y]); /* dead squares share the layout of bitboard rows */
+  }
+  game->atomshash = sok_hashatoms(game);
+}
+
+int sok_bits_solved(struct sokbitboard *bits) {
+  return(bits->goalsleft == 0);
+}
+
+int sok_bits_move(struct sokbitboard *bits, enum SOKMOVE dir) {
+  int res = 0, alreadysolved;
+  int x, y, vectorx = 0, vectory = 0;
+  switch (dir) {
+    case sokmoveUP:
+      vectory = -1;
+      break;
+    case sokmoveRIGHT:
+      vectorx = 1;
+      break;
+    case sokmoveDOWN:
+      vectory = 1;
+      break;
+    case sokmoveLEFT:
+      vectorx = -1;
+      break;
+  }
+  /* x/y are bitboard coordinates, ie. field coordinates + 1. there is no need for bound checking, since the field is surrounded by walls */
+  x = bits->positionx + 1 + vectorx;
+  y = bits->positiony + 1 + vectory;
+  if (bits->wall[y] & BIT(x)) return(-1);
+  alreadysolved = (bits->goalsleft == 0);
+  /* is there an atom on our way? */
+  if (bits->atom[y] & BIT(x)) {
+    int nextx = x + vectorx, nexty = y + vectory;
+    if (alreadysolved != 0) return(-1);
+    if ((bits->wall[nexty] | bits->atom[nexty]) & BIT(nextx)) return(-1);
+    res |= sokmove_pushed;
+    if (bits->goal[nexty] & BIT(nextx)) res |= sokmove_ongoal;
+    bits->atom[y] &= ~BIT(x);
+    bits->atom[nexty] |= BIT(nextx);
+    if (bits->goal[y] & BIT(x)) bits->goalsleft += 1;
+    if (res & sokmove_ongoal) bits->goalsleft -= 1;
+  }
+  bits->positionx = x - 1;
+  bits->positiony = y - 1;
+  if ((alreadysolved == 0) && (bits->goalsleft == 0)) res |= sokmove_solved;
+  return(res);
+}
+
+void sok_bits_reach(struct sokbitboard *bits, uint64_t *reach) {
+  int y, changed;
+  uint64_t row, free;
+  memset(reach, 0, sizeof(uint64_t) * 64);
+  if ((bits->positionx < 0) || (bits->positionx > 61) || (bits->positiony < 0) || (bits->positiony > 61)) return;
+  reach[bits->positiony + 1] = BIT(bits->positionx + 1);
+  /* sweep down then up, spreading every row sideways, until nothing changes anymore */
+  do {
+    changed = 0;
+    for (y = 0; y < 64; y++) {
+      free = ~(bits->wall[y] | bits->atom[y]);
+      row = reach[y];
+      if (y > 0) row |= reach[y - 1];
+      if (y < 63) row |= reach[y + 1];
+      row = sok_bits_rowfill(row & free, free);
+      if ((row | reach[y]) != reach[y]) {
+        reach[y] |= row;
+        changed = 1;
+      }
+    }
+    for (y = 63; y >= 0; y--) {
+      free = ~(bits->wall[y] | bits->atom[y]);
+      row = reach[y];
+      if (y > 0) row |= reach[y - 1];
+      if (y < 63) row |= reach[y + 1];
+      row = sok_bits_rowfill(row & free, free);
+      if ((row | reach[y]) != reach[y]) {
+        reach[y] |= row;
+        changed = 1;
+      }
+    }
+  } while (changed != 0);
+}
+
+int sok_bits_deadlock(struct sokbitboard *bits) {
+  int y, atoms = 0, goals = 0;
+  uint64_t stuck, walls_v, walls_h, occupied, occupiednext, block, stuckblock;
+  /* spare atoms may be left anywhere */
+  for (y = 0; y < 64; y++) {
+    atoms += bitcount(bits->atom[y]);
+    goals += bitcount(bits->goal[y]);
+  }
+  if (atoms != goals) return(0);
+  for (y = 0; y < 64; y++) {
+    stuck = bits->atom[y] & ~bits->goal[y]; /* atoms that are not on a goal yet */
+    /* atom in a corner: a wall on its left or right, and another above or below */
+    walls_v = 0;
+    if (y > 0) walls_v |= bits->wall[y - 1];
+    if (y < 63) walls_v |= bits->wall[y + 1];
+    walls_h = (bits->wall[y] << 1) | (bits->wall[y] >> 1);
+    if (stuck & walls_v & walls_h) return(1);
+    /* 2x2 block made only of walls and atoms, with at least one atom not on a goal. block has bit x set if the block starts at x,y */
+    if (y < 63) {
+      occupied = bits->wall[y] | bits->atom[y];
+      occupiednext = bits->wall[y + 1] | bits->atom[y + 1];
+      block = occupied & occupiednext & (occupied >> 1) & (occupiednext >> 1);
+      stuckblock = stuck | (bits->atom[y + 1] & ~bits->goal[y + 1]);
+      stuckblock |= stuckblock >> 1;
+      if (block & stuckblock) return(1);
+    }
+  }
+  return(0);
+}
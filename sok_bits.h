@@ -0,0 +1,67 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef sok_bits_h_sentinel
+#define sok_bits_h_sentinel
+
+  #include <stdint.h>
+  #include "sok_core.h"
+
+  /* packed representation of a game: one bitplane per field flag, one 64-bit word per row. rows and bits follow the field's storage,
+   * including its border of walls: bit x + 1 of row y + 1 is the tile at position x,y. the player position is kept in field coordinates. */
+  struct sokbitboard {
+    int field_width;
+    int field_height;
+    int positionx;
+    int positiony;
+    int goalsleft;      /* number of goals without an atom on them, kept up to date by sok_bits_move() */
+    uint64_t floor[64];
+    uint64_t atom[64];
+    uint64_t goal[64];
+    uint64_t wall[64];
+  };
+
+  /* fills a bitboard with the content of a game */
+  void sok_bits_fromgame(struct sokbitboard *bits, struct sokgame *game);
+
+  /* writes the content of a bitboard back into a game's field, size and player position, and recomputes the counters and the atoms
+   * hash that go with them (the game's dead squares are kept as-is) */
+  void sok_bits_togame(struct sokgame *game, struct sokbitboard *bits);
+
+  /* checks if the board is solved. returns 0 if not, non-zero otherwise. */
+  int sok_bits_solved(struct sokbitboard *bits);
+
+  /* try to move the player in a direction. returns a negative value if move has been denied, or a sokmove bitfield otherwise. */
+  int sok_bits_move(struct sokbitboard *bits, enum SOKMOVE dir);
+
+  /* spreads the seed bits to the left and to the right of a row, as long as they travel through free bits, and returns the result
+   * (occluded fill, 6 steps per direction). that's the row step of every flood fill done on bit rows, sok_reach() included. */
+  uint64_t sok_bits_rowfill(uint64_t seed, uint64_t free);
+
+  /* fills reach (64 rows, same layout as the bitboard) with the set of tiles the player can walk to without pushing anything */
+  void sok_bits_reach(struct sokbitboard *bits, uint64_t *reach);
+
+  /* returns non-zero if the board contains an atom that can never be moved to a goal anymore: an atom off goal stuck in a corner, or
+   * a 2x2 block of walls and atoms with an atom off goal. that's a quick whole-board test, weaker than sok_deadlock_check() on
+   * purpose (no dead squares, no freeze chains, no corrals). levels with more atoms than goals are never reported. */
+  int sok_bits_deadlock(struct sokbitboard *bits);
+
+#endif
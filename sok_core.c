@@ -23,10 +23,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#ifdef _WIN32
+#include <windows.h>  /* CreateFileMapping(), MapViewOfFile() */
+#else
+#include <fcntl.h>    /* open() */
+#include <unistd.h>   /* close() */
+#include <sys/mman.h> /* mmap() */
+#include <sys/stat.h> /* fstat() */
+#endif
+#include <SDL2/SDL.h>    /* threads */
 #include "crc32.h"
 #include "gz.h"
 #include "save.h"
+#include "sok_bits.h"
 #include "sok_core.h"
+#include "sok_deadlock.h"
 
 enum errorslist {
   ERR_UNDEFINED = -1,
@@ -35,7 +46,6 @@ enum errorslist {
   ERR_LEVEL_TOO_SMALL = -4,
   ERR_MEM_ALLOC_FAILED = -5,
   ERR_NO_LEVEL_DATA_FOUND = -6,
-  ERR_TOO_MANY_LEVELS_IN_SET = -7,
   ERR_UNABLE_TO_OPEN_FILE = -8,
   ERR_PLAYER_POS_UNDEFINED = -9
 };
@@ -47,7 +57,6 @@ char *sok_strerr(enum errorslist errid) {
     case ERR_LEVEL_TOO_SMALL: return("Level dimentions too small");
     case ERR_MEM_ALLOC_FAILED: return("Memory allocation failed - out of memory?");
     case ERR_NO_LEVEL_DATA_FOUND: return("No level data found in file");
-    case ERR_TOO_MANY_LEVELS_IN_SET: return("Too many levels in set");
     case ERR_UNABLE_TO_OPEN_FILE: return("Failed to open file");
     case ERR_UNDEFINED: return("Undefined error");
     case ERR_PLAYER_POS_UNDEFINED: return("Player position not defined");
@@ -91,42 +100,285 @@ long sok_history_getpushes(char *history) {
   return(res);
 }
 
-static struct sokgame *sok_allocgame(void) {
-  struct sokgame *result;
-  result = malloc(sizeof(struct sokgame));
-  return(result);
+/* returns the zobrist key of a field tile. keys are computed on the fly with the splitmix64 finalizer, which gives well-spread,
+ * reproducible values without any table to initialize. kind is 0 for atoms and 1 for the player. */
+static uint64_t zobristkey(int tileidx, int kind) {
+  uint64_t key;
+  key = (uint64_t)(tileidx + kind * field_tiles) + 1;
+  key *= 0x9E3779B97F4A7C15ull;
+  key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+  key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+  return(key ^ (key >> 31));
 }
 
-static void sok_freegame(struct sokgame *game) {
-  if (game == NULL) return;
-  if (game->solution != NULL) free(game->solution);
-  free(game);
+uint64_t sok_hashatoms(struct sokgame *game) {
+  int i;
+  uint64_t res = 0;
+  for (i = 0; i < field_tiles; i++) {
+    if (game->field[i] & field_atom) res ^= zobristkey(i, 0);
+  }
+  return(res);
 }
 
-/* free a list of allocated games */
-void sok_freefile(struct sokgame **gamelist, int gamescount) {
+/* returns the bits of a field row whose tiles have none of the blockers flags */
+static uint64_t freetiles(unsigned char *row, int blockers) {
+  uint64_t res = 0;
   int x;
-  for (x = 0; x < gamescount; x++) {
-    sok_freegame(gamelist[x]);
+  for (x = field_stride - 1; x >= 0; x--) res = (res << 1) | ((row[x] & blockers) == 0);
+  return(res);
+}
+
+/* scanline flood fill, working on whole rows at once: marks in filled (one word per field row) all the tiles connected to start that
+ * have none of the blockers flags. returns the field index of the top-left-most tile filled, or -1 if start itself is blocked. */
+static int floodfill(unsigned char *field, int start, int blockers, uint64_t *filled) {
+  uint64_t freerows[64], seeds[64], known = 0, queued = 0, span, newseeds;
+  unsigned char stack[64]; /* rows with seeds waiting to be filled, each row is queued at most once at any time */
+  int stacklen = 0, row, adjrow, x;
+  memset(filled, 0, sizeof(uint64_t) * 64);
+  if (field[start] & blockers) return(-1);
+  row = start / field_stride;
+  seeds[row] = (uint64_t)1 << (start % field_stride);
+  stack[stacklen++] = row;
+  queued |= (uint64_t)1 << row;
+  while (stacklen > 0) {
+    row = stack[--stacklen];
+    queued &= ~((uint64_t)1 << row);
+    if (((known >> row) & 1) == 0) {
+      freerows[row] = freetiles(field + row * field_stride, blockers);
+      known |= (uint64_t)1 << row;
+    }
+    span = seeds[row] & ~filled[row];
+    if (span == 0) continue;
+    /* narrow corridors are common: only go for the full fill if the span grows at all */
+    if ((((span << 1) | (span >> 1)) & freerows[row] & ~span) != 0) span = sok_bits_rowfill(span, freerows[row]);
+    filled[row] |= span;
+    /* seed the rows above and below with the free tiles that touch the new span */
+    for (adjrow = row - 1; adjrow <= row + 1; adjrow += 2) {
+      if ((adjrow < 0) || (adjrow > 63)) continue;
+      if (((known >> adjrow) & 1) == 0) {
+        freerows[adjrow] = freetiles(field + adjrow * field_stride, blockers);
+        known |= (uint64_t)1 << adjrow;
+      }
+      newseeds = span & freerows[adjrow] & ~filled[adjrow];
+      if (newseeds == 0) continue;
+      if ((queued >> adjrow) & 1) {
+          seeds[adjrow] |= newseeds;
+        } else {
+          seeds[adjrow] = newseeds;
+          stack[stacklen++] = adjrow;
+          queued |= (uint64_t)1 << adjrow;
+      }
+    }
+  }
+  /* the top-left-most tile is the lowest bit of the first row filled */
+  for (row = 0; filled[row] == 0; row++);
+  for (x = 0; ((filled[row] >> x) & 1) == 0; x++);
+  return(row * field_stride + x);
+}
+
+int sok_reach(struct sokgame *game, uint64_t *reach) {
+  return(floodfill(game->field, sok_fieldidx(game->positionx, game->positiony), field_wall | field_atom, reach));
+}
+
+uint64_t sok_hashposition(struct sokgame *game) {
+  uint64_t reach[64];
+  return(game->atomshash ^ zobristkey(sok_reach(game, reach), 1));
+}
+
+/* attaches a solution string to a game, and caches its amount of moves and pushes */
+static void sok_setsolution(struct sokgame *game, char *solution) {
+  game->solution = solution;
+  game->solutionlen = sok_history_getlen(solution);
+  game->solutionpushes = sok_history_getpushes(solution);
+}
+
+/* the levels parsed from a set are carved out of a chain of arena blocks, rather than malloc()'ed one by one. blocks get twice as
+ * large every time (up to ARENA_MAXBLOCK bytes), so a set where only a few levels are looked at takes little memory, while parsing
+ * a whole set of 100k levels takes only a few dozens of allocations. all the blocks are released at once by sok_freefile(). */
+#define ARENA_MINBLOCK 65536L
+#define ARENA_MAXBLOCK 4194304L
+
+struct arenablock {
+  struct arenablock *next;  /* the block allocated before this one */
+  long size;                /* bytes in data */
+  long used;                /* bytes of data handed out so far */
+  uint64_t data[1];         /* size bytes, 8-byte aligned */
+};
+
+/* returns size bytes (8-byte aligned) from the arena of set, or NULL if out of memory */
+static void *arenaalloc(struct soklevelset *set, long size) {
+  struct arenablock *block = set->arena;
+  long blocksize;
+  size = (size + 7) & ~7L;
+  if ((block == NULL) || (block->used + size > block->size)) {
+    blocksize = (block == NULL) ? ARENA_MINBLOCK : block->size * 2;
+    if (blocksize > ARENA_MAXBLOCK) blocksize = ARENA_MAXBLOCK;
+    if (blocksize < size) blocksize = size;
+    block = malloc(sizeof(struct arenablock) - sizeof(uint64_t) + blocksize);
+    if (block == NULL) return(NULL);
+    block->next = set->arena;
+    block->size = blocksize;
+    block->used = 0;
+    set->arena = block;
+  }
+  block->used += size;
+  return((unsigned char *)(block->data) + block->used - size);
+}
+
+/* a parsed level at rest, in the arena of its set: what can't be computed back cheaply, and the field tiles over the width and the
+ * height of the level only (the surrounding tiles are all void, but for the walls of the border), packed two per byte since field
+ * values fit in 4 bits. a 7x7 level takes 56 bytes instead of the 4.7 KB of a struct sokgame. */
+struct sokpackedlevel {
+  char *solution;
+  long solutionlen;
+  long solutionpushes;
+  unsigned char width;
+  unsigned char height;
+  unsigned char positionx;
+  unsigned char positiony;
+  unsigned char tiles[1];  /* (width * height + 1) / 2 bytes, row after row, the first tile of each pair in the low nibble */
+};
+
+/* same as sok_setsolution(), for a packed level */
+static void setpackedsolution(struct sokpackedlevel *packed, char *solution) {
+  packed->solution = solution;
+  packed->solutionlen = sok_history_getlen(solution);
+  packed->solutionpushes = sok_history_getpushes(solution);
+}
+
+/* packs the field of a freshly loaded game into the arena of set. returns NULL if out of memory. */
+static struct sokpackedlevel *packlevel(struct soklevelset *set, struct sokgame *game) {
+  struct sokpackedlevel *packed;
+  int x, y, i = 0;
+  packed = arenaalloc(set, sizeof(struct sokpackedlevel) - 1 + (game->field_width * game->field_height + 1) / 2);
+  if (packed == NULL) return(NULL);
+  packed->width = game->field_width;
+  packed->height = game->field_height;
+  packed->positionx = game->positionx;
+  packed->positiony = game->positiony;
+  for (y = 0; y < game->field_height; y++) {
+    for (x = 0; x < game->field_width; x++, i++) {
+      if (i & 1) {
+          packed->tiles[i / 2] |= sok_field(game, x, y) << 4;
+        } else {
+          packed->tiles[i / 2] = sok_field(game, x, y);
+      }
+    }
+  }
+  return(packed);
+}
+
+/* the reverse of packlevel(): rebuilds the field of game, as loadlevelfromfile() left it */
+static void unpacklevel(struct sokgame *game, struct sokpackedlevel *packed) {
+  int x, y, i = 0;
+  game->field_width = packed->width;
+  game->field_height = packed->height;
+  game->positionx = packed->positionx;
+  game->positiony = packed->positiony;
+  memset(game->field, 0, sizeof(game->field));
+  for (x = -1; x < 63; x++) {
+    sok_field(game, x, -1) = field_wall;
+    sok_field(game, x, 62) = field_wall;
+    sok_field(game, -1, x) = field_wall;
+    sok_field(game, 62, x) = field_wall;
+  }
+  for (y = 0; y < game->field_height; y++) {
+    for (x = 0; x < game->field_width; x++, i++) {
+      sok_field(game, x, y) = (packed->tiles[i / 2] >> ((i & 1) * 4)) & 15;
+    }
+  }
+}
+
+/* memory-maps a file read-only into set->map, so it can be parsed in place. returns the file size on success, -1 otherwise (the
+ * file doesn't exist, it is empty, or it is not a regular file). */
+static long mapfile(struct soklevelset *set, char *file) {
+  long size;
+#ifdef _WIN32
+  HANDLE fh, mh;
+  LARGE_INTEGER fsize;
+  fh = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (fh == INVALID_HANDLE_VALUE) return(-1);
+  if ((GetFileSizeEx(fh, &fsize) == 0) || (fsize.QuadPart < 1) || (fsize.QuadPart > 0x7fffffff)) {
+    CloseHandle(fh);
+    return(-1);
+  }
+  size = (long)fsize.QuadPart;
+  mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(fh);
+  if (mh == NULL) return(-1);
+  set->map = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+  if (set->map == NULL) {
+    CloseHandle(mh);
+    return(-1);
   }
+  set->maphandle = mh;
+#else
+  struct stat st;
+  void *map;
+  int fd;
+  fd = open(file, O_RDONLY);
+  if (fd < 0) return(-1);
+  if ((fstat(fd, &st) != 0) || (!S_ISREG(st.st_mode)) || (st.st_size < 1) || (st.st_size > 0x7fffffff)) {
+    close(fd);
+    return(-1);
+  }
+  size = (long)st.st_size;
+  map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return(-1);
+  set->map = map;
+#endif
+  set->mapsize = size;
+  return(size);
 }
 
-/* reads a byte from memory of from a file, whichever is passed as a parameter */
-static int readbytefrommem(unsigned char **memptr) {
-  int result = -1;
-  if (memptr != NULL) {
-    result = **memptr;
-    *memptr += 1;
-    if (result == 0) result = -1;
+/* releases the file mapping of a set, if any */
+static void unmapfile(struct soklevelset *set) {
+  if (set->map == NULL) return;
+#ifdef _WIN32
+  UnmapViewOfFile(set->map);
+  CloseHandle(set->maphandle);
+#else
+  munmap(set->map, set->mapsize);
+#endif
+  set->map = NULL;
+}
+
+/* free a level set, along with all the levels parsed from it */
+void sok_freefile(struct soklevelset *set) {
+  struct arenablock *block;
+  int x;
+  if (set->levels != NULL) {
+    for (x = 0; x < set->count; x++) {
+      if ((set->levels[x].packed != NULL) && (set->levels[x].packed->solution != NULL)) free(set->levels[x].packed->solution);
+    }
+    free(set->levels);
   }
+  while (set->arena != NULL) {
+    block = set->arena;
+    set->arena = block->next;
+    free(block);
+  }
+  if (set->allocptr != NULL) free(set->allocptr);
+  unmapfile(set);
+  memset(set, 0, sizeof(struct soklevelset));
+}
+
+/* reads a byte from memory, up to memend (excluded). returns -1 at the end of data, or on a null byte. */
+static int readbytefrommem(unsigned char **memptr, unsigned char *memend) {
+  int result;
+  if (*memptr >= memend) return(-1);
+  result = **memptr;
+  *memptr += 1;
+  if (result == 0) result = -1;
   return(result);
 }
 
-/* reads a single RLE chunk from file fd, fills bytebuff with the actual data byte and returns the amount of times it should be repeated. returns -1 on error (like end of file). */
-static int readRLEbyte(unsigned char **memptr, int *bytebuff) {
+/* reads a single RLE chunk from memory, fills bytebuff with the actual data byte and returns the amount of times it should be repeated. returns -1 on error (like end of file). */
+static int readRLEbyte(unsigned char **memptr, unsigned char *memend, int *bytebuff) {
   int rleprefix = -1;
   for (;;) { /* RLE support */
-      *bytebuff = readbytefrommem(memptr);
+      *bytebuff = readbytefrommem(memptr, memend);
       if (*bytebuff < 0) return(-1);
       if ((*bytebuff >= '0') && (*bytebuff <= '9')) {
         if (rleprefix > 0) {
@@ -143,44 +395,60 @@ static int readRLEbyte(unsigned char **memptr, int *bytebuff) {
   return(rleprefix);
 }
 
-/* floodfill algorithm to fill areas of a playfield that are not contained in walls */
-static void floodFillField(struct sokgame *game, int x, int y) {
-  if ((x >= 0) && (x < 64) && (y >= 0) && (y < 64) && (game->field[x][y] == field_floor)) {
-    game->field[x][y] = 0; /* set the 'pixel' before starting recursion */
-    floodFillField(game, x + 1, y);
-    floodFillField(game, x - 1, y);
-    floodFillField(game, x, y + 1);
-    floodFillField(game, x, y - 1);
+/* finds out the dead squares of a level, ie. the squares from where an atom can never be pushed to any goal: starting from goals,
+ * atoms are pulled in all directions, and every square they can't be pulled to is dead. */
+static void computedeadsquares(struct sokgame *game) {
+  static const int vectors[4] = {-field_stride, 1, field_stride, -1};
+  short queue[field_tiles];
+  unsigned char live[field_tiles];
+  int queuehead = 0, queuetail = 0, tile, from, d;
+  memset(live, 0, sizeof(live));
+  memset(game->deadsquares, 0, sizeof(game->deadsquares));
+  for (tile = 0; tile < field_tiles; tile++) {
+    if ((game->field[tile] & (field_goal | field_wall)) != field_goal) continue;
+    live[tile] = 1;
+    queue[queuetail++] = tile;
+  }
+  /* an atom can be pulled from tile to tile + vector if there is floor on both tile + vector and tile + 2 * vector (where the player stands) */
+  while (queuehead < queuetail) {
+    tile = queue[queuehead++];
+    for (d = 0; d < 4; d++) {
+      from = tile + vectors[d];
+      if ((live[from] != 0) || ((game->field[from] & (field_floor | field_wall)) != field_floor)) continue;
+      if ((game->field[from + vectors[d]] & (field_floor | field_wall)) != field_floor) continue;
+      live[from] = 1;
+      queue[queuetail++] = from;
+    }
+  }
+  for (tile = 0; tile < field_tiles; tile++) {
+    if ((live[tile] == 0) && ((game->field[tile] & (field_floor | field_wall)) == field_floor)) game->deadsquares[tile / field_stride] |= (uint64_t)1 << (tile % field_stride);
   }
 }
 
-
-/* loads the next level from open file fd. returns 0 on success, 1 on success with end of file reached, or -1 on error. */
-static int loadlevelfromfile(struct sokgame *game, unsigned char **memptr, char *comment, int maxcommentlen) {
+/* loads the field of the next level from memptr (never reading memend or beyond) and computes its id (the rest of the game struct
+ * is filled by preparelevel()). returns 0 on success, 1 on success with end of file reached, or a negative error code. */
+static int loadlevelfromfile(struct sokgame *game, unsigned char **memptr, unsigned char *memend, char *comment, int maxcommentlen) {
   int leveldatastarted = 0, endoffile = 0;
   int x, y, bytebuff;
   int commentfound = 0;
   char *origcomment = comment;
+  uint64_t outside[64];
   game->positionx = -1;
   game->positiony = -1;
   game->field_width = 0;
   game->field_height = 0;
-  game->solution = NULL;
+  sok_setsolution(game, NULL);
   if ((comment != NULL) && (maxcommentlen > 0)) *comment = 0;
 
-  /* Fill the area with floor */
-  for (y = 0; y < 64; y++) {
-    for (x = 0; x < 64; x++) {
-      game->field[x][y] = field_floor;
-    }
-  }
+  /* Fill the area with floor (including the border, so the fill function is able to get around the level) */
+  memset(game->field, field_floor, sizeof(game->field));
 
   x = 0;
   y = 0;
 
   for (;;) {
     int rleprefix;
-    rleprefix = readRLEbyte(memptr, &bytebuff);
+    rleprefix = readRLEbyte(memptr, memend, &bytebuff);
     if (rleprefix < 0) endoffile = 1;
     if (endoffile != 0) break;
     for (; rleprefix > 0; rleprefix--) {
@@ -188,30 +456,30 @@ static int loadlevelfromfile(struct sokgame *game, unsigned char **memptr, char
         case ' ': /* empty space */
         case '-': /* dash (-) and underscore (_) are sometimes used to denote empty spaces */
         case '_':
-          game->field[x + 1][y + 1] |= field_floor;
+          sok_field(game, x, y) |= field_floor;
           x += 1;
           break;
         case '#': /* wall */
-          game->field[x + 1][y + 1] |= field_wall;
+          sok_field(game, x, y) |= field_wall;
           x += 1;
           break;
         case '@': /* player */
-          game->field[x + 1][y + 1] |= field_floor;
+          sok_field(game, x, y) |= field_floor;
           game->positionx = x;
           game->positiony = y;
           x += 1;
           break;
         case '*': /* atom on goal */
-          game->field[x + 1][y + 1] |= field_goal;
+          sok_field(game, x, y) |= field_goal;
         case '$': /* atom */
-          game->field[x + 1][y + 1] |= field_atom;
+          sok_field(game, x, y) |= field_atom;
           x += 1;
           break;
         case '+': /* player on goal */
           game->positionx = x;
           game->positiony = y;
         case '.': /* goal */
-          game->field[x + 1][y + 1] |= field_goal;
+          sok_field(game, x, y) |= field_goal;
           x += 1;
           break;
         case '\n': /* next row */
@@ -225,7 +493,7 @@ static int loadlevelfromfile(struct sokgame *game, unsigned char **memptr, char
           if (leveldatastarted != 0) leveldatastarted = -1;
           if ((commentfound == 0) && (comment != NULL)) commentfound = -1;
           for (;;) {
-            bytebuff = readbytefrommem(memptr);
+            bytebuff = readbytefrommem(memptr, memend);
             if (bytebuff == '\r') continue;
             if (bytebuff == '\n') break;
             if (bytebuff < 0) {
@@ -265,20 +533,26 @@ static int loadlevelfromfile(struct sokgame *game, unsigned char **memptr, char
   if (game->field_width < 1) return(ERR_LEVEL_TOO_SMALL);
   if (leveldatastarted == 0) return(ERR_NO_LEVEL_DATA_FOUND);
 
-  /* remove floors around the level */
-  floodFillField(game, 63, 63);
-
-  /* move the field by -1 vertically and horizontally to remove the additional row and column added for the fill function to be able to get around the field. */
-  for (y = 0; y < 63; y++) {
-    for (x = 0; x < 63; x++) {
-      game->field[x][y] = game->field[x + 1][y + 1];
+  /* remove floors around the level: everything made only of floor that connects to the bottom-right corner */
+  if (floodfill(game->field, sok_fieldidx(62, 62), ~field_floor, outside) >= 0) {
+    for (x = 0; x < field_tiles; x++) {
+      if ((outside[x / field_stride] >> (x % field_stride)) & 1) game->field[x] = 0;
     }
   }
-  /* compute the CRC32 of the field */
+
+  /* turn the border of the field into walls */
+  for (x = -1; x < 63; x++) {
+    sok_field(game, x, -1) = field_wall;
+    sok_field(game, x, 62) = field_wall;
+    sok_field(game, -1, x) = field_wall;
+    sok_field(game, 62, x) = field_wall;
+  }
+
+  /* compute the CRC32 of the field (yes, the loop bounds are swapped - but that's how level ids have always been computed, and solutions are saved under these ids) */
   game->crc32 = crc32_init();
   for (y = 0; y < game->field_width; y++) {
     for (x = 0; x < game->field_height; x++) {
-      crc32_feed(&(game->crc32), &(game->field[x][y]), 1);
+      crc32_feed(&(game->crc32), &(sok_field(game, x, y)), 1);
     }
   }
   crc32_finish(&(game->crc32));
@@ -287,7 +561,35 @@ static int loadlevelfromfile(struct sokgame *game, unsigned char **memptr, char
   return(0);
 }
 
-/* loads a file to memory. returns the file size on success, -1 otherwise. */
+/* computes everything a freshly loaded level needs to be played, besides its field */
+static void preparelevel(struct sokgame *game) {
+  int x, y;
+
+  game->atomshash = sok_hashatoms(game);
+
+  /* count goals that still wait for an atom - sok_move() and sok_undo() keep this up to date afterwards */
+  game->goalsleft = 0;
+  game->atoms = 0;
+  game->goals = 0;
+  for (y = 0; y < game->field_height; y++) {
+    for (x = 0; x < game->field_width; x++) {
+      if ((sok_field(game, x, y) & (field_goal | field_atom)) == field_goal) game->goalsleft += 1;
+      if (sok_field(game, x, y) & field_atom) game->atoms += 1;
+      if (sok_field(game, x, y) & field_goal) game->goals += 1;
+    }
+  }
+
+  /* dead squares never change during a game, so they are computed once for all */
+  computedeadsquares(game);
+  game->deadatoms = 0;
+  for (y = 0; y < game->field_height; y++) {
+    for (x = 0; x < game->field_width; x++) {
+      if ((sok_field(game, x, y) & field_atom) && (sok_isdead(game, sok_fieldidx(x, y)))) game->deadatoms += 1;
+    }
+  }
+}
+
+/* loads a file to memory, for files that can't be mapped. returns the file size on success, -1 otherwise. */
 static long loadfile2mem(char *file, unsigned char **memptr) {
   long filesize;
   FILE *fd;
@@ -297,12 +599,17 @@ static long loadfile2mem(char *file, unsigned char **memptr) {
   /* get file size */
   fseek(fd, 0, SEEK_END);
   filesize = ftell(fd);
-  if (filesize <= 0) return(-1);
+  if (filesize <= 0) {
+    fclose(fd);
+    return(-1);
+  }
   rewind(fd);
   /* allocate mem */
-  *memptr = malloc(filesize + 1); /* +1 because I always want to add a NULL terminator at the end */
-  if (*memptr == NULL) return(-1);
-  (*memptr)[filesize] = 0;
+  *memptr = malloc(filesize);
+  if (*memptr == NULL) {
+    fclose(fd);
+    return(-1);
+  }
   /* load file to mem */
   if (fread(*memptr, 1, filesize, fd) != (unsigned long)filesize) {
     fclose(fd);
@@ -314,13 +621,100 @@ static long loadfile2mem(char *file, unsigned char **memptr) {
   return(filesize);
 }
 
-/* load levels from a file, and put them into an array of up to maxlevels levels */
-int sok_loadfile(struct sokgame **gamelist, int maxlevels, char *gamelevel, unsigned char *memptr, long filelen, char *comment, int maxcommentlen) {
-  int level, loadres, errflag = 0;
-  unsigned char *allocptr = NULL;
+/* finds where the level that starts at *memptr ends, following loadlevelfromfile() step by step but without building anything: a
+ * level ends with the first comment line that follows level data, or with the end of file. returns 1 if the end of file has been
+ * reached, 0 otherwise. */
+static int skiplevel(unsigned char **memptr, unsigned char *memend) {
+  int leveldatastarted = 0, x = 0, bytebuff, rleprefix;
+  for (;;) {
+    rleprefix = readRLEbyte(memptr, memend, &bytebuff);
+    if (rleprefix < 0) return(1);
+    for (; rleprefix > 0; rleprefix--) {
+      switch (bytebuff) {
+        case ' ':
+        case '-':
+        case '_':
+        case '#':
+        case '@':
+        case '*':
+        case '$':
+        case '+':
+        case '.':
+          x += 1;
+          break;
+        case '\n':
+        case '|':
+          x = 0;
+          break;
+        case '\r':
+          break;
+        default: /* a comment -> skip until end of line, it ends the level if level data started already */
+          if (leveldatastarted != 0) leveldatastarted = -1;
+          for (;;) {
+            bytebuff = readbytefrommem(memptr, memend);
+            if (bytebuff == '\n') break;
+            if (bytebuff < 0) return(1);
+          }
+          break;
+      }
+      if (leveldatastarted < 0) return(0);
+      if (x > 0) leveldatastarted = 1;
+    }
+  }
+}
+
+/* levels are parsed by chunks of LOADCHUNK levels, taken in turn by the (up to LOADMAXTHREADS) threads of a loadbatch */
+#define LOADCHUNK 64
+#define LOADMAXTHREADS 64
+
+struct loadbatch {
+  struct soklevelset *set;
+  int *results;         /* what loadlevelfromfile() returned for each level of set */
+  char *comment;        /* where the comment of the first level goes */
+  int maxcommentlen;
+  SDL_atomic_t next;    /* first level of the next chunk to parse */
+};
+
+/* parses chunks of levels of a batch until there are none left, recording the id of each level in the index */
+static int loadthread(void *data) {
+  struct loadbatch *batch = data;
+  struct soklevelset *set = batch->set;
+  struct sokgame *scratch;
+  unsigned char *levelptr;
+  int first, level;
+  scratch = malloc(sizeof(struct sokgame));
+  if (scratch == NULL) return(-1); /* the other threads will do the work */
+  for (;;) {
+    first = SDL_AtomicAdd(&(batch->next), LOADCHUNK);
+    if (first >= set->count) break;
+    for (level = first; (level < first + LOADCHUNK) && (level < set->count); level++) {
+      levelptr = set->data + set->levels[level].offset;
+      batch->results[level] = loadlevelfromfile(scratch, &levelptr, set->data + set->datalen, (level == 0) ? batch->comment : NULL, batch->maxcommentlen);
+      set->levels[level].crc32 = scratch->crc32;
+    }
+  }
+  free(scratch);
+  return(0);
+}
+
+/* indexes the levels of a file. a quick scan finds where each level starts, then levels are loaded into scratch games on several
+ * threads, just to check them and find out what their id is: dead squares, hashes and solutions are left for sok_getlevel(). the
+ * set ends with the first level that fails to load, as if levels were loaded one after another. */
+int sok_loadfile(struct soklevelset *set, char *gamelevel, unsigned char *memptr, long filelen, char *comment, int maxcommentlen, int threads) {
+  int level, endoffile, allocated = 1024;
+  unsigned char *allocptr = NULL, *levelptr;
+  struct soklevelentry *levels;
+  struct loadbatch batch;
+  SDL_Thread *thread[LOADMAXTHREADS];
+  memset(set, 0, sizeof(struct soklevelset));
   if (gamelevel != NULL) {
-    filelen = loadfile2mem(gamelevel, &allocptr);
-    memptr = allocptr;
+    /* the file is parsed right from its mapping, without copying it. should mapping fail, it is read to memory instead */
+    filelen = mapfile(set, gamelevel);
+    memptr = set->map;
+    if (filelen < 0) {
+      filelen = loadfile2mem(gamelevel, &allocptr);
+      memptr = allocptr;
+    }
   }
   if ((filelen < 0) || (memptr == NULL)) return(ERR_UNABLE_TO_OPEN_FILE);
 
@@ -331,104 +725,169 @@ int sok_loadfile(struct sokgame **gamelist, int maxlevels, char *gamelevel, unsi
     ungzptr = ungz(memptr, filelen, &uncompressedlen);
     filelen = uncompressedlen;
     if (allocptr != NULL) free(allocptr);
+    unmapfile(set);
     allocptr = ungzptr;
     memptr = ungzptr;
     if (ungzptr == NULL) return(ERR_UNABLE_TO_OPEN_FILE);
   }
 
-  for (level = 0;; level++) { /* iterate to load games sequentially from the file */
-    /* puts("loading level.."); */
-    if (level + 1 >= maxlevels) {
-      level--;
-      errflag = ERR_TOO_MANY_LEVELS_IN_SET;
-      break;
-    }
-    gamelist[level] = sok_allocgame();
-    if (gamelist[level] == NULL) {
-      level--;
-      errflag = ERR_MEM_ALLOC_FAILED;
-      break;
+  set->data = memptr;
+  set->datalen = filelen;
+  set->allocptr = allocptr;
+  set->levels = malloc(sizeof(struct soklevelentry) * allocated);
+  if (set->levels == NULL) {
+    sok_freefile(set);
+    return(ERR_MEM_ALLOC_FAILED);
+  }
+
+  /* find where levels start */
+  levelptr = set->data;
+  for (endoffile = 0; endoffile == 0; set->count++) {
+    if (set->count == allocated) { /* the index is full, make it twice as large */
+      levels = realloc(set->levels, sizeof(struct soklevelentry) * allocated * 2);
+      if (levels == NULL) {
+        sok_freefile(set);
+        return(ERR_MEM_ALLOC_FAILED);
+      }
+      set->levels = levels;
+      allocated *= 2;
     }
+    set->levels[set->count].offset = levelptr - set->data;
+    set->levels[set->count].packed = NULL;
+    set->levels[set->count].solved = -1;
+    endoffile = skiplevel(&levelptr, set->data + set->datalen);
+  }
 
-    /* call loadlevelfromfile */
-    loadres = loadlevelfromfile(gamelist[level], &memptr, (level == 0) ? comment : NULL, maxcommentlen);
+  /* load them all, on as many threads as asked for, but with at least two chunks of levels for each thread */
+  batch.set = set;
+  batch.results = malloc(sizeof(int) * set->count);
+  batch.comment = comment;
+  batch.maxcommentlen = maxcommentlen;
+  SDL_AtomicSet(&(batch.next), 0);
+  if (batch.results == NULL) {
+    sok_freefile(set);
+    return(ERR_MEM_ALLOC_FAILED);
+  }
+  if (threads < 1) threads = SDL_GetCPUCount();
+  if (threads > set->count / (LOADCHUNK * 2)) threads = set->count / (LOADCHUNK * 2);
+  if (threads > LOADMAXTHREADS) threads = LOADMAXTHREADS;
+  for (level = 1; level < threads; level++) thread[level] = SDL_CreateThread(loadthread, "sok_load", &batch);
+  loadthread(&batch);
+  for (level = 1; level < threads; level++) {
+    if (thread[level] != NULL) SDL_WaitThread(thread[level], NULL);
+  }
+  if (SDL_AtomicGet(&(batch.next)) < set->count) { /* no thread could get to work */
+    free(batch.results);
+    sok_freefile(set);
+    return(ERR_MEM_ALLOC_FAILED);
+  }
 
-    if (loadres < 0) { /* error loading level data */
-      if (level == 0) errflag = loadres;
-      sok_freegame(gamelist[level]);
-      level--;
-      break;
+  /* the set ends with the first level that failed to load, if it is the very first one the file is not a level file */
+  for (level = 0; level < set->count; level++) {
+    if (batch.results[level] >= 0) continue;
+    if (level == 0) {
+      level = batch.results[0];
+      free(batch.results);
+      sok_freefile(set);
+      return(level);
     }
-
-    /* write the level num and load the solution (if any) */
-    gamelist[level]->level = level + 1;
-    gamelist[level]->solution = solution_load(gamelist[level]->crc32, "dat");
-    /* if end of file reached, stop now */
-    if (loadres > 0) break;
+    set->count = level;
   }
+  free(batch.results);
 
-  if (allocptr != NULL) free(allocptr);
+  return(set->count);
+}
 
-  if (errflag != 0) {
-    sok_freefile(gamelist, level + 1);
-    return(errflag);
+int sok_getlevel(struct soklevelset *set, int level, struct sokgame *game) {
+  struct sokpackedlevel *packed;
+  unsigned char *levelptr;
+  if ((level < 0) || (level >= set->count)) return(ERR_UNDEFINED);
+  packed = set->levels[level].packed;
+  if (packed == NULL) {
+      /* the level has been loaded fine once already while indexing the file, so it can't fail now */
+      levelptr = set->data + set->levels[level].offset;
+      loadlevelfromfile(game, &levelptr, set->data + set->datalen, NULL, 0);
+      packed = packlevel(set, game);
+      if (packed == NULL) return(ERR_MEM_ALLOC_FAILED);
+      setpackedsolution(packed, solution_load(game->crc32, "dat"));
+      set->levels[level].packed = packed;
+      set->levels[level].solved = (packed->solution != NULL);
+    } else {
+      unpacklevel(game, packed);
+      game->crc32 = set->levels[level].crc32;
   }
+  preparelevel(game);
+  game->level = level + 1;
+  game->solution = packed->solution;
+  game->solutionlen = packed->solutionlen;
+  game->solutionpushes = packed->solutionpushes;
+  return(0);
+}
 
-  return(level + 1);
+int sok_issolved(struct soklevelset *set, int level) {
+  struct soklevelentry *entry;
+  char *solution;
+  if ((level < 0) || (level >= set->count)) return(0);
+  entry = &(set->levels[level]);
+  /* sok_loadsolutions() refreshes parsed levels, and makes the others be looked up again */
+  if (entry->solved < 0) {
+    solution = solution_load(entry->crc32, "dat");
+    entry->solved = (solution != NULL);
+    if (solution != NULL) free(solution);
+  }
+  return(entry->solved);
 }
 
-/* reloads solutions for all levels in a list */
-void sok_loadsolutions(struct sokgame **gamelist, int levelscount) {
-  int x = 0;
-  for (x = 0; x < levelscount; x++) {
-    gamelist[x]->solution = solution_load(gamelist[x]->crc32, "dat");
+/* reloads solutions for all parsed levels of a set */
+void sok_loadsolutions(struct soklevelset *set) {
+  int x;
+  for (x = 0; x < set->count; x++) {
+    /* a level not parsed yet may share its id with the one just solved (same level twice in a set): look it up again next time */
+    if (set->levels[x].packed == NULL) {
+      set->levels[x].solved = -1;
+      continue;
+    }
+    if (set->levels[x].packed->solution != NULL) free(set->levels[x].packed->solution);
+    setpackedsolution(set->levels[x].packed, solution_load(set->levels[x].crc32, "dat"));
+    set->levels[x].solved = (set->levels[x].packed->solution != NULL);
   }
 }
 
 /* checks if level is solved yet. returns 0 if not, non-zero otherwise. */
 int sok_checksolution(struct sokgame *game, struct sokgamestates *states) {
-  int x, y;
-  long bestscorelen, bestscorepushes, myscorelen, myscorepushes, betterflag = 0;
-  for (y = 0; y < game->field_height; y++) {
-    for (x = 0; x < game->field_width; x++) {
-      if (((game->field[x][y] & field_goal) != 0) && ((game->field[x][y] & field_atom) == 0)) return(0);
-    }
-  }
-  /* no non-filled goal found = level completed! */
+  int betterflag = 0;
+  if (game->goalsleft != 0) return(0);
+  /* no non-filled goal left = level completed! */
   if (states == NULL) return(1);
   /* Check if the solution is better than the one we had so far */
-  bestscorelen = sok_history_getlen(game->solution);
-  bestscorepushes = sok_history_getpushes(game->solution);
-  myscorelen = sok_history_getlen(states->history);
-  myscorepushes = sok_history_getpushes(states->history);
-  if (bestscorelen < 1) betterflag = 1;
-  if (bestscorelen > myscorelen) betterflag = 1;
-  if ((bestscorelen == myscorelen) && (bestscorepushes > myscorepushes)) betterflag = 1;
+  if (game->solutionlen < 1) betterflag = 1;
+  if (game->solutionlen > states->history.len) betterflag = 1;
+  if ((game->solutionlen == states->history.len) && (game->solutionpushes > states->history.pushes)) betterflag = 1;
   /* if our solution is better, save it */
-  if (betterflag != 0) solution_save(game->crc32, states->history, "dat");
+  if ((betterflag != 0) && (states->nosave == 0)) solution_save(game->crc32, states->history.moves, "dat");
   return(1);
 }
 
 
 int sok_move(struct sokgame *game, enum SOKMOVE dir, int validitycheck, struct sokgamestates *states) {
   int res = 0;
-  int x, y, vectorx = 0, vectory = 0, alreadysolved;
+  int pos, vector = 0, vectorx = 0, vectory = 0, alreadysolved;
   char historychar = ' ';
-  long movescount;
-  movescount = sok_history_getlen(states->history);
+  struct sokhistory *history = &(states->history);
   /* first of all let's check if we have enough place in history for a potential move - if not, realloc some place */
-  if (movescount + 3 >= states->historyallocsize) {
-    states->historyallocsize *= 2;
-    states->history = realloc(states->history, states->historyallocsize);
-    if (states->history == NULL) {
-      printf("failed to allocate %ld bytes for history buffer!\n", states->historyallocsize);
+  if (history->len + 3 >= history->allocsize) {
+    char *newmoves;
+    newmoves = realloc(history->moves, history->allocsize * 2);
+    if (newmoves == NULL) {
+      printf("failed to allocate %ld bytes for history buffer!\n", history->allocsize * 2);
       return(ERR_MEM_ALLOC_FAILED);
     }
+    history->moves = newmoves;
+    history->allocsize *= 2;
   }
   /* now let's do our real stuff */
-  alreadysolved = sok_checksolution(game, NULL);
-  x = game->positionx;
-  y = game->positiony;
+  alreadysolved = (game->goalsleft == 0);
+  pos = sok_fieldidx(game->positionx, game->positiony);
   switch (dir) {
     case sokmoveUP:
       vectory = -1;
@@ -451,38 +910,93 @@ int sok_move(struct sokgame *game, enum SOKMOVE dir, int validitycheck, struct s
       historychar = 'l';
       break;
   }
+  vector = vectory * field_stride + vectorx;
 
-  if (y < 1) return(-1);
-  if (game->field[x + vectorx][y + vectory] & field_wall) return(-1);
+  /* no bound checking needed here: the field is surrounded by walls */
+  if (game->field[pos + vector] & field_wall) return(-1);
   /* is there an atom on our way? */
-  if (game->field[x + vectorx][y + vectory] & field_atom) {
+  if (game->field[pos + vector] & field_atom) {
     if (alreadysolved != 0) return(-1);
-    if ((y + vectory < 1) || (y + vectory > 62) || (x + vectorx < 1) || (x + vectorx > 62)) return(-1);
-    if (game->field[x + vectorx * 2][y + vectory * 2] & (field_wall | field_atom)) return(-1);
+    if (game->field[pos + vector * 2] & (field_wall | field_atom)) return(-1);
     res |= sokmove_pushed;
-    if (game->field[x + vectorx * 2][y + vectory * 2] & field_goal) res |= sokmove_ongoal;
+    if (game->field[pos + vector * 2] & field_goal) res |= sokmove_ongoal;
+    if (sok_isdead(game, pos + vector * 2) && sok_deadsquaresmatter(game)) res |= sokmove_deadlock;
     if (validitycheck == 0) {
       historychar -= 32; /* change historical move to uppercase to mark a push action */
-      game->field[x + vectorx][y + vectory] &= ~field_atom;
-      game->field[x + vectorx * 2][y + vectory * 2] |= field_atom;
+      game->field[pos + vector] &= ~field_atom;
+      game->field[pos + vector * 2] |= field_atom;
+      if (game->field[pos + vector] & field_goal) game->goalsleft += 1;
+      if (res & sokmove_ongoal) game->goalsleft -= 1;
+      game->deadatoms += (int)sok_isdead(game, pos + vector * 2) - (int)sok_isdead(game, pos + vector);
+      game->atomshash ^= zobristkey(pos + vector, 0) ^ zobristkey(pos + vector * 2, 0);
     }
   }
   if (validitycheck == 0) {
-    states->history[movescount] = historychar;
-    states->history[movescount + 1] = 0; /* makes it a null-terminated string in case anyone would want to print it as-is */
+    history->moves[history->len] = historychar;
+    history->len += 1;
+    history->moves[history->len] = 0; /* makes it a null-terminated string in case anyone would want to print it as-is */
+    if (res & sokmove_pushed) history->pushes += 1;
     game->positiony += vectory;
     game->positionx += vectorx;
+    /* look for deadlocks around the atom we just pushed, and remember when the game got stuck */
+    if ((res & sokmove_pushed) && (game->goalsleft != 0) && (sok_deadlock_check(game, pos + vector * 2) != sokdeadlockNONE)) {
+      res |= sokmove_deadlock;
+      if (states->deadlocked == 0) states->deadlocked = history->len;
+    }
   }
   if ((alreadysolved == 0) && (sok_checksolution(game, states) != 0)) res |= sokmove_solved;
   return(res);
 }
 
+int sok_pull(struct sokgame *game, enum SOKMOVE dir, int validitycheck) {
+  int res = 0, pos, vector, vectorx = 0, vectory = 0;
+  switch (dir) {
+    case sokmoveUP:
+      vectory = -1;
+      break;
+    case sokmoveRIGHT:
+      vectorx = 1;
+      break;
+    case sokmoveDOWN:
+      vectory = 1;
+      break;
+    case sokmoveLEFT:
+      vectorx = -1;
+      break;
+  }
+  vector = vectory * field_stride + vectorx;
+  pos = sok_fieldidx(game->positionx, game->positiony);
+  /* the player can only step on a free tile, and drags along whatever atom stands behind it */
+  if (game->field[pos + vector] & (field_wall | field_atom)) return(-1);
+  if (game->field[pos - vector] & field_atom) {
+    res |= sokmove_pushed;
+    if (game->field[pos] & field_goal) res |= sokmove_ongoal;
+    if (sok_isdead(game, pos) && sok_deadsquaresmatter(game)) res |= sokmove_deadlock;
+    if (validitycheck == 0) {
+      game->field[pos - vector] &= ~field_atom;
+      game->field[pos] |= field_atom;
+      if (game->field[pos - vector] & field_goal) game->goalsleft += 1;
+      if (res & sokmove_ongoal) game->goalsleft -= 1;
+      game->deadatoms += (int)sok_isdead(game, pos) - (int)sok_isdead(game, pos - vector);
+      game->atomshash ^= zobristkey(pos - vector, 0) ^ zobristkey(pos, 0);
+    }
+  }
+  if (validitycheck == 0) {
+    game->positionx += vectorx;
+    game->positiony += vectory;
+  }
+  if (game->goalsleft == 0) res |= sokmove_solved;
+  return(res);
+}
+
 void sok_resetstates(struct sokgamestates *states) {
-  if (states->history != NULL) free(states->history);
+  int nosave = states->nosave;
+  if (states->history.moves != NULL) free(states->history.moves);
   memset(states, 0, sizeof(struct sokgamestates));
-  states->historyallocsize = 64;
-  states->history = malloc(states->historyallocsize);
-  if (states->history != NULL) memset(states->history, 0, states->historyallocsize);
+  states->nosave = nosave;
+  states->history.allocsize = 64;
+  states->history.moves = malloc(states->history.allocsize);
+  if (states->history.moves != NULL) memset(states->history.moves, 0, states->history.allocsize);
 }
 
 struct sokgamestates *sok_newstates(void) {
@@ -496,16 +1010,17 @@ struct sokgamestates *sok_newstates(void) {
 
 void sok_freestates(struct sokgamestates *states) {
   if (states == NULL) return;
-  if (states->history != NULL) free(states->history);
+  if (states->history.moves != NULL) free(states->history.moves);
   free(states);
 }
 
 void sok_undo(struct sokgame *game, struct sokgamestates *states) {
-  int movex = 0, movey = 0, movescount;
-  movescount = sok_history_getlen(states->history);
-  if (movescount < 1) return;
-  movescount -= 1;
-  switch (states->history[movescount]) {
+  int movex = 0, movey = 0, pos, vector;
+  long movescount;
+  struct sokhistory *history = &(states->history);
+  if (history->len < 1) return;
+  movescount = history->len - 1;
+  switch (history->moves[movescount]) {
     case 'u':
     case 'U':
       movey = 1;
@@ -528,17 +1043,27 @@ void sok_undo(struct sokgame *game, struct sokgamestates *states) {
       break;
   }
   /* if it was a PUSH action, then move the atom back */
-  if ((states->history[movescount] >= 'A') && ((states->history[movescount] <= 'Z'))) {
-    game->field[game->positionx - movex][game->positiony - movey] &= ~field_atom;
-    game->field[game->positionx][game->positiony] |= field_atom;
+  if ((history->moves[movescount] >= 'A') && ((history->moves[movescount] <= 'Z'))) {
+    pos = sok_fieldidx(game->positionx, game->positiony);
+    vector = movey * field_stride + movex;
+    game->field[pos - vector] &= ~field_atom;
+    game->field[pos] |= field_atom;
+    if (game->field[pos - vector] & field_goal) game->goalsleft += 1;
+    if (game->field[pos] & field_goal) game->goalsleft -= 1;
+    game->deadatoms += (int)sok_isdead(game, pos) - (int)sok_isdead(game, pos - vector);
+    game->atomshash ^= zobristkey(pos - vector, 0) ^ zobristkey(pos, 0);
+    history->pushes -= 1;
   }
   game->positionx += movex;
   game->positiony += movey;
-  states->history[movescount] = 0;
+  history->moves[movescount] = 0;
+  history->len = movescount;
+  if (history->len < states->deadlocked) states->deadlocked = 0;
 }
 
-void sok_play(struct sokgame *game, struct sokgamestates *states, char *playfile) {
-  if (playfile == NULL) return;
+int sok_play(struct sokgame *game, struct sokgamestates *states, char *playfile) {
+  int rejected = 0;
+  if (playfile == NULL) return(0);
   while (*playfile != 0) {
     enum SOKMOVE playmove;
     switch (*playfile) {
@@ -558,11 +1083,13 @@ void sok_play(struct sokgame *game, struct sokgamestates *states, char *playfile
       case 'L':
         playmove = sokmoveLEFT;
         break;
-      default:
+      default: /* not a move: played as a move left, as it always has been, but counted as a bad one */
         playmove = sokmoveLEFT;
+        rejected += 1;
         break;
     }
-    sok_move(game, playmove, 0, states);
+    if ((sok_move(game, playmove, 0, states) < 0) && (strchr("uUrRdDlL", *playfile) != NULL)) rejected += 1;
     playfile += 1;
   }
+  return(rejected);
 }
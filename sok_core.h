@@ -22,26 +22,58 @@
 #ifndef sok_core_h_sentinel
 #define sok_core_h_sentinel
 
+  #include <stdint.h>
+
   #define field_floor 1
   #define field_atom 2
   #define field_goal 4
   #define field_wall 8
 
+  /* the field is stored row after row, field_stride tiles per row. the playable area is surrounded by a border of walls, so tiles
+   * are addressed from -1 to 62 on both axes and looking at the direct neighbors of any tile of a level never goes out of bounds. */
+  #define field_stride 64
+  #define field_tiles (field_stride * 64)
+  #define sok_fieldidx(x, y) ((((y) + 1) * field_stride) + (x) + 1)
+  #define sok_field(game, x, y) ((game)->field[sok_fieldidx(x, y)])
+
+  /* tells whether the field tile at index idx is a dead square, ie. an atom there can never be brought to any goal anymore */
+  #define sok_isdead(game, idx) (((game)->deadsquares[(idx) / field_stride] >> ((idx) % field_stride)) & 1)
+
+  /* tells whether an atom on a dead square means a deadlock: that's only the case when every atom is needed on a goal, levels with
+   * more atoms than goals may leave the spare ones anywhere, dead squares included */
+  #define sok_deadsquaresmatter(game) ((game)->atoms == (game)->goals)
+
   struct sokgame {
     int field_width;
     int field_height;
-    unsigned char field[64][64];
+    unsigned char field[field_tiles];
     int positionx;
     int positiony;
     int level;
     unsigned long crc32;
+    int goalsleft;        /* number of goals without an atom on them */
+    int atoms;            /* number of atoms of the level, computed at load time */
+    int goals;            /* number of goals of the level, computed at load time */
+    uint64_t atomshash;   /* zobrist hash of the atoms positions, kept up to date by sok_move() and sok_undo() */
+    uint64_t deadsquares[64]; /* dead squares of the level (one row per word, bit n of word m is field tile m * field_stride + n), computed at load time */
+    int deadatoms;        /* number of atoms standing on dead squares, kept up to date by sok_move() and sok_undo() */
     char *solution;
+    long solutionlen;     /* number of moves in solution (cached) */
+    long solutionpushes;  /* number of pushes in solution (cached) */
+  };
+
+  struct sokhistory {
+    char *moves;      /* null-terminated string of moves, in the usual LURD notation */
+    long len;         /* number of moves stored in moves (ie. strlen(moves)) */
+    long pushes;      /* number of pushes (uppercase moves) stored in moves */
+    long allocsize;   /* amount of bytes allocated for moves */
   };
 
   struct sokgamestates {
     int angle;
-    char *history;
-    long historyallocsize;
+    struct sokhistory history;
+    long deadlocked;  /* number of moves in history when the game got into a deadlock, 0 if it is not deadlocked */
+    int nosave;       /* set to non-zero to replay moves without ever saving them as a solution (kept by sok_resetstates()) */
   };
 
   enum SOKMOVE {
@@ -54,18 +86,61 @@
   #define sokmove_pushed 1
   #define sokmove_ongoal 2
   #define sokmove_solved 4
+  #define sokmove_deadlock 8  /* the push led to a deadlock (only dead squares are checked when validitycheck is set) */
+
+  struct sokpackedlevel;
 
-  /* loads a level file. returns the amount of levels loaded on success, a non-positive value otherwise. */
-  int sok_loadfile(struct sokgame **game, int maxlevels, char *gamelevel, unsigned char *memptr, long filelen, char *comment, int maxcommentlen);
+  /* one level of a level set: where it starts in the level file and its id are known right away, the level itself is only parsed
+   * the first time it is asked for, and then kept in a compact form (private to sok_core.c) sized to the level */
+  struct soklevelentry {
+    long offset;                    /* position of the level data in the level file */
+    unsigned long crc32;            /* level id, as in struct sokgame */
+    struct sokpackedlevel *packed;  /* the parsed level, NULL until sok_getlevel() is called for it */
+    int solved;                     /* whether the level has a solution: 1 if it has, 0 if not, -1 if not looked up yet */
+  };
 
-  void sok_freefile(struct sokgame **gamelist, int gamescount);
+  struct soklevelset {
+    int count;                      /* number of levels in the set */
+    struct soklevelentry *levels;   /* count entries, in file order */
+    unsigned char *data;            /* the (uncompressed) level file, kept around to parse levels on demand */
+    long datalen;                   /* bytes in data */
+    unsigned char *allocptr;        /* data, if it has been allocated by sok_loadfile() (NULL otherwise) */
+    void *map;                      /* data, if it is the level file memory-mapped (NULL otherwise) */
+    long mapsize;
+    void *maphandle;                /* handle of the file mapping (Windows only) */
+    void *arena;                    /* memory blocks the parsed levels are allocated from (private to sok_core.c) */
+  };
 
-  /* checks if the game is solved. returns 0 if the game is not solved, non-zero otherwise. */
+  /* indexes a level file: every level is checked and its id computed, but levels are only parsed for good by sok_getlevel(). the
+   * file is either memory-mapped from gamelevel (so it shouldn't be changed while the set is in use), or taken from memptr (filelen
+   * bytes), in which case memptr must stay valid as long as the set is in use. levels are checked on up to threads threads (0 = one
+   * per CPU), the result doesn't depend on it. returns the amount of levels found on success, a non-positive value otherwise. */
+  int sok_loadfile(struct soklevelset *set, char *gamelevel, unsigned char *memptr, long filelen, char *comment, int maxcommentlen, int threads);
+
+  /* loads level (0-based) of a set into game, ready to be played. the level is parsed and its solution loaded the first time it is
+   * asked for, afterwards it is unpacked from the set. game->solution belongs to the set, and stays valid until sok_freefile() or
+   * sok_loadsolutions() is called. returns 0 on success, a negative value otherwise (out of memory). not thread-safe. */
+  int sok_getlevel(struct soklevelset *set, int level, struct sokgame *game);
+
+  /* tells whether level (0-based) of a set has a solution, without parsing it if it isn't yet. the answer is cached in the set, so
+   * only the first call for a level looks for its solution file. returns non-zero if it does. */
+  int sok_issolved(struct soklevelset *set, int level);
+
+  /* frees a level set and all the levels parsed from it (a zeroed set is fine too) */
+  void sok_freefile(struct soklevelset *set);
+
+  /* checks if the game is solved. returns 0 if the game is not solved, non-zero otherwise. if it is, and states holds moves that do
+   * better than the level's solution, they are saved as its new solution (unless states->nosave is set). */
   int sok_checksolution(struct sokgame *game, struct sokgamestates *states);
 
   /* try to move the player in a direction. returns a negative value if move has been denied, or a sokmove bitfield otherwise. */
   int sok_move(struct sokgame *game, enum SOKMOVE dir, int validitycheck, struct sokgamestates *states);
 
+  /* the reverse of a push: moves the player in a direction, pulling along the atom that stands right behind it (if any). returns a
+   * negative value if the move is denied, or a sokmove bitfield otherwise, sokmove_pushed meaning that an atom has been pulled. the
+   * history is left alone, and solutions are never saved: that's for solvers and tools that walk levels backward. */
+  int sok_pull(struct sokgame *game, enum SOKMOVE dir, int validitycheck);
+
   /* undo last move */
   void sok_undo(struct sokgame *game, struct sokgamestates *states);
 
@@ -84,13 +159,25 @@
   /* free the memory occupied by a previously allocated states structure */
   void sok_freestates(struct sokgamestates *states);
 
-  /* reloads solutions for all levels in a list */
-  void sok_loadsolutions(struct sokgame **gamelist, int levelscount);
+  /* reloads solutions for all the levels of a set that have been parsed so far (the others get theirs once parsed, and have their
+   * solved state looked up again by the next sok_issolved()), to be called once a level has been solved */
+  void sok_loadsolutions(struct soklevelset *set);
 
   /* returns a human string for error code */
   char *sok_strerr(int errid);
 
-  /* plays a string of moves */
-  void sok_play(struct sokgame *game, struct sokgamestates *states, char *playfile);
+  /* plays a string of moves, skipping those that are blocked. returns the number of bad moves (blocked, or characters that are not
+   * LURD moves), hence 0 if all of them have been played as they are. */
+  int sok_play(struct sokgame *game, struct sokgamestates *states, char *playfile);
+
+  /* computes the zobrist hash of the atoms positions from scratch (sok_move() and sok_undo() maintain game->atomshash incrementally) */
+  uint64_t sok_hashatoms(struct sokgame *game);
+
+  /* computes the set of tiles the player can walk to without pushing anything. reach receives one word per field row (same layout
+   * as deadsquares). returns the field index of the top-left-most reachable tile, ie. the normalized player position. */
+  int sok_reach(struct sokgame *game, uint64_t *reach);
+
+  /* returns the 64-bit zobrist hash of the position: atoms, plus the area the player can walk in (identified by its top-left-most tile) */
+  uint64_t sok_hashposition(struct sokgame *game);
 
 #endif
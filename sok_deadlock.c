@@ -0,0 +1,162 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+/*
+ * Deadlock detection that goes beyond dead squares. Both checks only ever
+ * look around the atom that has just been pushed:
+ *
+ *  - freeze: an atom is frozen if it can't move along either axis, because
+ *    of walls, of dead squares on both sides, or of other frozen atoms. a
+ *    frozen cluster with an atom that is not on a goal is a deadlock, unless
+ *    the level has more atoms than goals.
+ *  - closed corral: an empty area next to the pushed atom, that the player
+ *    can't reach, and whose borders are all walls or frozen atoms, will
+ *    never change anymore. if it holds an empty goal, it's a deadlock.
+ *
+ * Both are conservative: when in doubt (cluster or area too large), no
+ * deadlock is reported.
+ */
+
+#include <string.h>   /* memset() */
+#include "sok_core.h"
+#include "sok_deadlock.h"
+
+#define MAXCLUSTER 64   /* max amount of atoms examined by the freeze check */
+#define MAXCORRAL 256   /* max size of an area examined by the corral check */
+
+static const int vectors[4] = {-field_stride, 1, field_stride, -1};
+
+struct freezectx {
+  struct sokgame *game;
+  int cluster[MAXCLUSTER];  /* atoms being tested, they act as walls for the atoms they depend on */
+  int clustersize;
+  int offgoal;              /* number of frozen atoms found that are not on a goal */
+};
+
+static int isfrozen(struct freezectx *ctx, int tile);
+
+/* returns non-zero if tile holds an atom that is being tested already */
+static int incluster(struct freezectx *ctx, int tile) {
+  int i;
+  for (i = 0; i < ctx->clustersize; i++) {
+    if (ctx->cluster[i] == tile) return(1);
+  }
+  return(0);
+}
+
+/* returns non-zero if the atom on tile can't be moved along the axis of vector */
+static int isblocked(struct freezectx *ctx, int tile, int vector) {
+  unsigned char *field = ctx->game->field;
+  int a = tile - vector, b = tile + vector;
+  if ((field[a] & field_wall) || (field[b] & field_wall)) return(1);
+  if ((incluster(ctx, a) != 0) || (incluster(ctx, b) != 0)) return(1);
+  /* pushing it either way would put it on a dead square (spare atoms may go there, though) */
+  if (sok_isdead(ctx->game, a) && sok_isdead(ctx->game, b) && sok_deadsquaresmatter(ctx->game)) return(1);
+  if ((field[a] & field_atom) && (isfrozen(ctx, a) != 0)) return(1);
+  if ((field[b] & field_atom) && (isfrozen(ctx, b) != 0)) return(1);
+  return(0);
+}
+
+/* returns non-zero if the atom on tile can't move anymore */
+static int isfrozen(struct freezectx *ctx, int tile) {
+  int res, offgoal = ctx->offgoal;
+  if (ctx->clustersize == MAXCLUSTER) return(0);
+  ctx->cluster[ctx->clustersize++] = tile;
+  res = isblocked(ctx, tile, 1) && isblocked(ctx, tile, field_stride);
+  ctx->clustersize -= 1;
+  if (res == 0) {
+      ctx->offgoal = offgoal; /* whatever was found frozen relied on this atom being frozen, too */
+    } else if ((ctx->game->field[tile] & field_goal) == 0) {
+      ctx->offgoal += 1;
+  }
+  return(res);
+}
+
+/* returns non-zero if the atom on tile is frozen, and fills *offgoal with the number of frozen atoms that are not on a goal */
+static int frozencluster(struct sokgame *game, int tile, int *offgoal) {
+  struct freezectx ctx;
+  int res;
+  ctx.game = game;
+  ctx.clustersize = 0;
+  ctx.offgoal = 0;
+  res = isfrozen(&ctx, tile);
+  *offgoal = ctx.offgoal;
+  return(res);
+}
+
+/* looks at the empty area next to tile in direction d. returns non-zero if it is a closed corral with an empty goal. */
+static int closedcorral(struct sokgame *game, int tile, int d, int player) {
+  uint64_t seen[64];
+  int area[MAXCORRAL];
+  int areasize = 0, i, j, next, emptygoal = 0, offgoal;
+  next = tile + vectors[d];
+  if (game->field[next] & (field_wall | field_atom)) return(0);
+  memset(seen, 0, sizeof(seen));
+  seen[next / field_stride] |= (uint64_t)1 << (next % field_stride);
+  area[areasize++] = next;
+  /* flood the area, until it turns out to be reachable by the player or too large */
+  for (i = 0; i < areasize; i++) {
+    if (area[i] == player) return(0);
+    if (game->field[area[i]] & field_goal) emptygoal = 1;
+    for (j = 0; j < 4; j++) {
+      next = area[i] + vectors[j];
+      if ((seen[next / field_stride] >> (next % field_stride)) & 1) continue;
+      if (game->field[next] & field_wall) continue;
+      seen[next / field_stride] |= (uint64_t)1 << (next % field_stride);
+      if (game->field[next] & field_atom) continue;
+      if (areasize == MAXCORRAL) return(0);
+      area[areasize++] = next;
+    }
+  }
+  if (emptygoal == 0) return(0);
+  /* the area never changes if none of the atoms around it can move */
+  for (i = 0; i < areasize; i++) {
+    for (j = 0; j < 4; j++) {
+      next = area[i] + vectors[j];
+      if ((game->field[next] & field_atom) && (frozencluster(game, next, &offgoal) == 0)) return(0);
+    }
+  }
+  return(1);
+}
+
+enum SOKDEADLOCK sok_deadlock_check(struct sokgame *game, int tile) {
+  int d, offgoal, player;
+  if (sok_isdead(game, tile) && sok_deadsquaresmatter(game)) return(sokdeadlockDEADSQUARE);
+  /* the pushed atom borders any corral it could have closed, so if it can still move there's no need to look further */
+  if (frozencluster(game, tile, &offgoal) == 0) return(sokdeadlockNONE);
+  /* frozen atoms off goals are fine as long as there are enough atoms left for the goals: only spare atoms may stay off goals */
+  if ((offgoal > 0) && (game->atoms == game->goals)) return(sokdeadlockFROZEN);
+  player = sok_fieldidx(game->positionx, game->positiony);
+  for (d = 0; d < 4; d++) {
+    if (closedcorral(game, tile, d, player) != 0) return(sokdeadlockCORRAL);
+  }
+  return(sokdeadlockNONE);
+}
+
+char *sok_deadlock_str(enum SOKDEADLOCK verdict) {
+  switch (verdict) {
+    case sokdeadlockNONE: return("no deadlock");
+    case sokdeadlockDEADSQUARE: return("atom on a dead square");
+    case sokdeadlockFROZEN: return("frozen atoms");
+    case sokdeadlockCORRAL: return("closed corral");
+  }
+  return("unknown");
+}
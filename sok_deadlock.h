@@ -0,0 +1,42 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef sok_deadlock_h_sentinel
+#define sok_deadlock_h_sentinel
+
+  #include "sok_core.h"
+
+  enum SOKDEADLOCK {
+    sokdeadlockNONE = 0,
+    sokdeadlockDEADSQUARE = 1,  /* the atom stands on a dead square */
+    sokdeadlockFROZEN = 2,      /* the atom is part of a cluster of atoms that can't move anymore, and not all of them are on goals */
+    sokdeadlockCORRAL = 3       /* the atom closes an area the player can't enter anymore, and that holds an empty goal */
+  };
+
+  /* checks whether the atom that has just been pushed on field tile 'tile' put the game into a deadlock. only the neighborhood of
+   * that atom is examined, so it is meant to be called after every push. the player is expected to stand at its position after
+   * the push. the game's field is not modified. */
+  enum SOKDEADLOCK sok_deadlock_check(struct sokgame *game, int tile);
+
+  /* returns a human string for a deadlock verdict */
+  char *sok_deadlock_str(enum SOKDEADLOCK verdict);
+
+#endif
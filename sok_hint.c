@@ -0,0 +1,352 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+/*
+ * Hints are found by the solver (see sok_solve.c), on a worker thread, so
+ * the game never waits for them. Whatever a search finds is kept in a table
+ * of known positions, that lives as long as the player stays on the same
+ * level: every position along a solution gets its next push, since what is
+ * left of a push-optimal solution is a push-optimal solution of the position
+ * reached so far. Following hints hence only searches once, and so does
+ * undoing moves back to a position that has been hinted before. Positions
+ * are identified the way the solver does it (atoms, plus the top-left-most
+ * tile of the area the player can walk in), so walking around does not
+ * make a known position unknown.
+ */
+
+#include <stdlib.h>             /* malloc(), free() */
+#include <string.h>             /* memcpy(), memcmp() */
+#include <SDL2/SDL.h>           /* threads and locks */
+#include "sok_core.h"
+#include "sok_hint.h"
+#include "sok_solve.h"
+
+#define HINT_MAXNODES 2000000l  /* hint searches give up after that many positions */
+#define TABLEINITSIZE 1024      /* initial number of slots of the table of known positions */
+
+/* a known position: the hint status, and the push that leads to a solution (atom tile and direction) if any */
+struct knownpos {
+  uint64_t hash;
+  long key;               /* index of the position in keys, -1 for an empty slot */
+  short atom;
+  unsigned char dir;
+  unsigned char status;   /* sokhintREADY, sokhintUNSOLVABLE or sokhintGAVEUP */
+};
+
+struct sokhint {
+  SDL_Thread *thread;
+  SDL_mutex *lock;        /* protects everything below, except cancel */
+  SDL_cond *wakeup;
+  SDL_atomic_t cancel;    /* non-zero to abort the search in progress */
+  int quit;
+  struct sokgame request; /* position waiting for the worker */
+  int requested;
+  uint64_t searchhash;    /* hash of the position searched or waiting to be (0 if none) */
+  /* known positions, all of the level identified by crc32 */
+  unsigned long crc32;
+  int keylen;
+  struct knownpos *table;
+  long tablesize;
+  long count;
+  short *keys;            /* keylen tiles per known position: the normalized player, then the atoms in field order */
+  long keysalloc;
+};
+
+/* computes the key of the current position of game, returns its length */
+static int positionkey(struct sokgame *game, short *key) {
+  uint64_t reach[64];
+  int tile, len = 1;
+  key[0] = sok_reach(game, reach);
+  for (tile = 0; tile < field_tiles; tile++) {
+    if (game->field[tile] & field_atom) key[len++] = tile;
+  }
+  return(len);
+}
+
+static struct knownpos *lookup(struct sokhint *hint, uint64_t hash, short *key) {
+  long i;
+  if (hint->table == NULL) return(NULL);
+  for (i = (long)(hash >> 16) & (hint->tablesize - 1); hint->table[i].key >= 0; i = (i + 1) & (hint->tablesize - 1)) {
+    if ((hint->table[i].hash == hash) && (memcmp(hint->keys + hint->table[i].key * hint->keylen, key, sizeof(short) * hint->keylen) == 0)) return(&(hint->table[i]));
+  }
+  return(NULL);
+}
+
+/* doubles the size of the table of known positions (or allocates it). returns 0 on success. */
+static int growtable(struct sokhint *hint) {
+  struct knownpos *newtable;
+  long newsize, i, j;
+  newsize = (hint->table == NULL) ? TABLEINITSIZE : hint->tablesize * 2;
+  newtable = malloc(sizeof(struct knownpos) * newsize);
+  if (newtable == NULL) return(-1);
+  for (i = 0; i < newsize; i++) newtable[i].key = -1;
+  for (i = 0; i < hint->tablesize; i++) {
+    if (hint->table[i].key < 0) continue;
+    for (j = (long)(hint->table[i].hash >> 16) & (newsize - 1); newtable[j].key >= 0; j = (j + 1) & (newsize - 1));
+    newtable[j] = hint->table[i];
+  }
+  if (hint->table != NULL) free(hint->table);
+  hint->table = newtable;
+  hint->tablesize = newsize;
+  return(0);
+}
+
+/* remembers what is known about a position, unless it is known already */
+static void remember(struct sokhint *hint, uint64_t hash, short *key, int status, int atom, int dir) {
+  struct knownpos *pos;
+  long i;
+  if (lookup(hint, hash, key) != NULL) return;
+  if ((hint->count + 1) * 2 > hint->tablesize) {
+    if (growtable(hint) != 0) return;
+  }
+  if ((hint->count + 1) * hint->keylen > hint->keysalloc) {
+    short *newkeys;
+    long newalloc = (hint->keysalloc < 1024) ? 1024 : hint->keysalloc * 2;
+    while ((hint->count + 1) * hint->keylen > newalloc) newalloc *= 2;
+    newkeys = realloc(hint->keys, sizeof(short) * newalloc);
+    if (newkeys == NULL) return;
+    hint->keys = newkeys;
+    hint->keysalloc = newalloc;
+  }
+  for (i = (long)(hash >> 16) & (hint->tablesize - 1); hint->table[i].key >= 0; i = (i + 1) & (hint->tablesize - 1));
+  pos = &(hint->table[i]);
+  memcpy(hint->keys + hint->count * hint->keylen, key, sizeof(short) * hint->keylen);
+  pos->hash = hash;
+  pos->key = hint->count;
+  pos->atom = atom;
+  pos->dir = dir;
+  pos->status = status;
+  hint->count += 1;
+}
+
+/* forgets all known positions, and gets ready for those of the level of game */
+static void forget(struct sokhint *hint, struct sokgame *game) {
+  short key[field_tiles];
+  if (hint->table != NULL) free(hint->table);
+  if (hint->keys != NULL) free(hint->keys);
+  hint->table = NULL;
+  hint->tablesize = 0;
+  hint->count = 0;
+  hint->keys = NULL;
+  hint->keysalloc = 0;
+  hint->crc32 = game->crc32;
+  hint->keylen = positionkey(game, key);
+}
+
+static void dirvector(int dir, int *vectorx, int *vectory) {
+  *vectorx = 0;
+  *vectory = 0;
+  if (dir == sokmoveUP) *vectory = -1;
+  if (dir == sokmoveRIGHT) *vectorx = 1;
+  if (dir == sokmoveDOWN) *vectory = 1;
+  if (dir == sokmoveLEFT) *vectorx = -1;
+}
+
+static int move2dir(char move) {
+  switch (move) {
+    case 'u':
+    case 'U':
+      return(sokmoveUP);
+    case 'r':
+    case 'R':
+      return(sokmoveRIGHT);
+    case 'd':
+    case 'D':
+      return(sokmoveDOWN);
+    case 'l':
+    case 'L':
+      return(sokmoveLEFT);
+  }
+  return(0);
+}
+
+/* learns from the outcome of a search that started at the current position of game (game is played along the solution) */
+static void learn(struct sokhint *hint, struct sokgame *game, char *solution, enum SOKSOLVE result) {
+  struct sokgamestates *states;
+  short key[field_tiles];
+  int dir, vectorx, vectory;
+  long i;
+  positionkey(game, key);
+  if (result == soksolveUNSOLVABLE) {
+    remember(hint, sok_hashposition(game), key, sokhintUNSOLVABLE, 0, 0);
+    return;
+  }
+  if ((result == soksolveNODELIMIT) || (result == soksolveOUTOFMEMORY)) {
+    remember(hint, sok_hashposition(game), key, sokhintGAVEUP, 0, 0);
+    return;
+  }
+  if ((result != soksolveSOLVED) || (solution == NULL)) return;
+  states = sok_newstates();
+  if (states == NULL) return;
+  states->nosave = 1; /* the game is played along a solution of the solver, not the player's */
+  for (i = 0; solution[i] != 0; i++) {
+    dir = move2dir(solution[i]);
+    if ((solution[i] >= 'A') && (solution[i] <= 'Z')) {
+      dirvector(dir, &vectorx, &vectory);
+      positionkey(game, key);
+      remember(hint, sok_hashposition(game), key, sokhintREADY, sok_fieldidx(game->positionx + vectorx, game->positiony + vectory), dir);
+    }
+    sok_move(game, dir, 0, states);
+  }
+  sok_freestates(states);
+}
+
+static int cancelsearch(void *userdata) {
+  struct sokhint *hint = userdata;
+  return(SDL_AtomicGet(&(hint->cancel)));
+}
+
+static int worker(void *data) {
+  struct sokhint *hint = data;
+  struct sokgame game;
+  struct soksolveparams params;
+  struct soksolvestats stats;
+  char *solution;
+  sok_solve_defaults(&params);
+  params.maxnodes = HINT_MAXNODES;
+  params.cancel = cancelsearch;
+  params.userdata = hint;
+  SDL_LockMutex(hint->lock);
+  for (;;) {
+    while ((hint->requested == 0) && (hint->quit == 0)) SDL_CondWait(hint->wakeup, hint->lock);
+    if (hint->quit != 0) break;
+    memcpy(&game, &(hint->request), sizeof(struct sokgame));
+    hint->requested = 0;
+    SDL_AtomicSet(&(hint->cancel), 0);
+    SDL_UnlockMutex(hint->lock);
+    solution = sok_solve(&game, &params, &stats);
+    SDL_LockMutex(hint->lock);
+    /* the player may have switched to another level in the meantime, then whatever has been found is worthless */
+    if (game.crc32 == hint->crc32) learn(hint, &game, solution, stats.result);
+    if (solution != NULL) free(solution);
+    if (hint->requested == 0) hint->searchhash = 0;
+  }
+  SDL_UnlockMutex(hint->lock);
+  return(0);
+}
+
+struct sokhint *sok_hint_new(void) {
+  struct sokhint *hint;
+  hint = malloc(sizeof(struct sokhint));
+  if (hint == NULL) return(NULL);
+  memset(hint, 0, sizeof(struct sokhint));
+  hint->lock = SDL_CreateMutex();
+  hint->wakeup = SDL_CreateCond();
+  if ((hint->lock != NULL) && (hint->wakeup != NULL)) hint->thread = SDL_CreateThread(worker, "sokhint", hint);
+  if (hint->thread == NULL) {
+    if (hint->lock != NULL) SDL_DestroyMutex(hint->lock);
+    if (hint->wakeup != NULL) SDL_DestroyCond(hint->wakeup);
+    free(hint);
+    return(NULL);
+  }
+  return(hint);
+}
+
+void sok_hint_free(struct sokhint *hint) {
+  if (hint == NULL) return;
+  SDL_LockMutex(hint->lock);
+  hint->quit = 1;
+  SDL_AtomicSet(&(hint->cancel), 1);
+  SDL_CondSignal(hint->wakeup);
+  SDL_UnlockMutex(hint->lock);
+  SDL_WaitThread(hint->thread, NULL);
+  SDL_DestroyMutex(hint->lock);
+  SDL_DestroyCond(hint->wakeup);
+  if (hint->table != NULL) free(hint->table);
+  if (hint->keys != NULL) free(hint->keys);
+  free(hint);
+}
+
+/* computes the moves that walk the player to the tile behind atom, and push it in direction dir. returns a malloc()'ed string, or
+ * NULL if the player can't get there. */
+static char *pushmoves(struct sokgame *game, int atom, int dir) {
+  static const char dirmoves[5] = {0, 'u', 'l', 'd', 'r'};
+  short queue[field_tiles];
+  unsigned char from[field_tiles];  /* direction of the move that reached every tile (0 = not reached yet) */
+  int queuehead = 0, queuetail = 0, tile, nexttile, d, vectorx, vectory, target, len = 0;
+  char *res;
+  dirvector(dir, &vectorx, &vectory);
+  target = atom - (vectory * field_stride + vectorx);
+  memset(from, 0, sizeof(from));
+  tile = sok_fieldidx(game->positionx, game->positiony);
+  from[tile] = 5; /* the start tile is reached, but by no move */
+  queue[queuetail++] = tile;
+  while ((queuehead < queuetail) && (from[target] == 0)) {
+    tile = queue[queuehead++];
+    for (d = sokmoveUP; d <= sokmoveRIGHT; d++) {
+      dirvector(d, &vectorx, &vectory);
+      nexttile = tile + vectory * field_stride + vectorx;
+      if ((from[nexttile] != 0) || (game->field[nexttile] & (field_wall | field_atom)) || ((game->field[nexttile] & field_floor) == 0)) continue;
+      from[nexttile] = d;
+      queue[queuetail++] = nexttile;
+    }
+  }
+  if (from[target] == 0) return(NULL);
+  /* count the moves, then write them backward from the target */
+  for (tile = target; from[tile] != 5; len++) {
+    dirvector(from[tile], &vectorx, &vectory);
+    tile -= vectory * field_stride + vectorx;
+  }
+  res = malloc(len + 2);
+  if (res == NULL) return(NULL);
+  res[len] = dirmoves[dir] - 32; /* the push itself, uppercase */
+  res[len + 1] = 0;
+  for (tile = target; from[tile] != 5; tile -= vectory * field_stride + vectorx) {
+    res[--len] = dirmoves[from[tile]];
+    dirvector(from[tile], &vectorx, &vectory);
+  }
+  return(res);
+}
+
+enum SOKHINT sok_hint_get(struct sokhint *hint, struct sokgame *game, char **moves) {
+  struct knownpos *pos;
+  short key[field_tiles];
+  uint64_t hash;
+  enum SOKHINT res = sokhintBUSY;
+  *moves = NULL;
+  if (game->goalsleft == 0) return(sokhintNONE);
+  SDL_LockMutex(hint->lock);
+  if (game->crc32 != hint->crc32) {
+    forget(hint, game);
+    SDL_AtomicSet(&(hint->cancel), 1);
+    hint->searchhash = 0;
+  }
+  positionkey(game, key);
+  hash = sok_hashposition(game);
+  pos = lookup(hint, hash, key);
+  if (pos != NULL) {
+      res = pos->status;
+      if (res == sokhintREADY) {
+        *moves = pushmoves(game, pos->atom, pos->dir);
+        if (*moves == NULL) res = sokhintNONE;
+      }
+    } else if (hint->searchhash != hash) {
+      /* the position is not the one being searched: hand it over to the worker, aborting whatever it does */
+      memcpy(&(hint->request), game, sizeof(struct sokgame));
+      hint->request.solution = NULL;
+      hint->requested = 1;
+      hint->searchhash = hash;
+      SDL_AtomicSet(&(hint->cancel), 1);
+      SDL_CondSignal(hint->wakeup);
+  }
+  SDL_UnlockMutex(hint->lock);
+  return(res);
+}
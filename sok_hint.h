@@ -0,0 +1,49 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef sok_hint_h_sentinel
+#define sok_hint_h_sentinel
+
+  #include "sok_core.h"
+
+  enum SOKHINT {
+    sokhintREADY = 0,       /* the next push is known */
+    sokhintBUSY = 1,        /* still searching, ask again later */
+    sokhintUNSOLVABLE = 2,  /* the position can't be solved anymore */
+    sokhintGAVEUP = 3,      /* the search ran out of nodes or memory before finding anything */
+    sokhintNONE = 4         /* nothing to hint about (level solved, or out of memory) */
+  };
+
+  struct sokhint;
+
+  /* starts a hint engine, with its worker thread. returns NULL on error. */
+  struct sokhint *sok_hint_new(void);
+
+  /* stops the worker thread (aborting any search in progress) and releases the engine */
+  void sok_hint_free(struct sokhint *hint);
+
+  /* looks for a hint on the current position of game, without ever blocking. if the position is known, moves receives a malloc()'ed
+   * string of LURD moves that walk the player to the next push and perform it, otherwise a search is handed over to the worker
+   * thread and sokhintBUSY is returned: just ask again later. known positions are kept until another level is asked about, so
+   * following hints, undoing moves or coming back to an earlier position gives an answer right away. */
+  enum SOKHINT sok_hint_get(struct sokhint *hint, struct sokgame *game, char **moves);
+
+#endif
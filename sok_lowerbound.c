@@ -0,0 +1,226 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+/*
+ * Lower bound of the number of pushes a position needs to be solved. Every
+ * atom has to travel to a distinct goal, and can't get there in fewer
+ * pushes than it would on an otherwise empty level. The bound is the cost
+ * of the cheapest assignment of atoms to goals, found with the hungarian
+ * algorithm (shortest augmenting paths over dual potentials). When atoms
+ * outnumber goals, the spare atoms go to dummy goals that cost nothing.
+ *
+ * A push moves one atom, so the potentials of the previous assignment stay
+ * valid for all the others: only the moved atom is unassigned, its own
+ * potential is lowered until it is feasible again, and one augmenting path
+ * brings the assignment back to optimal. That's O(n^2) instead of O(n^3).
+ *
+ * A push brings the pushed atom at most one push closer to any goal, so
+ * the bound never drops by more than one per push: it is consistent, which
+ * is what a push-optimal A* needs.
+ */
+
+#include <limits.h>   /* INT_MAX */
+#include <stdlib.h>   /* malloc(), free() */
+#include <string.h>   /* memset(), memcpy() */
+#include "sok_core.h"
+#include "sok_lowerbound.h"
+
+#define NODIST 0xffffu   /* dist value of goals an atom can't reach */
+
+static const int vectors[4] = {-field_stride, 1, field_stride, -1};
+
+/* returns non-zero if tile is floor that an atom or the player may stand on */
+#define ISFLOOR(field, tile) (((field)[tile] & (field_floor | field_wall)) == field_floor)
+
+struct soklowerbound *sok_lowerbound_new(struct sokgame *game) {
+  struct soklowerbound *bound;
+  short queue[field_tiles];
+  int queuehead, queuetail, tile, from, goal, d, maxdist = 0;
+  unsigned short dist;
+  bound = malloc(sizeof(struct soklowerbound));
+  if (bound == NULL) return(NULL);
+  bound->atoms = 0;
+  bound->goals = 0;
+  for (tile = 0; tile < field_tiles; tile++) {
+    if (ISFLOOR(game->field, tile) == 0) continue;
+    if (game->field[tile] & field_atom) bound->atoms += 1;
+    if (game->field[tile] & field_goal) bound->goals += 1;
+  }
+  if ((bound->goals > bound->atoms) || (bound->atoms == 0)) {
+    free(bound);
+    return(NULL);
+  }
+  bound->dist = malloc(sizeof(unsigned short) * field_tiles * bound->goals);
+  if (bound->dist == NULL) {
+    free(bound);
+    return(NULL);
+  }
+  memset(bound->dist, 0xff, sizeof(unsigned short) * field_tiles * bound->goals);
+  /* pull an atom away from every goal: it can be pulled from tile to tile + vector if there is floor on both tile + vector and
+   * tile + 2 * vector (where the player stands), the same way dead squares are found */
+  goal = 0;
+  for (tile = 0; tile < field_tiles; tile++) {
+    if ((ISFLOOR(game->field, tile) == 0) || ((game->field[tile] & field_goal) == 0)) continue;
+    queuehead = 0;
+    queuetail = 0;
+    bound->dist[tile * bound->goals + goal] = 0;
+    queue[queuetail++] = tile;
+    while (queuehead < queuetail) {
+      from = queue[queuehead++];
+      dist = bound->dist[from * bound->goals + goal] + 1;
+      if (dist > maxdist) maxdist = dist;
+      for (d = 0; d < 4; d++) {
+        if ((ISFLOOR(game->field, from + vectors[d]) == 0) || (ISFLOOR(game->field, from + 2 * vectors[d]) == 0)) continue;
+        if (bound->dist[(from + vectors[d]) * bound->goals + goal] != NODIST) continue;
+        bound->dist[(from + vectors[d]) * bound->goals + goal] = dist;
+        queue[queuetail++] = from + vectors[d];
+      }
+    }
+    goal += 1;
+  }
+  bound->unreachable = bound->atoms * maxdist + 1;
+  return(bound);
+}
+
+void sok_lowerbound_free(struct soklowerbound *bound) {
+  if (bound == NULL) return;
+  free(bound->dist);
+  free(bound);
+}
+
+struct sokmatching *sok_lowerbound_newmatching(struct soklowerbound *bound) {
+  struct sokmatching *matching;
+  int *buff, n = bound->atoms + 1;
+  matching = malloc(sizeof(struct sokmatching));
+  buff = malloc(sizeof(int) * n * 8);
+  if ((matching == NULL) || (buff == NULL)) {
+    if (matching != NULL) free(matching);
+    if (buff != NULL) free(buff);
+    return(NULL);
+  }
+  memset(buff, 0, sizeof(int) * n * 8);
+  /* the arrays that make the state of the matching come first, so copying a matching is a single memcpy() */
+  matching->size = bound->atoms;
+  matching->tile = buff;
+  matching->u = buff + n;
+  matching->v = buff + n * 2;
+  matching->goalatom = buff + n * 3;
+  matching->atomgoal = buff + n * 4;
+  matching->way = buff + n * 5;
+  matching->minv = buff + n * 6;
+  matching->used = buff + n * 7;
+  return(matching);
+}
+
+void sok_lowerbound_freematching(struct sokmatching *matching) {
+  if (matching == NULL) return;
+  free(matching->tile);
+  free(matching);
+}
+
+void sok_lowerbound_copymatching(struct sokmatching *dst, struct sokmatching *src) {
+  memcpy(dst->tile, src->tile, sizeof(int) * (src->size + 1) * 5);
+}
+
+/* cost of sending atom to goal (both 1-based) */
+static int cost(struct soklowerbound *bound, struct sokmatching *m, int atom, int goal) {
+  unsigned short dist;
+  if (goal > bound->goals) return(0); /* dummy goal of a spare atom */
+  dist = bound->dist[m->tile[atom] * bound->goals + goal - 1];
+  if (dist == NODIST) return(bound->unreachable);
+  return(dist);
+}
+
+/* assigns the unassigned atom to a goal, along the shortest augmenting path. expects potentials to be feasible (cost - u - v >= 0)
+ * everywhere, and tight on every assigned pair. */
+static void augment(struct soklowerbound *bound, struct sokmatching *m, int atom) {
+  int n = m->size, goal, prevgoal = 0, nextgoal = 0, current, reduced, delta;
+  m->goalatom[0] = atom;
+  for (goal = 0; goal <= n; goal++) {
+    m->minv[goal] = INT_MAX;
+    m->used[goal] = 0;
+  }
+  do {
+    m->used[prevgoal] = 1;
+    current = m->goalatom[prevgoal];
+    delta = INT_MAX;
+    for (goal = 1; goal <= n; goal++) {
+      if (m->used[goal] != 0) continue;
+      reduced = cost(bound, m, current, goal) - m->u[current] - m->v[goal];
+      if (reduced < m->minv[goal]) {
+        m->minv[goal] = reduced;
+        m->way[goal] = prevgoal;
+      }
+      if (m->minv[goal] < delta) {
+        delta = m->minv[goal];
+        nextgoal = goal;
+      }
+    }
+    for (goal = 0; goal <= n; goal++) {
+      if (m->used[goal] != 0) {
+          m->u[m->goalatom[goal]] += delta;
+          m->v[goal] -= delta;
+        } else {
+          m->minv[goal] -= delta;
+      }
+    }
+    prevgoal = nextgoal;
+  } while (m->goalatom[prevgoal] != 0);
+  /* flip the assignments along the path */
+  do {
+    nextgoal = m->way[prevgoal];
+    m->goalatom[prevgoal] = m->goalatom[nextgoal];
+    m->atomgoal[m->goalatom[prevgoal]] = prevgoal;
+    prevgoal = nextgoal;
+  } while (prevgoal != 0);
+}
+
+/* returns the cost of the current assignment, or -1 if it sends an atom to a goal it can't reach */
+static int matchingcost(struct soklowerbound *bound, struct sokmatching *m) {
+  int atom, res = 0;
+  for (atom = 1; atom <= m->size; atom++) res += cost(bound, m, atom, m->atomgoal[atom]);
+  if (res >= bound->unreachable) return(-1);
+  return(res);
+}
+
+int sok_lowerbound_compute(struct soklowerbound *bound, struct sokmatching *matching, int *atoms) {
+  int atom;
+  memset(matching->tile, 0, sizeof(int) * (matching->size + 1) * 5);
+  for (atom = 1; atom <= matching->size; atom++) matching->tile[atom] = atoms[atom - 1];
+  for (atom = 1; atom <= matching->size; atom++) augment(bound, matching, atom);
+  return(matchingcost(bound, matching));
+}
+
+int sok_lowerbound_update(struct soklowerbound *bound, struct sokmatching *matching, int atom, int tile) {
+  int goal, reduced;
+  atom += 1;
+  matching->tile[atom] = tile;
+  matching->goalatom[matching->atomgoal[atom]] = 0;
+  matching->atomgoal[atom] = 0;
+  /* the atom's costs changed: lower its potential until no reduced cost is negative anymore */
+  matching->u[atom] = INT_MAX;
+  for (goal = 1; goal <= matching->size; goal++) {
+    reduced = cost(bound, matching, atom, goal) - matching->v[goal];
+    if (reduced < matching->u[atom]) matching->u[atom] = reduced;
+  }
+  augment(bound, matching, atom);
+  return(matchingcost(bound, matching));
+}
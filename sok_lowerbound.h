@@ -0,0 +1,69 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef sok_lowerbound_h_sentinel
+#define sok_lowerbound_h_sentinel
+
+  #include "sok_core.h"
+
+  /* the static part of the bound: push distances of a level, computed once */
+  struct soklowerbound {
+    int atoms;              /* number of atoms of the level, ie. the size of the matching */
+    int goals;              /* number of goals (there may be fewer goals than atoms, spare atoms then go to free dummy goals) */
+    unsigned short *dist;   /* dist[tile * goals + g] is the number of pushes needed to bring an atom from tile to goal g, if nothing else stood in the way */
+    int unreachable;        /* cost of sending an atom to a goal it can't reach: more than any matching made of possible moves */
+  };
+
+  /* a minimum-cost assignment of atoms to goals. every thread needs its own. arrays are 1-based (index 0 is used by the algorithm). */
+  struct sokmatching {
+    int size;
+    int *tile;              /* tile[i] is the field tile of atom i */
+    int *u;                 /* dual potential of every atom */
+    int *v;                 /* dual potential of every goal */
+    int *goalatom;          /* atom assigned to every goal */
+    int *atomgoal;          /* goal assigned to every atom */
+    int *way;               /* scratch buffers of the augmenting path search */
+    int *minv;
+    int *used;
+  };
+
+  /* computes the push distance tables of a level. returns NULL if out of memory, or if the level has more goals than atoms. */
+  struct soklowerbound *sok_lowerbound_new(struct sokgame *game);
+
+  void sok_lowerbound_free(struct soklowerbound *bound);
+
+  /* allocates a matching for a level's bound. returns NULL if out of memory. */
+  struct sokmatching *sok_lowerbound_newmatching(struct soklowerbound *bound);
+
+  void sok_lowerbound_freematching(struct sokmatching *matching);
+
+  /* copies the state of a matching into another one of the same level */
+  void sok_lowerbound_copymatching(struct sokmatching *dst, struct sokmatching *src);
+
+  /* computes from scratch the matching of the atoms standing on the field tiles listed in atoms (bound->atoms of them). returns the
+   * minimum number of pushes any solution needs, or -1 if some goal can't be reached by any atom (a deadlock). */
+  int sok_lowerbound_compute(struct soklowerbound *bound, struct sokmatching *matching, int *atoms);
+
+  /* updates a matching after the atom number atom (0-based, in the order they were listed to sok_lowerbound_compute) moved to tile.
+   * that's a single augmenting path instead of a whole new matching. returns the same as sok_lowerbound_compute(). */
+  int sok_lowerbound_update(struct soklowerbound *bound, struct sokmatching *matching, int atom, int tile);
+
+#endif
@@ -0,0 +1,481 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+/*
+ * Solutions are optimized for moves first, pushes second, which is how
+ * sok_checksolution() ranks them. A solution is turned into its list of
+ * pushes: walks are not kept, since the shortest walk between two pushes
+ * is computed whenever it is needed.
+ *
+ * Then windows of consecutive pushes are searched again. A window starts
+ * at the position reached after some push, with the player exactly where
+ * that push left it, and ends at the position the window's pushes lead to.
+ * Only the atoms the window pushes may move, the others are as good as
+ * walls. The search is a uniform-cost (Dial) search over positions made of
+ * these atoms plus the exact player tile, a push costing the walk to it
+ * plus one move. Reaching the end position also costs the walk from there
+ * to the push that follows the window. Whenever that adds up to fewer moves
+ * than the window took (or as many moves, with fewer pushes), the window's
+ * pushes are replaced. Windows are slid over the solution until a whole
+ * pass brings nothing.
+ */
+
+#include <stdlib.h>             /* malloc(), free() */
+#include <string.h>             /* memset(), memcpy() */
+#include "sok_core.h"
+#include "sok_optimize.h"
+
+#define DEFAULT_WINDOW 6
+#define DEFAULT_MAXNODES 20000l
+#define NOTREACHED 0x7fff       /* walking distance of tiles the player can't get to */
+
+/* directions, in the order used everywhere in the optimizer: up, right, down, left */
+static const int dirvectors[4] = {-field_stride, 1, field_stride, -1};
+static const char dirmoves[4] = {'u', 'r', 'd', 'l'};
+
+struct optimizer {
+  struct sokgame *game;
+  unsigned char floor[field_tiles];   /* non-zero for tiles atoms and the player may stand on */
+  unsigned char occ[field_tiles];     /* non-zero for tiles occupied by an atom */
+  short atomat[field_tiles];          /* id + 1 of the atom on every tile, 0 if none */
+  int atoms;
+  short *startatoms;                  /* tile of every atom at the start */
+  short *atomtile;                    /* tile of every atom, as replayed so far */
+  int startplayer;
+  /* the solution, as a list of pushes */
+  int pushes;
+  int pushalloc;
+  short *pushatom;                    /* tile of the pushed atom, before the push */
+  unsigned char *pushdir;
+  /* walks */
+  uint32_t stamp;
+  uint32_t seen[field_tiles];
+  short dist[field_tiles];
+  unsigned char from[field_tiles];    /* direction of the move that reached every tile */
+  short queue[field_tiles];
+  short taildist[field_tiles];        /* walking distance from the push that follows a window */
+  /* window search */
+  int window;
+  long maxnodes;
+  int movables;                       /* number of atoms the window search may push */
+  short *keys;                        /* movables sorted atom tiles, then the player tile, for every node */
+  int *moves;
+  int *npushes;
+  int *parent;
+  short *lastatom;                    /* the push that led to every node */
+  unsigned char *lastdir;
+  unsigned char *closed;
+  long nodecount;
+  int *table;                         /* hash table of node ids + 1 (0 = empty slot) */
+  long tablesize;
+  int *qnode;                         /* bucket queue entries (node ids), linked per bucket through qnext */
+  int *qnext;
+  long qcount;
+  long qalloc;
+  struct sokoptimizestats *stats;
+};
+
+/* computes walking distances from tile start into dist (only valid where seen == stamp), stops as soon as goal is reached (goal may
+ * be -1 to compute the whole area). returns the distance to goal, or NOTREACHED. */
+static int walk(struct optimizer *o, int start, int goal) {
+  int queuehead = 0, queuetail = 0, tile, nexttile, d;
+  o->stamp += 1;
+  o->seen[start] = o->stamp;
+  o->dist[start] = 0;
+  o->queue[queuetail++] = start;
+  while (queuehead < queuetail) {
+    tile = o->queue[queuehead++];
+    if (tile == goal) return(o->dist[tile]);
+    for (d = 0; d < 4; d++) {
+      nexttile = tile + dirvectors[d];
+      if ((o->seen[nexttile] == o->stamp) || (o->floor[nexttile] == 0) || (o->occ[nexttile] != 0)) continue;
+      o->seen[nexttile] = o->stamp;
+      o->dist[nexttile] = o->dist[tile] + 1;
+      o->from[nexttile] = d;
+      o->queue[queuetail++] = nexttile;
+    }
+  }
+  return(NOTREACHED);
+}
+
+/* brings occ, atomat and atomtile to the position reached after the first upto pushes. returns the player tile. */
+static int replay(struct optimizer *o, int upto) {
+  int i, atom;
+  memset(o->occ, 0, sizeof(o->occ));
+  memset(o->atomat, 0, sizeof(o->atomat));
+  for (i = 0; i < o->atoms; i++) {
+    o->atomtile[i] = o->startatoms[i];
+    o->occ[o->startatoms[i]] = 1;
+    o->atomat[o->startatoms[i]] = i + 1;
+  }
+  for (i = 0; i < upto; i++) {
+    atom = o->atomat[o->pushatom[i]] - 1;
+    o->occ[o->pushatom[i]] = 0;
+    o->atomat[o->pushatom[i]] = 0;
+    o->atomtile[atom] = o->pushatom[i] + dirvectors[o->pushdir[i]];
+    o->occ[o->atomtile[atom]] = 1;
+    o->atomat[o->atomtile[atom]] = atom + 1;
+  }
+  if (upto == 0) return(o->startplayer);
+  return(o->pushatom[upto - 1]);
+}
+
+/* makes room for count pushes in the solution. returns 0 on success. */
+static int reservepushes(struct optimizer *o, int count) {
+  short *newatom;
+  unsigned char *newdir;
+  int newalloc;
+  if (count <= o->pushalloc) return(0);
+  newalloc = (o->pushalloc < 64) ? 64 : o->pushalloc;
+  while (newalloc < count) newalloc *= 2;
+  newatom = realloc(o->pushatom, sizeof(short) * newalloc);
+  if (newatom == NULL) return(-1);
+  o->pushatom = newatom;
+  newdir = realloc(o->pushdir, newalloc);
+  if (newdir == NULL) return(-1);
+  o->pushdir = newdir;
+  o->pushalloc = newalloc;
+  return(0);
+}
+
+/* appends a push to the solution. returns 0 on success. */
+static int addpush(struct optimizer *o, int atom, int dir) {
+  if (reservepushes(o, o->pushes + 1) != 0) return(-1);
+  o->pushatom[o->pushes] = atom;
+  o->pushdir[o->pushes] = dir;
+  o->pushes += 1;
+  return(0);
+}
+
+/* turns a LURD string into a list of pushes. returns 0 if the moves are legal and solve the game, non-zero otherwise. moves past the
+ * one that solves the game are ignored. */
+static int parsesolution(struct optimizer *o, char *solution) {
+  int player, i, d, goalsleft = 0;
+  player = o->startplayer;
+  replay(o, 0);
+  for (i = 0; i < field_tiles; i++) {
+    if ((o->floor[i] != 0) && (o->game->field[i] & field_goal) && (o->occ[i] == 0)) goalsleft += 1;
+  }
+  for (; (*solution != 0) && (goalsleft != 0); solution++) {
+    for (d = 0; (d < 4) && (dirmoves[d] != (*solution | 32)); d++);
+    if (d == 4) return(-1);
+    if (o->floor[player + dirvectors[d]] == 0) return(-1);
+    player += dirvectors[d];
+    if (o->occ[player] == 0) continue;
+    /* a push */
+    if ((o->floor[player + dirvectors[d]] == 0) || (o->occ[player + dirvectors[d]] != 0)) return(-1);
+    if (addpush(o, player, d) != 0) return(-1);
+    o->occ[player] = 0;
+    o->occ[player + dirvectors[d]] = 1;
+    if (o->game->field[player] & field_goal) goalsleft += 1;
+    if (o->game->field[player + dirvectors[d]] & field_goal) goalsleft -= 1;
+  }
+  if (goalsleft != 0) return(-1);
+  return(0);
+}
+
+/* builds the LURD string of the current list of pushes, with shortest walks. returns a malloc()'ed string, or NULL on error. */
+static char *buildsolution(struct optimizer *o) {
+  char *res;
+  long len = 0, alloc = 256;
+  int i, player, behind, tile, d, steps;
+  res = malloc(alloc);
+  if (res == NULL) return(NULL);
+  player = replay(o, 0);
+  for (i = 0; i < o->pushes; i++) {
+    behind = o->pushatom[i] - dirvectors[o->pushdir[i]];
+    steps = walk(o, player, behind);
+    if (steps == NOTREACHED) {
+      free(res);
+      return(NULL);
+    }
+    if (len + steps + 2 > alloc) {
+      char *newres;
+      while (len + steps + 2 > alloc) alloc *= 2;
+      newres = realloc(res, alloc);
+      if (newres == NULL) {
+        free(res);
+        return(NULL);
+      }
+      res = newres;
+    }
+    /* write the walk backward from where it ends */
+    for (tile = behind, d = steps; tile != player; tile -= dirvectors[o->from[tile]]) res[len + --d] = dirmoves[o->from[tile]];
+    len += steps;
+    res[len++] = dirmoves[o->pushdir[i]] - 32;
+    o->occ[o->pushatom[i]] = 0;
+    o->occ[o->pushatom[i] + dirvectors[o->pushdir[i]]] = 1;
+    player = o->pushatom[i];
+  }
+  res[len] = 0;
+  return(res);
+}
+
+static unsigned long hashkey(short *key, int len) {
+  unsigned long hash = 2166136261lu;
+  int i;
+  for (i = 0; i < len; i++) hash = ((hash ^ (unsigned short)key[i]) * 16777619lu) & 0xfffffffflu;
+  return(hash);
+}
+
+/* returns the id of the node that has key, or -1. if there is none and add is set, stores key as a new node (then returns its id,
+ * or -1 if the search is out of nodes). */
+static long findnode(struct optimizer *o, short *key, int add) {
+  long i;
+  int len = o->movables + 1;
+  for (i = (long)(hashkey(key, len) & (o->tablesize - 1)); o->table[i] != 0; i = (i + 1) & (o->tablesize - 1)) {
+    if (memcmp(o->keys + (long)(o->table[i] - 1) * len, key, sizeof(short) * len) == 0) return(o->table[i] - 1);
+  }
+  if ((add == 0) || (o->nodecount >= o->maxnodes)) return(-1);
+  memcpy(o->keys + o->nodecount * len, key, sizeof(short) * len);
+  o->closed[o->nodecount] = 0;
+  o->table[i] = o->nodecount + 1;
+  o->nodecount += 1;
+  return(o->nodecount - 1);
+}
+
+/* queues a node in the bucket of its moves. returns 0 on success. */
+static int enqueue(struct optimizer *o, int *buckets, long node) {
+  if (o->qcount == o->qalloc) return(-1);
+  o->qnode[o->qcount] = node;
+  o->qnext[o->qcount] = buckets[o->moves[node]];
+  buckets[o->moves[node]] = o->qcount;
+  o->qcount += 1;
+  return(0);
+}
+
+/* searches the window of k pushes that starts after push first for a cheaper sequence of pushes, and puts it in place of the
+ * window's pushes. returns 1 if the solution got better, 0 otherwise. */
+static int searchwindow(struct optimizer *o, int first, int k) {
+  short start[field_tiles], key[field_tiles], childkey[field_tiles], target[field_tiles], tileatfirst[field_tiles];
+  unsigned char moved[field_tiles];
+  int player, i, j, d, behind, steps, origmoves = 0, bestmoves, bestpushes, c, len, atom, dest;
+  int *buckets;
+  long node, child, best = -1, q;
+  /* replay the window: what it costs, and which atoms it pushes */
+  player = replay(o, first);
+  memcpy(tileatfirst, o->atomtile, sizeof(short) * o->atoms);
+  memset(moved, 0, o->atoms);
+  for (i = first; i < first + k; i++) {
+    behind = o->pushatom[i] - dirvectors[o->pushdir[i]];
+    steps = walk(o, player, behind);
+    if (steps == NOTREACHED) return(0);
+    origmoves += steps + 1;
+    atom = o->atomat[o->pushatom[i]] - 1;
+    moved[atom] = 1;
+    o->occ[o->pushatom[i]] = 0;
+    o->atomat[o->pushatom[i]] = 0;
+    o->atomtile[atom] = o->pushatom[i] + dirvectors[o->pushdir[i]];
+    o->occ[o->atomtile[atom]] = 1;
+    o->atomat[o->atomtile[atom]] = atom + 1;
+    player = o->pushatom[i];
+  }
+  /* the walk to the push that follows the window, from anywhere */
+  if (first + k < o->pushes) {
+      walk(o, o->pushatom[first + k] - dirvectors[o->pushdir[first + k]], -1);
+      for (i = 0; i < field_tiles; i++) o->taildist[i] = (o->seen[i] == o->stamp) ? o->dist[i] : NOTREACHED;
+    } else {
+      memset(o->taildist, 0, sizeof(o->taildist));
+  }
+  origmoves += o->taildist[player];
+  /* the atoms of the window: where they start, and where they have to end (field order, hence sorted) */
+  o->movables = 0;
+  for (i = 0; i < field_tiles; i++) {
+    if ((o->atomat[i] != 0) && (moved[o->atomat[i] - 1] != 0)) target[o->movables++] = i;
+  }
+  len = 0;
+  for (i = 0; i < field_tiles; i++) {
+    if ((o->atomat[i] != 0) && (moved[o->atomat[i] - 1] != 0)) o->occ[i] = 0; /* occ now only holds the atoms that stay put */
+  }
+  for (j = 0; j < o->atoms; j++) {
+    if (moved[j] != 0) start[len++] = tileatfirst[j];
+  }
+  for (i = 1; i < len; i++) { /* sort the start tiles */
+    short t = start[i];
+    for (j = i; (j > 0) && (start[j - 1] > t); j--) start[j] = start[j - 1];
+    start[j] = t;
+  }
+  /* uniform-cost search, moves never exceed those of the window */
+  buckets = malloc(sizeof(int) * (origmoves + 1));
+  if (buckets == NULL) return(0);
+  for (i = 0; i <= origmoves; i++) buckets[i] = -1;
+  memset(o->table, 0, sizeof(int) * o->tablesize);
+  o->nodecount = 0;
+  o->qcount = 0;
+  memcpy(key, start, sizeof(short) * o->movables);
+  key[o->movables] = (first == 0) ? o->startplayer : o->pushatom[first - 1];
+  node = findnode(o, key, 1);
+  o->moves[node] = 0;
+  o->npushes[node] = 0;
+  o->parent[node] = -1;
+  enqueue(o, buckets, node);
+  bestmoves = origmoves;
+  bestpushes = k;
+  for (c = 0; c <= bestmoves; c++) {
+    for (q = buckets[c]; q >= 0; q = o->qnext[q]) {
+      node = o->qnode[q];
+      if ((o->closed[node] != 0) || (o->moves[node] != c)) continue;
+      o->closed[node] = 1;
+      if (o->stats != NULL) o->stats->nodes += 1;
+      memcpy(key, o->keys + node * (o->movables + 1), sizeof(short) * (o->movables + 1));
+      /* is it the end position of the window? */
+      if ((memcmp(key, target, sizeof(short) * o->movables) == 0) && (o->taildist[key[o->movables]] != NOTREACHED)) {
+        steps = c + o->taildist[key[o->movables]];
+        if ((steps < bestmoves) || ((steps == bestmoves) && (o->npushes[node] < bestpushes))) {
+          bestmoves = steps;
+          bestpushes = o->npushes[node];
+          best = node;
+        }
+      }
+      /* expand it */
+      for (i = 0; i < o->movables; i++) o->occ[key[i]] = 1;
+      walk(o, key[o->movables], -1);
+      for (i = 0; i < o->movables; i++) {
+        for (d = 0; d < 4; d++) {
+          behind = key[i] - dirvectors[d];
+          dest = key[i] + dirvectors[d];
+          if ((o->seen[behind] != o->stamp) || (o->floor[dest] == 0) || (o->occ[dest] != 0) || (sok_isdead(o->game, dest) && sok_deadsquaresmatter(o->game))) continue;
+          steps = c + o->dist[behind] + 1;
+          if (steps > bestmoves) continue;
+          /* the child: atom i moves to dest (keep the tiles sorted), the player stands where it was */
+          memcpy(childkey, key, sizeof(short) * (o->movables + 1));
+          for (j = i; (j > 0) && (childkey[j - 1] > dest); j--) childkey[j] = childkey[j - 1];
+          for (; (j < o->movables - 1) && (childkey[j + 1] < dest); j++) childkey[j] = childkey[j + 1];
+          childkey[j] = dest;
+          childkey[o->movables] = key[i];
+          child = findnode(o, childkey, 0);
+          if (child < 0) {
+              child = findnode(o, childkey, 1);
+              if (child < 0) goto DONE; /* out of nodes */
+            } else if ((o->closed[child] != 0) || (steps > o->moves[child]) || ((steps == o->moves[child]) && (o->npushes[node] + 1 >= o->npushes[child]))) {
+              continue;
+          }
+          o->moves[child] = steps;
+          o->npushes[child] = o->npushes[node] + 1;
+          o->parent[child] = node;
+          o->lastatom[child] = key[i];
+          o->lastdir[child] = d;
+          if (enqueue(o, buckets, child) != 0) goto DONE;
+        }
+      }
+      for (i = 0; i < o->movables; i++) o->occ[key[i]] = 0;
+    }
+  }
+  DONE:
+  free(buckets);
+  if (o->stats != NULL) o->stats->windows += 1;
+  if (best < 0) return(0);
+  /* put the new pushes in place of the window's ones: the window becomes bestpushes pushes long */
+  if (reservepushes(o, o->pushes + bestpushes - k) != 0) return(0);
+  memmove(o->pushatom + first + bestpushes, o->pushatom + first + k, sizeof(short) * (o->pushes - first - k));
+  memmove(o->pushdir + first + bestpushes, o->pushdir + first + k, o->pushes - first - k);
+  o->pushes += bestpushes - k;
+  for (i = bestpushes - 1, node = best; i >= 0; i--, node = o->parent[node]) {
+    o->pushatom[first + i] = o->lastatom[node];
+    o->pushdir[first + i] = o->lastdir[node];
+  }
+  if (o->stats != NULL) o->stats->improvements += 1;
+  return(1);
+}
+
+static void freeoptimizer(struct optimizer *o) {
+  if (o->startatoms != NULL) free(o->startatoms);
+  if (o->atomtile != NULL) free(o->atomtile);
+  if (o->pushatom != NULL) free(o->pushatom);
+  if (o->pushdir != NULL) free(o->pushdir);
+  if (o->keys != NULL) free(o->keys);
+  if (o->moves != NULL) free(o->moves);
+  if (o->npushes != NULL) free(o->npushes);
+  if (o->parent != NULL) free(o->parent);
+  if (o->lastatom != NULL) free(o->lastatom);
+  if (o->lastdir != NULL) free(o->lastdir);
+  if (o->closed != NULL) free(o->closed);
+  if (o->table != NULL) free(o->table);
+  if (o->qnode != NULL) free(o->qnode);
+  if (o->qnext != NULL) free(o->qnext);
+  free(o);
+}
+
+char *sok_optimize(struct sokgame *game, char *solution, int window, long maxnodes, struct sokoptimizestats *stats) {
+  struct optimizer *o;
+  char *res;
+  long movesbefore, pushesbefore, movesafter, pushesafter;
+  int tile, first, improved;
+  if (window < 1) window = DEFAULT_WINDOW;
+  if (maxnodes < 1) maxnodes = DEFAULT_MAXNODES;
+  if (stats != NULL) memset(stats, 0, sizeof(struct sokoptimizestats));
+  o = malloc(sizeof(struct optimizer));
+  if (o == NULL) return(NULL);
+  memset(o, 0, sizeof(struct optimizer));
+  o->game = game;
+  o->stats = stats;
+  o->window = window;
+  o->maxnodes = maxnodes;
+  o->startplayer = sok_fieldidx(game->positionx, game->positiony);
+  for (tile = 0; tile < field_tiles; tile++) {
+    o->floor[tile] = ((game->field[tile] & (field_floor | field_wall)) == field_floor);
+    if (game->field[tile] & field_atom) o->atoms += 1;
+  }
+  o->startatoms = malloc(sizeof(short) * (o->atoms + 1));
+  o->atomtile = malloc(sizeof(short) * (o->atoms + 1));
+  for (o->tablesize = 1024; o->tablesize < maxnodes * 2; o->tablesize *= 2);
+  o->qalloc = maxnodes * 4;
+  o->keys = malloc(sizeof(short) * (window + 1) * maxnodes);
+  o->moves = malloc(sizeof(int) * maxnodes);
+  o->npushes = malloc(sizeof(int) * maxnodes);
+  o->parent = malloc(sizeof(int) * maxnodes);
+  o->lastatom = malloc(sizeof(short) * maxnodes);
+  o->lastdir = malloc(maxnodes);
+  o->closed = malloc(maxnodes);
+  o->table = malloc(sizeof(int) * o->tablesize);
+  o->qnode = malloc(sizeof(int) * o->qalloc);
+  o->qnext = malloc(sizeof(int) * o->qalloc);
+  if ((o->startatoms == NULL) || (o->atomtile == NULL) || (o->keys == NULL) || (o->moves == NULL) || (o->npushes == NULL) || (o->parent == NULL)
+   || (o->lastatom == NULL) || (o->lastdir == NULL) || (o->closed == NULL) || (o->table == NULL) || (o->qnode == NULL) || (o->qnext == NULL)) {
+    freeoptimizer(o);
+    return(NULL);
+  }
+  o->atoms = 0;
+  for (tile = 0; tile < field_tiles; tile++) {
+    if ((o->floor[tile] != 0) && (game->field[tile] & field_atom)) o->startatoms[o->atoms++] = tile;
+  }
+  if (parsesolution(o, solution) != 0) {
+    freeoptimizer(o);
+    return(NULL);
+  }
+  movesbefore = sok_history_getlen(solution);
+  pushesbefore = sok_history_getpushes(solution);
+  /* slide windows over the solution until a whole pass brings nothing (every improvement is strict, so this ends) */
+  do {
+    improved = 0;
+    for (first = 0; first + 1 < o->pushes; first++) {
+      while (searchwindow(o, first, (first + window <= o->pushes) ? window : o->pushes - first) != 0) improved = 1;
+    }
+  } while (improved != 0);
+  res = buildsolution(o);
+  freeoptimizer(o);
+  if (res == NULL) return(NULL);
+  movesafter = sok_history_getlen(res);
+  pushesafter = sok_history_getpushes(res);
+  if ((movesafter < movesbefore) || ((movesafter == movesbefore) && (pushesafter < pushesbefore))) return(res);
+  free(res);
+  return(NULL);
+}
@@ -0,0 +1,40 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef sok_optimize_h_sentinel
+#define sok_optimize_h_sentinel
+
+  #include "sok_core.h"
+
+  struct sokoptimizestats {
+    long windows;         /* number of windows of pushes searched again */
+    long improvements;    /* number of windows that got shorter */
+    long nodes;           /* number of positions expanded by all window searches */
+  };
+
+  /* tries to shorten solution, a string of moves in the LURD notation that solves game from its current position. the walks between
+   * pushes are replaced by shortest ones, and every window of window consecutive pushes (0 = default) is searched again for a cheaper
+   * way to get to the same position, expanding at most maxnodes positions (0 = default). returns a malloc()'ed solution that is strictly
+   * better, ie. that has fewer moves, or as many moves and fewer pushes. returns NULL if no better solution has been found, or if
+   * solution does not solve game. stats may be NULL. */
+  char *sok_optimize(struct sokgame *game, char *solution, int window, long maxnodes, struct sokoptimizestats *stats);
+
+#endif
@@ -0,0 +1,477 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+/*
+ * Pattern database of a level: the exact number of pushes needed by every
+ * lone atom, and by every pair of atoms, to reach goals. Unlike the bound
+ * of sok_lowerbound.c, atoms of a pair get in each other's way, and the
+ * player has to walk around them.
+ *
+ * It is built by a breadth-first search that pulls atoms away from goals
+ * (pulls are pushes played backwards). A state is the one or two atoms,
+ * plus the area the player is in, identified by its lowest tile. The cost
+ * of a pattern is the lowest over all the areas the player may be in.
+ *
+ * The database is written in the save directory, next to solutions, and
+ * mapped in memory when the level is solved again. The file is a header,
+ * the live square of every field tile, then single and pair costs. It is
+ * stored in the byte order of the machine that built it: the magic number
+ * doesn't match on others, and the file is simply ignored there.
+ */
+
+#include <stdio.h>    /* fopen(), fwrite() */
+#include <stdlib.h>   /* malloc(), realloc(), free() */
+#include <string.h>   /* memset() */
+#ifdef _WIN32
+#include <windows.h>  /* CreateFileMapping(), MapViewOfFile() */
+#else
+#include <fcntl.h>    /* open() */
+#include <unistd.h>   /* close() */
+#include <sys/mman.h> /* mmap() */
+#include <sys/stat.h> /* fstat() */
+#endif
+#include "save.h"
+#include "sok_core.h"
+#include "sok_pdb.h"
+
+#define PDBMAGIC 0x42445053lu   /* "SPDB" */
+#define PDBVERSION 1
+#define HASHINITSLOTS 4096
+#define NOTILE 0                /* tile of the missing atom of single atom states (it's in the border, so never any atom's) */
+
+static const int vectors[4] = {-field_stride, 1, field_stride, -1};
+
+struct pdbheader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t crc32;               /* crc of the level */
+  uint32_t live;                /* number of live squares */
+  uint32_t filesize;
+  uint32_t reserved[3];
+};
+
+#define PAIRINDEX(i, j) ((long)(j) * ((j) - 1) / 2 + (i))  /* index of the pair of live squares i < j */
+#define FILESIZE(live) ((long)sizeof(struct pdbheader) + (long)sizeof(short) * field_tiles + (live) + PAIRINDEX(0, (long)(live)))
+
+/* state of the search: atoms on tiles a and b (b is NOTILE for a lone atom), player in the area which lowest tile is area */
+#define STATEKEY(a, b, area) ((uint64_t)(a) | ((uint64_t)(b) << 12) | ((uint64_t)(area) << 24))
+#define KEYA(key) ((int)((key) & 4095))
+#define KEYB(key) ((int)(((key) >> 12) & 4095))
+#define KEYAREA(key) ((int)(((key) >> 24) & 4095))
+
+struct builder {
+  unsigned char walkable[field_tiles];
+  unsigned char atomat[field_tiles];
+  uint32_t reach[field_tiles];  /* reach[tile] == reachstamp for the area of the state being expanded */
+  uint32_t seen[field_tiles];   /* seen[tile] == seenstamp for any other area */
+  uint32_t reachstamp;
+  uint32_t seenstamp;
+  short queue[field_tiles];
+  /* visited states: open addressing hash table of keys (0 = empty slot) and their distances */
+  uint64_t *keys;
+  unsigned short *dist;
+  long slots;
+  long count;
+  /* states to expand, in order */
+  uint64_t *todo;
+  long todoalloc;
+  long todocount;
+  long memory;
+  long budget;
+};
+
+/* marks with stamp all the tiles the player can walk to from start, and returns the lowest of them */
+static int flood(struct builder *b, uint32_t *marks, uint32_t stamp, int start) {
+  int queuehead = 0, queuetail = 0, tile, next, d, best = start;
+  b->queue[queuetail++] = start;
+  marks[start] = stamp;
+  while (queuehead < queuetail) {
+    tile = b->queue[queuehead++];
+    if (tile < best) best = tile;
+    for (d = 0; d < 4; d++) {
+      next = tile + vectors[d];
+      if ((marks[next] == stamp) || (b->walkable[next] == 0) || (b->atomat[next] != 0)) continue;
+      marks[next] = stamp;
+      b->queue[queuetail++] = next;
+    }
+  }
+  return(best);
+}
+
+/* returns the slot of key in the hash table, or the empty slot where it belongs */
+static long hashslot(struct builder *b, uint64_t key) {
+  long i;
+  i = (long)((key * 0x9E3779B97F4A7C15ull) >> 40) & (b->slots - 1);
+  while ((b->keys[i] != 0) && (b->keys[i] != key)) i = (i + 1) & (b->slots - 1);
+  return(i);
+}
+
+/* doubles the size of the hash table. returns 0 on success, non-zero if out of memory or budget. */
+static int growhash(struct builder *b) {
+  uint64_t *oldkeys = b->keys;
+  unsigned short *olddist = b->dist;
+  long oldslots = b->slots, i, slot;
+  b->slots = (oldslots == 0) ? HASHINITSLOTS : oldslots * 2;
+  if (b->memory + (b->slots - oldslots) * (long)(sizeof(uint64_t) + sizeof(unsigned short)) > b->budget) {
+    b->slots = oldslots;
+    return(-1);
+  }
+  b->keys = calloc(b->slots, sizeof(uint64_t));
+  b->dist = malloc(b->slots * sizeof(unsigned short));
+  if ((b->keys == NULL) || (b->dist == NULL)) {
+    if (b->keys != NULL) free(b->keys);
+    if (b->dist != NULL) free(b->dist);
+    b->keys = oldkeys;
+    b->dist = olddist;
+    b->slots = oldslots;
+    return(-1);
+  }
+  b->memory += (b->slots - oldslots) * (long)(sizeof(uint64_t) + sizeof(unsigned short));
+  for (i = 0; i < oldslots; i++) {
+    if (oldkeys[i] == 0) continue;
+    slot = hashslot(b, oldkeys[i]);
+    b->keys[slot] = oldkeys[i];
+    b->dist[slot] = olddist[i];
+  }
+  if (oldkeys != NULL) free(oldkeys);
+  if (olddist != NULL) free(olddist);
+  return(0);
+}
+
+/* records a state unless it has been seen already. returns 0 on success, non-zero if out of memory or budget. */
+static int addstate(struct builder *b, int atom1, int atom2, int area, unsigned short dist) {
+  uint64_t key;
+  long slot;
+  /* the same pair of atoms is always listed in the same order */
+  if ((atom2 != NOTILE) && (atom2 < atom1)) {
+    int tmp = atom1;
+    atom1 = atom2;
+    atom2 = tmp;
+  }
+  key = STATEKEY(atom1, atom2, area);
+  if ((b->count + 1) * 2 > b->slots) {
+    if (growhash(b) != 0) return(-1);
+  }
+  slot = hashslot(b, key);
+  if (b->keys[slot] != 0) return(0);
+  if (b->todocount == b->todoalloc) {
+    uint64_t *newtodo;
+    long newalloc = (b->todoalloc == 0) ? HASHINITSLOTS : b->todoalloc * 2;
+    if (b->memory + (newalloc - b->todoalloc) * (long)sizeof(uint64_t) > b->budget) return(-1);
+    newtodo = realloc(b->todo, newalloc * sizeof(uint64_t));
+    if (newtodo == NULL) return(-1);
+    b->memory += (newalloc - b->todoalloc) * (long)sizeof(uint64_t);
+    b->todo = newtodo;
+    b->todoalloc = newalloc;
+  }
+  b->keys[slot] = key;
+  b->dist[slot] = dist;
+  b->count += 1;
+  b->todo[b->todocount++] = key;
+  return(0);
+}
+
+/* adds a state for every area the player may be in around atoms atom1 and atom2, at distance 0. returns 0 on success. */
+static int addgoalstates(struct builder *b, int atom1, int atom2) {
+  int tile, area, res = 0;
+  b->atomat[atom1] = 1;
+  b->atomat[atom2] = 1;
+  b->seenstamp += 1;
+  for (tile = 0; (tile < field_tiles) && (res == 0); tile++) {
+    if ((b->walkable[tile] == 0) || (b->atomat[tile] != 0) || (b->seen[tile] == b->seenstamp)) continue;
+    area = flood(b, b->seen, b->seenstamp, tile);
+    res = addstate(b, atom1, atom2, area, 0);
+  }
+  b->atomat[atom1] = 0;
+  b->atomat[atom2] = 0;
+  return(res);
+}
+
+/* adds all the states the state key can be pulled to. returns 0 on success. */
+static int expandstate(struct builder *b, uint64_t key, unsigned short dist) {
+  int atoms[2], i, d, from, to, player, area, res = 0;
+  atoms[0] = KEYA(key);
+  atoms[1] = KEYB(key);
+  b->atomat[atoms[0]] = 1;
+  b->atomat[atoms[1]] = 1;
+  b->reachstamp += 1;
+  flood(b, b->reach, b->reachstamp, KEYAREA(key));
+  for (i = 0; (i < 2) && (res == 0); i++) {
+    from = atoms[i];
+    if (from == NOTILE) continue;
+    for (d = 0; d < 4; d++) {
+      /* the player stands next to the atom, and steps back pulling it */
+      to = from + vectors[d];
+      player = to + vectors[d];
+      if ((b->reach[to] != b->reachstamp) || (b->walkable[player] == 0) || (b->atomat[player] != 0)) continue;
+      b->atomat[from] = 0;
+      b->atomat[to] = 1;
+      b->seenstamp += 1;
+      area = flood(b, b->seen, b->seenstamp, player);
+      b->atomat[to] = 0;
+      b->atomat[from] = 1;
+      res = addstate(b, to, atoms[1 - i], area, dist + 1);
+      if (res != 0) break;
+    }
+  }
+  b->atomat[atoms[0]] = 0;
+  b->atomat[atoms[1]] = 0;
+  return(res);
+}
+
+static void freebuilder(struct builder *b) {
+  if (b->keys != NULL) free(b->keys);
+  if (b->dist != NULL) free(b->dist);
+  if (b->todo != NULL) free(b->todo);
+  free(b);
+}
+
+long sok_pdb_build(struct sokgame *game, long budget) {
+  struct builder *b;
+  struct pdbheader *hdr;
+  unsigned char *file, *single, *pair;
+  short *tile2live;
+  char path[4096];
+  long filesize, i, cost, index;
+  int tile, tile2, live = 0, atoms = 0, goals = 0, l1, l2;
+  FILE *fd;
+  b = calloc(1, sizeof(struct builder));
+  if (b == NULL) return(-1);
+  b->budget = budget;
+  /* the tiles the player can ever walk on: all non-wall tiles connected to the player */
+  for (tile = 0; tile < field_tiles; tile++) b->walkable[tile] = ((game->field[tile] & field_wall) == 0);
+  b->seenstamp = 1;
+  flood(b, b->seen, b->seenstamp, sok_fieldidx(game->positionx, game->positiony));
+  for (tile = 0; tile < field_tiles; tile++) {
+    b->walkable[tile] = (b->seen[tile] == b->seenstamp);
+    if (b->walkable[tile] == 0) {
+      if ((game->field[tile] & (field_goal | field_atom)) == field_goal) goals = -1; /* a goal out of reach: never solvable */
+      continue;
+    }
+    if (game->field[tile] & field_atom) atoms += 1;
+    if ((game->field[tile] & field_goal) && (goals >= 0)) goals += 1;
+    if (sok_isdead(game, tile) == 0) live += 1;
+  }
+  /* pairs only make sense if every atom has to end on a goal */
+  filesize = FILESIZE(live);
+  if ((atoms != goals) || (goals <= 0) || (filesize > budget)) {
+    freebuilder(b);
+    return(0);
+  }
+  b->memory = sizeof(struct builder) + filesize;
+  /* pull lone atoms and pairs of atoms away from all goals */
+  for (tile = 0; tile < field_tiles; tile++) {
+    if ((b->walkable[tile] == 0) || ((game->field[tile] & field_goal) == 0)) continue;
+    if (addgoalstates(b, tile, NOTILE) != 0) goto outofbudget;
+    for (tile2 = tile + 1; tile2 < field_tiles; tile2++) {
+      if ((b->walkable[tile2] == 0) || ((game->field[tile2] & field_goal) == 0)) continue;
+      if (addgoalstates(b, tile, tile2) != 0) goto outofbudget;
+    }
+  }
+  for (i = 0; i < b->todocount; i++) {
+    if (expandstate(b, b->todo[i], b->dist[hashslot(b, b->todo[i])]) != 0) goto outofbudget;
+  }
+  /* the cost of a pattern is its lowest over all player areas */
+  file = malloc(filesize);
+  if (file == NULL) {
+    freebuilder(b);
+    return(-1);
+  }
+  memset(file, 0, filesize);
+  hdr = (struct pdbheader *)file;
+  hdr->magic = PDBMAGIC;
+  hdr->version = PDBVERSION;
+  hdr->crc32 = game->crc32;
+  hdr->live = live;
+  hdr->filesize = filesize;
+  tile2live = (short *)(file + sizeof(struct pdbheader));
+  single = file + sizeof(struct pdbheader) + sizeof(short) * field_tiles;
+  pair = single + live;
+  live = 0;
+  for (tile = 0; tile < field_tiles; tile++) {
+    tile2live[tile] = -1;
+    if (b->walkable[tile] && (sok_isdead(game, tile) == 0)) tile2live[tile] = live++;
+  }
+  memset(single, SOKPDB_DEADLOCK, live + PAIRINDEX(0, (long)live));
+  for (i = 0; i < b->slots; i++) {
+    if (b->keys[i] == 0) continue;
+    cost = b->dist[i];
+    if (cost >= SOKPDB_DEADLOCK) cost = SOKPDB_DEADLOCK - 1; /* still a lower bound */
+    l1 = tile2live[KEYA(b->keys[i])];
+    if (l1 < 0) continue;
+    if (KEYB(b->keys[i]) == NOTILE) {
+        if (cost < single[l1]) single[l1] = cost;
+      } else {
+        l2 = tile2live[KEYB(b->keys[i])];
+        if (l2 < 0) continue;
+        index = (l1 < l2) ? PAIRINDEX(l1, l2) : PAIRINDEX(l2, l1);
+        if (cost < pair[index]) pair[index] = cost;
+    }
+  }
+  freebuilder(b);
+  /* write it all */
+  if (savefile_path(path, sizeof(path), game->crc32, SOKPDB_EXT) != 0) {
+    free(file);
+    return(-1);
+  }
+  fd = fopen(path, "wb");
+  if (fd == NULL) {
+    free(file);
+    return(-1);
+  }
+  if (fwrite(file, 1, filesize, fd) != (size_t)filesize) filesize = -1;
+  if (fclose(fd) != 0) filesize = -1;
+  if (filesize < 0) remove(path);
+  free(file);
+  return(filesize);
+
+  outofbudget:
+  freebuilder(b);
+  return(0);
+}
+
+struct sokpdb *sok_pdb_load(struct sokgame *game) {
+  struct sokpdb *pdb;
+  struct pdbheader *hdr;
+  char path[4096];
+  int tile;
+  long size;
+  if (savefile_path(path, sizeof(path), game->crc32, SOKPDB_EXT) != 0) return(NULL);
+  pdb = calloc(1, sizeof(struct sokpdb));
+  if (pdb == NULL) return(NULL);
+#ifdef _WIN32
+  {
+    HANDLE fh, mh;
+    LARGE_INTEGER fsize;
+    fh = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE) {
+      free(pdb);
+      return(NULL);
+    }
+    if ((GetFileSizeEx(fh, &fsize) == 0) || (fsize.QuadPart < (LONGLONG)sizeof(struct pdbheader)) || (fsize.QuadPart > 0x7fffffff)) {
+      CloseHandle(fh);
+      free(pdb);
+      return(NULL);
+    }
+    size = (long)fsize.QuadPart;
+    mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(fh);
+    if (mh == NULL) {
+      free(pdb);
+      return(NULL);
+    }
+    pdb->map = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+    if (pdb->map == NULL) {
+      CloseHandle(mh);
+      free(pdb);
+      return(NULL);
+    }
+    pdb->handle = mh;
+  }
+#else
+  {
+    struct stat st;
+    int fd;
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      free(pdb);
+      return(NULL);
+    }
+    if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(struct pdbheader)) || (st.st_size > 0x7fffffff)) {
+      close(fd);
+      free(pdb);
+      return(NULL);
+    }
+    size = (long)st.st_size;
+    pdb->map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pdb->map == MAP_FAILED) {
+      free(pdb);
+      return(NULL);
+    }
+  }
+#endif
+  pdb->mapsize = size;
+  /* make sure the file is the one of this level, and in one piece */
+  hdr = pdb->map;
+  if ((hdr->magic != PDBMAGIC) || (hdr->version != PDBVERSION) || (hdr->crc32 != (uint32_t)game->crc32) || (hdr->filesize != size)
+    || (hdr->live > field_tiles) || (FILESIZE((long)hdr->live) != size)) {
+    sok_pdb_free(pdb);
+    return(NULL);
+  }
+  pdb->live = hdr->live;
+  pdb->tile2live = (const short *)((unsigned char *)pdb->map + sizeof(struct pdbheader));
+  pdb->single = (const unsigned char *)pdb->map + sizeof(struct pdbheader) + sizeof(short) * field_tiles;
+  pdb->pair = pdb->single + pdb->live;
+  for (tile = 0; tile < field_tiles; tile++) {
+    if (pdb->tile2live[tile] >= pdb->live) {
+      sok_pdb_free(pdb);
+      return(NULL);
+    }
+  }
+  return(pdb);
+}
+
+void sok_pdb_free(struct sokpdb *pdb) {
+  if (pdb == NULL) return;
+#ifdef _WIN32
+  UnmapViewOfFile(pdb->map);
+  CloseHandle(pdb->handle);
+#else
+  munmap(pdb->map, pdb->mapsize);
+#endif
+  free(pdb);
+}
+
+int sok_pdb_bound(struct sokpdb *pdb, int *atoms, int count) {
+  short live[field_tiles];
+  unsigned char paired[field_tiles];
+  int i, j, best, cost, gain, bestgain, res = 0;
+  for (i = 0; i < count; i++) {
+    live[i] = pdb->tile2live[atoms[i]];
+    if ((live[i] < 0) || (pdb->single[live[i]] == SOKPDB_DEADLOCK)) return(-1);
+    paired[i] = 0;
+  }
+  /* pair every atom with the one it makes the most difference with, if any. any grouping is a lower bound, since pushes on atoms of
+   * a group can always be replayed when there's nothing else on the level. */
+  for (i = 0; i < count; i++) {
+    best = -1;
+    bestgain = 0;
+    for (j = i + 1; j < count; j++) {
+      cost = (live[i] < live[j]) ? pdb->pair[PAIRINDEX(live[i], live[j])] : pdb->pair[PAIRINDEX(live[j], live[i])];
+      if (cost == SOKPDB_DEADLOCK) return(-1);
+      if ((paired[i] != 0) || (paired[j] != 0)) continue;
+      gain = cost - pdb->single[live[i]] - pdb->single[live[j]];
+      if (gain > bestgain) {
+        bestgain = gain;
+        best = j;
+      }
+    }
+    if (paired[i] != 0) continue;
+    res += pdb->single[live[i]];
+    if (best >= 0) {
+      res += pdb->single[live[best]] + bestgain;
+      paired[i] = 1;
+      paired[best] = 1;
+    }
+  }
+  return(res);
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef sok_pdb_h_sentinel
+#define sok_pdb_h_sentinel
+
+  #include "sok_core.h"
+
+  #define SOKPDB_EXT "pdb"              /* extension of pattern database files, next to the solution files */
+  #define SOKPDB_DEFAULTBUDGET (64l * 1024 * 1024)
+
+  /* a pattern database, mapped in memory: the exact number of pushes every single atom, and every pair of atoms, needs to reach goals
+   * when there's nothing else on the level. it is read-only once loaded, so all threads may share it. */
+  struct sokpdb {
+    int live;                 /* number of squares an atom may stand on without being dead */
+    const short *tile2live;   /* live square of every field tile, or -1 */
+    const unsigned char *single; /* single[l] = pushes needed by a lone atom on live square l (SOKPDB_DEADLOCK if it can't make it) */
+    const unsigned char *pair;   /* pair[j * (j - 1) / 2 + i] = pushes needed by two atoms on live squares i < j */
+    void *map;                /* the mapping, and what it takes to release it */
+    long mapsize;
+    void *handle;
+  };
+
+  #define SOKPDB_DEADLOCK 255   /* cost of atoms that can't be brought to goals */
+
+  /* builds the pattern database of a level, and writes it to the save directory. the database only depends on walls, goals and the
+   * player's area, not on where atoms are. budget is the max amount of bytes the file and the build may take. returns the size of
+   * the file on success, 0 if the level is out of scope (not as many atoms as goals, or too large for budget), -1 on error. */
+  long sok_pdb_build(struct sokgame *game, long budget);
+
+  /* maps the pattern database of a level, if one has been built. returns NULL otherwise. */
+  struct sokpdb *sok_pdb_load(struct sokgame *game);
+
+  void sok_pdb_free(struct sokpdb *pdb);
+
+  /* returns a lower bound of the pushes needed by the atoms standing on the count field tiles listed in atoms: atoms are grouped in
+   * pairs wherever that gives more than looking at them alone. returns -1 if some atom or pair of atoms can't be brought to goals. */
+  int sok_pdb_bound(struct sokpdb *pdb, int *atoms, int count);
+
+#endif
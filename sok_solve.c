@@ -0,0 +1,1790 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+/*
+ * The solver performs an A* search over pushes, guided by a consistent lower
+ * bound of the pushes left (see sok_lowerbound.c), hence the first solution
+ * it finds is push-optimal. With the bound turned off, it is a plain
+ * breadth-first search. A position is the sorted list of the squares
+ * occupied by atoms, plus the top-left-most square of the area the player
+ * can walk in. Walking moves are not part of the search: they are computed
+ * once a solution is found, when the pushes are turned back into a LURD
+ * string.
+ *
+ * Positions wait in buckets, one per estimated solution length (pushes so
+ * far + bound). The search goes one layer at a time: a layer is whatever
+ * the lowest non-empty bucket holds. Its positions are cut in chunks, and
+ * spread over a pool of threads: each thread owns a deque of chunks, and
+ * steals from the others once its own deque is empty. New positions are
+ * checked against a visited table split in stripes, each stripe having its
+ * own lock. They are kept aside until the layer is done, then sorted by
+ * (parent, pushed atom, direction) and given their ids - which is exactly
+ * the order a single thread would have found them in, so the outcome does
+ * not depend on the number of threads.
+ *
+ * With a consistent bound, a position may first be found through a longer
+ * path, but never after it has been expanded. When a shorter path turns
+ * up, the position is stored again and the old record is marked stale.
+ * The pattern database of the level (see sok_pdb.c), if one has been
+ * built, makes the bound stronger but no longer consistent: estimates are
+ * then carried along paths (a child is never estimated more than one push
+ * below its parent), and a position found through a shorter path after
+ * its expansion is simply expanded again.
+ *
+ * On request, pushes that leave no real choice are made in one go, as a
+ * macro push (solutions are then no longer sure to be push-optimal).
+ * When an atom is pushed into a tunnel, ie. both the player and the atom
+ * stand between walls, it is pushed on to the far end of it (or to the
+ * first goal on the way). Optionally, an atom pushed into a goal room (an
+ * area with goals that can only be entered through one square) goes right
+ * to the next goal of the room, following an order worked out once per
+ * level, that keeps the other goals within reach. The intermediate
+ * positions are never stored: a macro push is recorded as its first push,
+ * its length being the difference of depths between the position and its
+ * parent, and it is worked out again when the solution is built. Tunnel
+ * macros only make a solution longer in the odd level where an atom has
+ * to be parked inside a tunnel, and pushed back out of it later. Goal
+ * room macros may cost a few pushes more often.
+ *
+ * A breadth-first search may also be run from both ends at once: forward
+ * from the start, and backward from the goals, pulling atoms instead of
+ * pushing them. Each step expands one layer of the side whose next layer
+ * is smaller, and looks up the positions it produced in the visited table
+ * of the other side. The first layer that meets the other side gives a
+ * shortest solution: the forward chain of pushes up to the meeting point,
+ * followed by the pulls of the backward chain, turned into pushes.
+ *
+ * Searches that do not fit in memory can be run breadth-first over a
+ * visited store that spills to disk (see sok_visited.c), on one thread.
+ * Positions then have no id to link them to their parent: once a solution
+ * is found, the chain of pushes is traced back by expanding the positions
+ * of every previous layer again, until one of them leads to the position
+ * being traced. Between two layers, the whole visited store may be saved
+ * to a checkpoint file, named after the crc of the level, so that a later
+ * search from the same position resumes from the last layer saved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>             /* malloc(), free(), qsort() */
+#include <string.h>             /* memset(), memcpy() */
+#include <SDL2/SDL.h>           /* SDL_GetTicks(), threads and locks */
+#include "save.h"
+#include "sok_core.h"
+#include "sok_deadlock.h"
+#include "sok_lowerbound.h"
+#include "sok_pdb.h"
+#include "sok_solve.h"
+#include "sok_visited.h"
+
+#define DEFAULT_MAXMEMORY (256l * 1024 * 1024)
+#define NODESPERBLOCK 65536
+#define PROGRESS_INTERVAL 4096
+#define MAXTHREADS 64
+#define CHUNKSIZE 64            /* positions per unit of work */
+#define STRIPES 64              /* the visited table is made of that many independently locked parts */
+#define STRIPEBITS 6
+#define PENDING 0x80000000lu    /* flags table entries that refer to a position of the layer being expanded */
+#define BUCKETINITSIZE 1024     /* initial number of positions a bucket has room for */
+
+/* flags of stored positions */
+#define NODE_SOLVED 1           /* all goals are filled */
+#define NODE_STALE 2            /* the position has been stored again since, with a shorter path */
+
+/* checkpoints of searches on disk */
+#define CHECKPOINTMAGIC 0x504b4353lu    /* "SCKP" */
+#define CHECKPOINTVERSION 1
+#define CHECKPOINT_EXT "ckp"
+#define CHECKPOINT_TMPEXT "ckt"         /* checkpoint being written */
+
+/* reasons to abandon a layer */
+#define ABORT_OUTOFMEMORY 1
+#define ABORT_CANCELED 2
+
+/* directions, in the order used everywhere in the solver: up, right, down, left */
+static const int dirvectors[4] = {-field_stride, 1, field_stride, -1};
+static const char dirmoves[4] = {'u', 'r', 'd', 'l'};
+#define OPPOSITE(d) (((d) + 2) & 3)
+
+/* the static part of a level, as seen by the solver. squares are the non-wall tiles the player can ever walk on, numbered in
+ * row-major order (so the lowest square of an area is also its top-left-most one). */
+struct solverlevel {
+  int squares;
+  int boxes;
+  int goals;
+  short tile2sq[field_tiles];     /* square of every field tile, or -1 */
+  short sq2tile[field_tiles];     /* field tile of every square */
+  short next[field_tiles][4];     /* neighbor square in every direction, or -1 */
+  unsigned char goal[field_tiles];
+  unsigned char dead[field_tiles];  /* squares an atom should never be pushed to */
+  unsigned char unreached[field_tiles]; /* squares no atom can ever be pushed to from where atoms start, hence never pulled to */
+  uint64_t boxkey[field_tiles];   /* zobrist keys of atoms on squares */
+  uint64_t playerkey[field_tiles];
+  /* goal rooms: areas holding goals that can only be entered through one square, only looked for with goal room macros */
+  int rooms;
+  short room[field_tiles];        /* 1 + goal room of every square, or 0 */
+  short roomentrance[field_tiles];  /* the square every goal room is entered through */
+  short roomfirst[field_tiles];   /* index in roomfill of the first goal of every goal room */
+  short roomgoals[field_tiles];   /* number of goals of every goal room, 0 if no fill order has been found for it */
+  short roomfill[field_tiles];    /* goals of all goal rooms, room after room, in the order they are to be filled */
+};
+
+/* header of a stored position. it is directly followed by the sorted list of the atoms squares, so player + atoms form one
+ * array of 1 + boxes uint16_t values, which is what is compared and hashed. */
+struct nodehdr {
+  uint32_t parent;        /* id of the position this one has been reached from */
+  uint16_t pushfrom;      /* square of the atom that has been pushed to get here */
+  uint8_t pushdir;        /* direction of the push */
+  uint8_t flags;          /* NODE_xxx flags */
+  uint16_t depth;         /* number of pushes since the start */
+  uint16_t estimate;      /* lower bound of the pushes still needed to solve the position */
+  uint16_t player;        /* normalized player square */
+};
+
+/* header of a checkpoint file. it is followed by the starting position of the search (player + atoms), then by the visited store. */
+struct checkpointheader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t crc32;         /* crc of the level */
+  uint32_t squares;
+  uint32_t boxes;
+  uint32_t depth;         /* layer to expand next, all layers up to that one are in the visited store */
+  uint32_t reserved[2];
+};
+
+/* one part of the visited table: an open addressing hash table of position ids (0 = empty slot) */
+struct stripe {
+  uint32_t *table;
+  uint32_t *check;        /* upper 32 bits of the hash of every position in table */
+  long count;
+  SDL_SpinLock lock;
+};
+
+/* ids of the positions whose depth + estimate have the same value, in the order they have been stored */
+struct bucket {
+  uint32_t *ids;
+  long count;
+  long alloc;
+  long next;              /* positions before that one have been expanded already */
+  uint32_t solvedid;      /* first solved position in the bucket, if any */
+};
+
+/* sort key of a position found during the current layer */
+struct pendingkey {
+  uint32_t parent;
+  uint32_t index;
+  uint16_t pushfrom;
+  uint8_t pushdir;
+};
+
+/* scratch buffers of the searches for the way of an atom to a goal, inside a goal room */
+struct roomsearch {
+  uint32_t seenstamp;
+  uint32_t *seen;         /* seen[atom square * 4 + side the player stands on] == seenstamp once that state has been reached */
+  int *prev;              /* state every state has been reached from, -1 for the first ones */
+  int *queue;
+  uint32_t reachstamp;
+  uint32_t *reach;        /* reach[sq] == reachstamp if the player can walk to sq */
+  short *walkqueue;
+};
+
+struct solver;
+
+struct worker {
+  struct solver *s;
+  SDL_Thread *thread;
+  int index;
+  /* work-stealing deque: chunks of the current layer still to expand. the owner takes them from the front, thieves from the back. */
+  SDL_SpinLock dequelock;
+  long dequefront;
+  long dequeback;
+  /* scratch buffers, used during expansion */
+  uint32_t stamp;
+  uint32_t *reach;        /* reach[sq] == stamp if the player can walk to sq */
+  uint32_t seenstamp;
+  uint32_t *seen;         /* used to normalize the player position of children, every child gets a new seenstamp */
+  short *boxat;           /* boxat[sq] != 0 if there is an atom on sq */
+  short *queue;
+  uint16_t *childstate;
+  struct sokgame *board;  /* copy of the level, with the atoms of the position being expanded, for deadlock checks */
+  int *atomtiles;         /* field tiles of the atoms of the position being expanded */
+  struct sokmatching *match;      /* matching of the position being expanded */
+  struct sokmatching *childmatch; /* matching of a child, updated from the one of its parent */
+  uint16_t *macrofrom;    /* single pushes of the last macro push: squares of the atom before every push */
+  unsigned char *macrodir;        /* and directions */
+  struct roomsearch rs;
+};
+
+struct solver {
+  struct solverlevel *lvl;
+  struct soklowerbound *bound;    /* NULL for a breadth-first search */
+  struct sokpdb *pdb;             /* pattern database of the level, if there is one */
+  int pull;               /* non-zero for a backward search, that pulls atoms away from the goals */
+  struct soksolveparams params;
+  struct soksolvestats *stats;
+  int statelen;           /* size of a position (player + atoms), in bytes */
+  int recsize;            /* size of a stored position, header included */
+  unsigned char **blocks; /* stored positions, in blocks of NODESPERBLOCK records */
+  long blockscount;
+  uint32_t nodecount;     /* ids of stored positions go from 1 to nodecount */
+  uint32_t capacity;      /* max amount of positions that fit in the memory budget */
+  struct stripe stripes[STRIPES];
+  uint32_t stripemask;
+  long stripemax;         /* max amount of entries in a stripe */
+  /* positions found during the current layer, waiting for their ids */
+  void **pending;
+  SDL_atomic_t pendingcount;
+  SDL_mutex *pendinglock;
+  /* positions waiting to be expanded, by depth + estimate */
+  struct bucket *buckets;
+  long bucketscount;
+  long f;                 /* bucket being expanded */
+  uint32_t solvedid;      /* solved position found, if any */
+  /* the layer being expanded */
+  uint32_t *layer;
+  long layercount;
+  SDL_atomic_t expanded;
+  SDL_atomic_t abort;
+  long lastpoll;
+  /* thread pool */
+  struct worker *workers;
+  int threads;
+  SDL_mutex *poollock;
+  SDL_cond *poolstart;
+  SDL_cond *pooldone;
+  int generation;
+  int busy;
+  int quit;
+  unsigned long startticks;
+  /* breadth-first search over a visited store on disk */
+  struct sokvisited *visited;
+  uint16_t *solvedstate;  /* first solved position found, if any */
+  int solved;
+  uint16_t *tracestate;   /* position whose parent is being looked for, when tracing a solution back */
+  int tracefrom;          /* push that leads to it, once found */
+  int tracedir;
+};
+
+static uint64_t splitmix(uint64_t key) {
+  key += 0x9E3779B97F4A7C15ull;
+  key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+  key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+  return(key ^ (key >> 31));
+}
+
+void sok_solve_defaults(struct soksolveparams *params) {
+  memset(params, 0, sizeof(struct soksolveparams));
+  params->maxmemory = DEFAULT_MAXMEMORY;
+}
+
+char *sok_solve_strresult(enum SOKSOLVE result) {
+  switch (result) {
+    case soksolveSOLVED: return("solved");
+    case soksolveUNSOLVABLE: return("no solution exists");
+    case soksolveNODELIMIT: return("node limit reached");
+    case soksolveOUTOFMEMORY: return("memory budget exhausted");
+    case soksolveCANCELED: return("canceled");
+    case soksolveERROR: return("error");
+  }
+  return("unknown");
+}
+
+/* computes the static data of a level. returns soksolveSOLVED if the level looks solvable, or another code otherwise. */
+static enum SOKSOLVE setuplevel(struct solverlevel *lvl, struct sokgame *game) {
+  short queue[field_tiles];
+  unsigned char walkable[field_tiles];
+  int queuehead = 0, queuetail = 0, tile, sq, i, d;
+  memset(walkable, 0, sizeof(walkable));
+  /* find out the tiles the player can ever walk on: all non-wall tiles connected to the player */
+  tile = sok_fieldidx(game->positionx, game->positiony);
+  if (game->field[tile] & field_wall) return(soksolveERROR);
+  queue[queuetail++] = tile;
+  walkable[tile] = 1;
+  while (queuehead < queuetail) {
+    tile = queue[queuehead++];
+    for (d = 0; d < 4; d++) {
+      if (walkable[tile + dirvectors[d]] != 0) continue;
+      if (game->field[tile + dirvectors[d]] & field_wall) continue;
+      walkable[tile + dirvectors[d]] = 1;
+      queue[queuetail++] = tile + dirvectors[d];
+    }
+  }
+  /* number them in row-major order */
+  lvl->squares = 0;
+  lvl->boxes = 0;
+  lvl->goals = 0;
+  lvl->rooms = 0;
+  memset(lvl->room, 0, sizeof(lvl->room));
+  for (tile = 0; tile < field_tiles; tile++) {
+    lvl->tile2sq[tile] = -1;
+    if (walkable[tile] == 0) {
+      /* a goal out of reach that isn't already filled can never be solved */
+      if ((game->field[tile] & (field_goal | field_atom)) == field_goal) return(soksolveUNSOLVABLE);
+      continue;
+    }
+    lvl->tile2sq[tile] = lvl->squares;
+    lvl->sq2tile[lvl->squares] = tile;
+    lvl->goal[lvl->squares] = 0;
+    lvl->dead[lvl->squares] = sok_isdead(game, tile);
+    if (game->field[tile] & field_goal) {
+      lvl->goal[lvl->squares] = 1;
+      lvl->goals += 1;
+    }
+    if (game->field[tile] & field_atom) lvl->boxes += 1;
+    lvl->boxkey[lvl->squares] = splitmix(lvl->squares);
+    lvl->playerkey[lvl->squares] = splitmix(lvl->squares + field_tiles);
+    lvl->squares += 1;
+  }
+  /* spare atoms may be left anywhere, dead squares included */
+  if (lvl->boxes != lvl->goals) memset(lvl->dead, 0, sizeof(lvl->dead));
+  for (i = 0; i < lvl->squares; i++) {
+    for (d = 0; d < 4; d++) lvl->next[i][d] = lvl->tile2sq[lvl->sq2tile[i] + dirvectors[d]];
+  }
+  /* push a lone atom around from every starting square, whatever is not reached is of no use to a backward search */
+  queuehead = 0;
+  queuetail = 0;
+  for (i = 0; i < lvl->squares; i++) {
+    lvl->unreached[i] = 1;
+    if ((game->field[lvl->sq2tile[i]] & field_atom) == 0) continue;
+    lvl->unreached[i] = 0;
+    queue[queuetail++] = i;
+  }
+  while (queuehead < queuetail) {
+    i = queue[queuehead++];
+    for (d = 0; d < 4; d++) {
+      sq = lvl->next[i][d];
+      if ((sq < 0) || (lvl->next[i][OPPOSITE(d)] < 0) || (lvl->unreached[sq] == 0)) continue;
+      lvl->unreached[sq] = 0;
+      queue[queuetail++] = sq;
+    }
+  }
+  if (lvl->boxes < lvl->goals) return(soksolveUNSOLVABLE);
+  return(soksolveSOLVED);
+}
+
+/* returns a pointer to the stored position id */
+static struct nodehdr *getnode(struct solver *s, uint32_t id) {
+  return((struct nodehdr *)(s->blocks[id / NODESPERBLOCK] + (id % NODESPERBLOCK) * s->recsize));
+}
+
+/* returns a pointer to a position found during the current layer */
+static struct nodehdr *getpending(struct solver *s, uint32_t index) {
+  return((struct nodehdr *)((unsigned char *)SDL_AtomicGetPtr(&(s->pending[index / NODESPERBLOCK])) + (index % NODESPERBLOCK) * s->recsize));
+}
+
+/* returns the position a visited table entry refers to */
+static struct nodehdr *getentry(struct solver *s, uint32_t entry) {
+  if (entry & PENDING) return(getpending(s, entry & ~PENDING));
+  return(getnode(s, entry));
+}
+
+/* returns the position array (player + atoms) of a stored position */
+#define NODESTATE(node) (&((node)->player))
+
+/* computes the hash of a position (player + sorted atoms) */
+static uint64_t hashstate(struct solver *s, uint16_t *state) {
+  int i;
+  uint64_t res;
+  res = s->lvl->playerkey[state[0]];
+  for (i = 1; i <= s->lvl->boxes; i++) res ^= s->lvl->boxkey[state[i]];
+  return(res);
+}
+
+/* returns non-zero if the push (parent, pushfrom, pushdir) comes before the one that led to node, in the order of a sequential search */
+static int pushcomesfirst(struct nodehdr *node, uint32_t parent, int pushfrom, int pushdir) {
+  if (parent != node->parent) return(parent < node->parent);
+  if (pushfrom != node->pushfrom) return(pushfrom < node->pushfrom);
+  return(pushdir < node->pushdir);
+}
+
+/* records a position found during the current layer, unless it has been seen already through a path at least as short. if it has been
+ * found during this layer already, only the shortest path is kept, and among those the push that comes first. returns 0 on success,
+ * non-zero if the memory budget is exhausted. */
+static int addpending(struct solver *s, uint16_t *state, uint64_t hash, uint32_t parent, int pushfrom, int pushdir, int depth, int estimate, int solved) {
+  struct stripe *stripe = &(s->stripes[hash >> (64 - STRIPEBITS)]);
+  struct nodehdr *node, *stale = NULL;
+  uint32_t i, check = (uint32_t)(hash >> 32), index;
+  int res = 0;
+  SDL_AtomicLock(&(stripe->lock));
+  for (i = (uint32_t)hash & s->stripemask; stripe->table[i] != 0; i = (i + 1) & s->stripemask) {
+    if (stripe->check[i] != check) continue;
+    node = getentry(s, stripe->table[i]);
+    if (memcmp(NODESTATE(node), state, s->statelen) != 0) continue;
+    if (stripe->table[i] & PENDING) {
+      if ((depth < node->depth) || ((depth == node->depth) && (pushcomesfirst(node, parent, pushfrom, pushdir)))) {
+        node->parent = parent;
+        node->pushfrom = pushfrom;
+        node->pushdir = pushdir;
+        node->depth = depth;
+      }
+      if (estimate > node->estimate) node->estimate = estimate; /* all estimates are lower bounds, keep the best one */
+      SDL_AtomicUnlock(&(stripe->lock));
+      return(0);
+    }
+    if (depth >= node->depth) {
+      SDL_AtomicUnlock(&(stripe->lock));
+      return(0);
+    }
+    /* a shorter path to a stored position: store it again, in the same slot */
+    stale = node;
+    break;
+  }
+  /* new position */
+  index = SDL_AtomicAdd(&(s->pendingcount), 1);
+  if ((stripe->count >= s->stripemax) || (s->nodecount + index + 1 >= s->capacity)) {
+    res = -1;
+    goto done;
+  }
+  if (SDL_AtomicGetPtr(&(s->pending[index / NODESPERBLOCK])) == NULL) {
+    SDL_LockMutex(s->pendinglock);
+    if (SDL_AtomicGetPtr(&(s->pending[index / NODESPERBLOCK])) == NULL) {
+      void *block = malloc((long)NODESPERBLOCK * s->recsize);
+      if (block != NULL) s->stats->memory += (long)NODESPERBLOCK * s->recsize;
+      SDL_AtomicSetPtr(&(s->pending[index / NODESPERBLOCK]), block);
+    }
+    SDL_UnlockMutex(s->pendinglock);
+    if (SDL_AtomicGetPtr(&(s->pending[index / NODESPERBLOCK])) == NULL) {
+      res = -1;
+      goto done;
+    }
+  }
+  node = getpending(s, index);
+  node->parent = parent;
+  node->pushfrom = pushfrom;
+  node->pushdir = pushdir;
+  node->flags = (solved != 0) ? NODE_SOLVED : 0;
+  node->depth = depth;
+  node->estimate = estimate;
+  memcpy(NODESTATE(node), state, s->statelen);
+  stripe->table[i] = PENDING | index;
+  stripe->check[i] = check;
+  if (stale != NULL) {
+      stale->flags |= NODE_STALE;
+    } else {
+      stripe->count += 1;
+  }
+
+  done:
+  SDL_AtomicUnlock(&(stripe->lock));
+  return(res);
+}
+
+static int comparependingkeys(const void *a, const void *b) {
+  const struct pendingkey *ka = a, *kb = b;
+  if (ka->parent != kb->parent) return((ka->parent < kb->parent) ? -1 : 1);
+  if (ka->pushfrom != kb->pushfrom) return((ka->pushfrom < kb->pushfrom) ? -1 : 1);
+  return((int)ka->pushdir - (int)kb->pushdir);
+}
+
+/* appends position id to the bucket of its depth + estimate. returns 0 on success, non-zero if out of memory. */
+static int addtobucket(struct solver *s, uint32_t id) {
+  struct nodehdr *node = getnode(s, id);
+  struct bucket *b;
+  long f = node->depth + node->estimate;
+  if (f >= s->bucketscount) {
+    struct bucket *newbuckets;
+    long newcount = (f + 64) & ~63l;
+    newbuckets = realloc(s->buckets, sizeof(struct bucket) * newcount);
+    if (newbuckets == NULL) return(-1);
+    memset(newbuckets + s->bucketscount, 0, sizeof(struct bucket) * (newcount - s->bucketscount));
+    s->buckets = newbuckets;
+    s->bucketscount = newcount;
+  }
+  b = &(s->buckets[f]);
+  if (b->count == b->alloc) {
+    uint32_t *newids;
+    long newalloc = (b->alloc == 0) ? BUCKETINITSIZE : b->alloc * 2;
+    newids = realloc(b->ids, sizeof(uint32_t) * newalloc);
+    if (newids == NULL) return(-1);
+    s->stats->memory += sizeof(uint32_t) * (newalloc - b->alloc);
+    b->ids = newids;
+    b->alloc = newalloc;
+  }
+  b->ids[b->count++] = id;
+  if ((node->flags & NODE_SOLVED) && (b->solvedid == 0)) b->solvedid = id;
+  return(0);
+}
+
+/* gives their ids to all the positions found during the layer, in the order a sequential search would have found them, and puts them
+ * in their buckets. returns 0 on success, non-zero if the memory budget is exhausted. */
+static int finishlayer(struct solver *s) {
+  struct pendingkey *keys;
+  struct nodehdr *node;
+  struct stripe *stripe;
+  long count, k;
+  uint32_t i, id;
+  uint64_t hash;
+  count = SDL_AtomicGet(&(s->pendingcount));
+  if (count == 0) return(0);
+  keys = malloc(sizeof(struct pendingkey) * count);
+  if (keys == NULL) return(-1);
+  for (k = 0; k < count; k++) {
+    node = getpending(s, k);
+    keys[k].parent = node->parent;
+    keys[k].pushfrom = node->pushfrom;
+    keys[k].pushdir = node->pushdir;
+    keys[k].index = k;
+  }
+  qsort(keys, count, sizeof(struct pendingkey), comparependingkeys);
+  for (k = 0; k < count; k++) {
+    id = s->nodecount + 1;
+    if (id / NODESPERBLOCK >= s->blockscount) {
+      s->blocks[s->blockscount] = malloc((long)NODESPERBLOCK * s->recsize);
+      if (s->blocks[s->blockscount] == NULL) {
+        free(keys);
+        return(-1);
+      }
+      s->blockscount += 1;
+      s->stats->memory += (long)NODESPERBLOCK * s->recsize;
+    }
+    s->nodecount = id;
+    node = getnode(s, id);
+    memcpy(node, getpending(s, keys[k].index), s->recsize);
+    if (addtobucket(s, id) != 0) {
+      free(keys);
+      return(-1);
+    }
+    /* point the visited table to the final id */
+    hash = hashstate(s, NODESTATE(node));
+    stripe = &(s->stripes[hash >> (64 - STRIPEBITS)]);
+    for (i = (uint32_t)hash & s->stripemask; stripe->table[i] != (PENDING | keys[k].index); i = (i + 1) & s->stripemask);
+    stripe->table[i] = id;
+  }
+  free(keys);
+  SDL_AtomicSet(&(s->pendingcount), 0);
+  s->stats->positions += count;
+  return(0);
+}
+
+/* marks in reach (with stamp) all the squares the player can walk to from square start, and returns the lowest of them */
+static int walk(struct worker *w, uint32_t *reach, uint32_t stamp, int start) {
+  int queuehead = 0, queuetail = 0, sq, nextsq, d, best = start;
+  w->queue[queuetail++] = start;
+  reach[start] = stamp;
+  while (queuehead < queuetail) {
+    sq = w->queue[queuehead++];
+    if (sq < best) best = sq;
+    for (d = 0; d < 4; d++) {
+      nextsq = w->s->lvl->next[sq][d];
+      if ((nextsq < 0) || (reach[nextsq] == stamp) || (w->boxat[nextsq] != 0)) continue;
+      reach[nextsq] = stamp;
+      w->queue[queuetail++] = nextsq;
+    }
+  }
+  return(best);
+}
+
+/* hands a child found by expand() over to the visited store on disk, or checks whether it is the position being traced back. returns
+ * 0 to go on, 1 if it is the position being traced, -1 on I/O error. */
+static int diskchild(struct solver *s, uint16_t *child, int from, int d, int solved) {
+  if (s->tracestate != NULL) {
+    if (memcmp(child, s->tracestate, s->statelen) != 0) return(0);
+    s->tracefrom = from;
+    s->tracedir = d;
+    return(1);
+  }
+  if ((solved != 0) && (s->solved == 0)) {
+    memcpy(s->solvedstate, child, s->statelen);
+    s->solved = 1;
+  }
+  return(sok_visited_add(s->visited, child));
+}
+
+/* returns non-zero if square sq has walls on both sides, across direction d */
+static int corridor(struct solverlevel *lvl, int sq, int d) {
+  return((lvl->next[sq][(d + 1) & 3] < 0) && (lvl->next[sq][(d + 3) & 3] < 0));
+}
+
+/* returns non-zero if square sq is part of goal room r or is its entrance, or (if out is non-zero) lies just outside of its entrance */
+static int roomsquare(struct solverlevel *lvl, int r, int sq, int out) {
+  int d;
+  if ((lvl->room[sq] == r + 1) || (sq == lvl->roomentrance[r])) return(1);
+  for (d = 0; (out != 0) && (d < 4); d++) {
+    if (lvl->next[sq][d] == lvl->roomentrance[r]) return(1);
+  }
+  return(0);
+}
+
+/* marks in rs->reach all the squares of goal room r (as roomsquare() sees them) the player can walk to from square start, without
+ * walking over the atom on square atom or the ones set in boxat */
+static void roomwalk(struct solverlevel *lvl, struct roomsearch *rs, short *boxat, int r, int out, int atom, int start) {
+  int queuehead = 0, queuetail = 0, sq, nextsq, d;
+  rs->reachstamp += 1;
+  rs->reach[start] = rs->reachstamp;
+  rs->walkqueue[queuetail++] = start;
+  while (queuehead < queuetail) {
+    sq = rs->walkqueue[queuehead++];
+    for (d = 0; d < 4; d++) {
+      nextsq = lvl->next[sq][d];
+      if ((nextsq < 0) || (nextsq == atom) || (boxat[nextsq] != 0) || (rs->reach[nextsq] == rs->reachstamp)) continue;
+      if (roomsquare(lvl, r, nextsq, out) == 0) continue;
+      rs->reach[nextsq] = rs->reachstamp;
+      rs->walkqueue[queuetail++] = nextsq;
+    }
+  }
+}
+
+/* looks for the shortest way to push the atom on square atom to square target without leaving goal room r, the player standing on
+ * square player and the other atoms on the squares set in boxat. the player must be able to walk out of the room once done. if pull
+ * is non-zero, the atom is pulled instead, out to the entrance of the room (target). fills pushfrom and pushdir (unless NULL) with
+ * the squares of the atom before every push and their directions, and returns the number of pushes, or -1 if there is no way. */
+static int roompath(struct solverlevel *lvl, struct roomsearch *rs, short *boxat, int r, int pull, int atom, int player, int target, uint16_t *pushfrom, unsigned char *pushdir) {
+  int queuehead = 0, queuetail = 0, state = -1, nextstate, sq, to, behind, d, pushes;
+  rs->seenstamp += 1;
+  roomwalk(lvl, rs, boxat, r, pull, atom, player);
+  for (d = 0; d < 4; d++) {
+    sq = lvl->next[atom][d];
+    if ((sq < 0) || (rs->reach[sq] != rs->reachstamp)) continue;
+    rs->seen[atom * 4 + d] = rs->seenstamp;
+    rs->prev[atom * 4 + d] = -1;
+    rs->queue[queuetail++] = atom * 4 + d;
+  }
+  for (;;) {
+    if (queuehead == queuetail) return(-1);
+    state = rs->queue[queuehead++];
+    atom = state >> 2;
+    roomwalk(lvl, rs, boxat, r, pull, atom, lvl->next[atom][state & 3]);
+    if ((atom == target) && ((pull != 0) || (rs->reach[lvl->roomentrance[r]] == rs->reachstamp))) break;
+    for (d = 0; d < 4; d++) {
+      if (pull != 0) {
+          /* the player stands next to the atom, and steps further away, pulling it along */
+          to = lvl->next[atom][d];
+          if ((to < 0) || (rs->reach[to] != rs->reachstamp)) continue;
+          behind = lvl->next[to][d];
+          if ((behind < 0) || (boxat[behind] != 0) || (roomsquare(lvl, r, behind, 1) == 0)) continue;
+          nextstate = to * 4 + d;
+        } else {
+          behind = lvl->next[atom][OPPOSITE(d)];
+          to = lvl->next[atom][d];
+          if ((behind < 0) || (rs->reach[behind] != rs->reachstamp) || (to < 0) || (lvl->room[to] != r + 1)) continue;
+          if ((boxat[to] != 0) || (lvl->dead[to] != 0)) continue;
+          nextstate = to * 4 + OPPOSITE(d);
+      }
+      if (rs->seen[nextstate] == rs->seenstamp) continue;
+      rs->seen[nextstate] = rs->seenstamp;
+      rs->prev[nextstate] = state;
+      rs->queue[queuetail++] = nextstate;
+    }
+  }
+  /* follow the chain back: every step moved the atom from the square of the previous state */
+  pushes = 0;
+  for (sq = state; rs->prev[sq] >= 0; sq = rs->prev[sq]) pushes += 1;
+  if (pushfrom == NULL) return(pushes);
+  for (d = pushes - 1; d >= 0; d--) {
+    pushfrom[d] = rs->prev[state] >> 2;
+    pushdir[d] = (pull != 0) ? (state & 3) : OPPOSITE(state & 3);
+    state = rs->prev[state];
+  }
+  return(pushes);
+}
+
+/* finds the goal rooms of the level: areas that hold goals, and to start with neither the player nor atoms out of goals, and that
+ * can only be entered through one square. of nested rooms, only the largest one is kept. the goals of every room are then sorted in the order
+ * they are to be filled: atoms are pulled out of the full room one after the other, the last one out being the first one in. returns
+ * 0 on success, non-zero if out of memory. */
+static int findrooms(struct solver *s, struct sokgame *game) {
+  struct solverlevel *lvl = s->lvl;
+  struct worker *w = &(s->workers[0]);
+  int *label, *owner, *roomsize, *roomof;
+  short *entrance, *queue;
+  int labels = 0, candidates = 0, first, queuehead, queuetail, e, seed, sq, nextsq, d, goals, starts, r, j, k, g;
+  label = calloc(lvl->squares, sizeof(int));
+  owner = calloc(lvl->squares, sizeof(int));
+  roomsize = malloc(sizeof(int) * lvl->squares * 4);
+  roomof = calloc(lvl->squares * 4, sizeof(int));
+  entrance = malloc(sizeof(short) * lvl->squares * 4);
+  queue = malloc(sizeof(short) * lvl->squares);
+  if ((label == NULL) || (owner == NULL) || (roomsize == NULL) || (roomof == NULL) || (entrance == NULL) || (queue == NULL)) {
+    r = -1;
+    goto done;
+  }
+  /* take every square away in turn, and look at the areas it cuts off */
+  for (e = 0; e < lvl->squares; e++) {
+    first = labels + 1;
+    for (seed = 0; seed < lvl->squares; seed++) {
+      if ((seed == e) || (label[seed] >= first)) continue;
+      labels += 1;
+      goals = 0;
+      starts = 0;
+      queuehead = 0;
+      queuetail = 0;
+      queue[queuetail++] = seed;
+      label[seed] = labels;
+      while (queuehead < queuetail) {
+        sq = queue[queuehead++];
+        goals += lvl->goal[sq];
+        if ((game->field[lvl->sq2tile[sq]] & (field_atom | field_goal)) == field_atom) starts += 1;
+        if (lvl->sq2tile[sq] == sok_fieldidx(game->positionx, game->positiony)) starts += 1;
+        for (d = 0; d < 4; d++) {
+          nextsq = lvl->next[sq][d];
+          if ((nextsq < 0) || (nextsq == e) || (label[nextsq] >= first)) continue;
+          label[nextsq] = labels;
+          queue[queuetail++] = nextsq;
+        }
+      }
+      if ((goals == 0) || (starts != 0)) continue;
+      /* rooms are either nested or apart: the largest one takes all the squares of the ones it holds */
+      roomsize[candidates] = queuetail;
+      entrance[candidates] = e;
+      candidates += 1;
+      for (j = 0; j < queuetail; j++) {
+        if ((owner[queue[j]] == 0) || (roomsize[owner[queue[j]] - 1] < queuetail)) owner[queue[j]] = candidates;
+      }
+    }
+  }
+  for (sq = 0; sq < lvl->squares; sq++) {
+    if (owner[sq] == 0) continue;
+    if (roomof[owner[sq] - 1] == 0) {
+      lvl->roomentrance[lvl->rooms] = entrance[owner[sq] - 1];
+      lvl->rooms += 1;
+      roomof[owner[sq] - 1] = lvl->rooms;
+    }
+    lvl->room[sq] = roomof[owner[sq] - 1];
+  }
+  /* fill orders */
+  first = 0;
+  for (r = 0; r < lvl->rooms; r++) {
+    lvl->roomfirst[r] = first;
+    lvl->roomgoals[r] = 0;
+    for (sq = 0; sq < lvl->squares; sq++) {
+      if ((lvl->room[sq] != r + 1) || (lvl->goal[sq] == 0)) continue;
+      lvl->roomfill[first + lvl->roomgoals[r]] = sq;
+      lvl->roomgoals[r] += 1;
+      w->boxat[sq] = 1;
+    }
+    for (k = lvl->roomgoals[r]; k > 0; k--) {
+      for (j = 0; j < k; j++) {
+        g = lvl->roomfill[first + j];
+        w->boxat[g] = 0;
+        if (roompath(lvl, &(w->rs), w->boxat, r, 1, g, lvl->roomentrance[r], lvl->roomentrance[r], NULL, NULL) >= 0) break;
+        w->boxat[g] = 1;
+      }
+      if (j == k) break;
+      lvl->roomfill[first + j] = lvl->roomfill[first + k - 1];
+      lvl->roomfill[first + k - 1] = g;
+    }
+    for (j = 0; j < lvl->roomgoals[r]; j++) w->boxat[lvl->roomfill[first + j]] = 0;
+    first += lvl->roomgoals[r];
+    if (k > 0) lvl->roomgoals[r] = 0; /* the room can't be emptied, leave it alone */
+  }
+  r = 0;
+
+  done:
+  if (label != NULL) free(label);
+  if (owner != NULL) free(owner);
+  if (roomsize != NULL) free(roomsize);
+  if (roomof != NULL) free(roomof);
+  if (entrance != NULL) free(entrance);
+  if (queue != NULL) free(queue);
+  return(r);
+}
+
+/* works out the macro push that the push of the atom on square from in direction d stands for, from position state (whose atoms are
+ * set in w->boxat): an atom pushed along a tunnel goes on to its far end, and with goal room macros, an atom pushed into a goal room
+ * goes right to the goal it is to fill. fills w->macrofrom and w->macrodir with the single pushes, and returns their number. */
+static int macropush(struct worker *w, uint16_t *state, int from, int d) {
+  struct solverlevel *lvl = w->s->lvl;
+  int to = lvl->next[from][d], r = lvl->room[to] - 1, pushes = 1, ahead, inside, filled, i;
+  w->macrofrom[0] = from;
+  w->macrodir[0] = d;
+  if ((w->s->params.macros >= 2) && (r >= 0) && (lvl->roomentrance[r] == from) && (lvl->roomgoals[r] > 0)) {
+    /* the room must hold nothing but atoms on the first goals of its fill order */
+    inside = 0;
+    for (i = 1; i <= lvl->boxes; i++) inside += (lvl->room[state[i]] == r + 1);
+    for (filled = 0; (filled < lvl->roomgoals[r]) && (w->boxat[lvl->roomfill[lvl->roomfirst[r] + filled]] != 0); filled++);
+    if ((filled == inside) && (filled < lvl->roomgoals[r])) {
+      w->boxat[from] = 0;
+      i = roompath(lvl, &(w->rs), w->boxat, r, 0, to, from, lvl->roomfill[lvl->roomfirst[r] + filled], w->macrofrom + 1, w->macrodir + 1);
+      w->boxat[from] = 1;
+      if (i >= 0) return(i + 1);
+    }
+  }
+  /* a tunnel: the player stands between walls, and so does the atom. the player could only walk back, and the atom is going
+   * nowhere else than along the tunnel anyway. it stops on goals, and on the last square before the tunnel opens up. */
+  if (corridor(lvl, from, d) == 0) return(1);
+  while ((corridor(lvl, to, d) != 0) && (lvl->goal[to] == 0)) {
+    ahead = lvl->next[to][d];
+    if ((ahead < 0) || (w->boxat[ahead] != 0) || (lvl->dead[ahead] != 0) || (corridor(lvl, ahead, d) == 0)) break;
+    w->macrofrom[pushes] = to;
+    w->macrodir[pushes] = d;
+    pushes += 1;
+    to = ahead;
+  }
+  return(pushes);
+}
+
+/* generates all the positions that can be reached from position id (node) with one push (or one pull for a backward search). returns
+ * 0 on success, non-zero if the memory budget has been exhausted (or with a visited store on disk, whatever diskchild() returned). */
+static int expand(struct worker *w, uint32_t id, struct nodehdr *node) {
+  struct solver *s = w->s;
+  uint16_t *state = NODESTATE(node), *child = w->childstate;
+  struct solverlevel *lvl = s->lvl;
+  int i, j, d, from, to, behind, player, pushes, ongoal = 0, estimate = 0, solved, res = 0;
+  uint64_t boxhash = 0, hash;
+  for (i = 1; i <= lvl->boxes; i++) {
+    w->boxat[state[i]] = 1;
+    w->board->field[lvl->sq2tile[state[i]]] |= field_atom;
+    w->atomtiles[i - 1] = lvl->sq2tile[state[i]];
+    boxhash ^= lvl->boxkey[state[i]];
+    ongoal += lvl->goal[state[i]];
+  }
+  /* every child differs by one atom: they all start from the matching of this position */
+  if (s->bound != NULL) sok_lowerbound_compute(s->bound, w->match, w->atomtiles);
+  w->stamp += 1;
+  walk(w, w->reach, w->stamp, state[0]);
+  for (i = 1; (i <= lvl->boxes) && (res == 0); i++) {
+    from = state[i];
+    for (d = 0; d < 4; d++) {
+      to = lvl->next[from][d];
+      if (s->pull != 0) {
+          /* the player stands on to, and steps further in direction d, pulling the atom along. positions found that way can all
+           * be pushed back to the goals, so there is no deadlock to look for. */
+          if ((to < 0) || (w->reach[to] != w->stamp)) continue;
+          behind = lvl->next[to][d];
+          if ((behind < 0) || (w->boxat[behind] != 0) || (lvl->unreached[to] != 0)) continue;
+        } else {
+          behind = lvl->next[from][OPPOSITE(d)];
+          if ((to < 0) || (behind < 0) || (w->boxat[to] != 0) || (w->reach[behind] != w->stamp)) continue;
+          if (lvl->dead[to] != 0) continue;
+      }
+      /* an atom pushed into a tunnel or a goal room may go on, in a single macro push */
+      player = from;
+      pushes = 1;
+      if (s->params.macros != 0) {
+        pushes = macropush(w, state, from, d);
+        player = w->macrofrom[pushes - 1];
+        to = lvl->next[player][w->macrodir[pushes - 1]];
+      }
+      /* skip pushes that freeze atoms or close a corral (a push that solves the level is never a deadlock) */
+      if ((s->pull == 0) && (ongoal - lvl->goal[from] + lvl->goal[to] != lvl->goals)) {
+        enum SOKDEADLOCK verdict;
+        w->board->field[lvl->sq2tile[from]] &= ~field_atom;
+        w->board->field[lvl->sq2tile[to]] |= field_atom;
+        w->board->positionx = lvl->sq2tile[player] % field_stride - 1;
+        w->board->positiony = lvl->sq2tile[player] / field_stride - 1;
+        verdict = sok_deadlock_check(w->board, lvl->sq2tile[to]);
+        w->board->field[lvl->sq2tile[to]] &= ~field_atom;
+        w->board->field[lvl->sq2tile[from]] |= field_atom;
+        if (verdict != sokdeadlockNONE) continue;
+      }
+      if (s->bound != NULL) {
+        sok_lowerbound_copymatching(w->childmatch, w->match);
+        estimate = sok_lowerbound_update(s->bound, w->childmatch, i - 1, lvl->sq2tile[to]);
+        if (estimate < 0) continue; /* some goal can't be reached by any atom anymore */
+      }
+      if (s->pdb != NULL) {
+        int pdbestimate;
+        w->atomtiles[i - 1] = lvl->sq2tile[to];
+        pdbestimate = sok_pdb_bound(s->pdb, w->atomtiles, lvl->boxes);
+        w->atomtiles[i - 1] = lvl->sq2tile[from];
+        if (pdbestimate < 0) continue; /* some atoms can't reach goals together */
+        if (pdbestimate > estimate) estimate = pdbestimate;
+        if (estimate < node->estimate - pushes) estimate = node->estimate - pushes;
+      }
+      /* build the child position: move the atom, keep the list sorted, and normalize the player position */
+      memcpy(child, state, s->statelen);
+      for (j = i; (j > 1) && (child[j - 1] > to); j--) child[j] = child[j - 1];
+      for (; (j < lvl->boxes) && (child[j + 1] < to); j++) child[j] = child[j + 1];
+      child[j] = to;
+      w->boxat[from] = 0;
+      w->boxat[to] = 1;
+      w->seenstamp += 1;
+      child[0] = walk(w, w->seen, w->seenstamp, (s->pull != 0) ? behind : player);
+      w->boxat[to] = 0;
+      w->boxat[from] = 1;
+      solved = (ongoal - lvl->goal[from] + lvl->goal[to] == lvl->goals);
+      if (s->visited != NULL) {
+          res = diskchild(s, child, from, d, solved);
+        } else if (s->pull != 0) {
+          /* what gets recorded is the push that undoes the pull, and leads back to the parent */
+          hash = boxhash ^ lvl->boxkey[from] ^ lvl->boxkey[to] ^ lvl->playerkey[child[0]];
+          res = addpending(s, child, hash, id, to, OPPOSITE(d), node->depth + 1, estimate, 0);
+        } else {
+          hash = boxhash ^ lvl->boxkey[from] ^ lvl->boxkey[to] ^ lvl->playerkey[child[0]];
+          res = addpending(s, child, hash, id, from, d, node->depth + pushes, estimate, solved);
+      }
+      if (res != 0) break;
+    }
+  }
+  for (i = 1; i <= lvl->boxes; i++) {
+    w->boxat[state[i]] = 0;
+    w->board->field[lvl->sq2tile[state[i]]] &= ~field_atom;
+  }
+  return(res);
+}
+
+/* fetches the next chunk to expand: from the front of the worker's own deque, or from the back of another one's. returns 0 once
+ * there is nothing left to do. */
+static int getchunk(struct worker *w, long *chunk) {
+  struct solver *s = w->s;
+  struct worker *victim;
+  int i, res = 0;
+  SDL_AtomicLock(&(w->dequelock));
+  if (w->dequefront < w->dequeback) {
+    *chunk = w->dequefront++;
+    res = 1;
+  }
+  SDL_AtomicUnlock(&(w->dequelock));
+  for (i = 1; (i < s->threads) && (res == 0); i++) {
+    victim = &(s->workers[(w->index + i) % s->threads]);
+    SDL_AtomicLock(&(victim->dequelock));
+    if (victim->dequefront < victim->dequeback) {
+      *chunk = --(victim->dequeback);
+      res = 1;
+    }
+    SDL_AtomicUnlock(&(victim->dequelock));
+  }
+  return(res);
+}
+
+/* calls the progress callback and polls for cancellation. only ever called by the thread that called sok_solve(). */
+static void pollcallbacks(struct solver *s) {
+  long expanded = SDL_AtomicGet(&(s->expanded)), nodes;
+  if (expanded - s->lastpoll < PROGRESS_INTERVAL) return;
+  s->lastpoll = expanded;
+  s->stats->elapsedms = SDL_GetTicks() - s->startticks;
+  if (s->params.progress != NULL) {
+    nodes = s->stats->nodes;
+    s->stats->nodes += expanded;
+    s->params.progress(s->stats, s->params.userdata);
+    s->stats->nodes = nodes;
+  }
+  if ((s->params.cancel != NULL) && (s->params.cancel(s->params.userdata) != 0)) SDL_AtomicCAS(&(s->abort), 0, ABORT_CANCELED);
+}
+
+/* expands chunks of the current layer until there is none left */
+static void worklayer(struct worker *w) {
+  struct solver *s = w->s;
+  long chunk, first, last, k;
+  while (getchunk(w, &chunk) != 0) {
+    if (SDL_AtomicGet(&(s->abort)) != 0) break;
+    first = chunk * CHUNKSIZE;
+    last = first + CHUNKSIZE;
+    if (last > s->layercount) last = s->layercount;
+    for (k = first; k < last; k++) {
+      if (expand(w, s->layer[k], getnode(s, s->layer[k])) != 0) {
+        SDL_AtomicCAS(&(s->abort), 0, ABORT_OUTOFMEMORY);
+        break;
+      }
+    }
+    SDL_AtomicAdd(&(s->expanded), k - first);
+    if (w->index == 0) pollcallbacks(s);
+  }
+}
+
+static int workerthread(void *data) {
+  struct worker *w = data;
+  struct solver *s = w->s;
+  int generation = 0;
+  SDL_LockMutex(s->poollock);
+  for (;;) {
+    while ((s->generation == generation) && (s->quit == 0)) SDL_CondWait(s->poolstart, s->poollock);
+    if (s->quit != 0) break;
+    generation = s->generation;
+    SDL_UnlockMutex(s->poollock);
+    worklayer(w);
+    SDL_LockMutex(s->poollock);
+    s->busy -= 1;
+    if (s->busy == 0) SDL_CondSignal(s->pooldone);
+  }
+  SDL_UnlockMutex(s->poollock);
+  return(0);
+}
+
+/* expands all positions of the layer, using all threads */
+static void runlayer(struct solver *s) {
+  long chunks, i;
+  chunks = (s->layercount + CHUNKSIZE - 1) / CHUNKSIZE;
+  /* hand out contiguous ranges of chunks, stealing will even things out */
+  for (i = 0; i < s->threads; i++) {
+    s->workers[i].dequefront = chunks * i / s->threads;
+    s->workers[i].dequeback = chunks * (i + 1) / s->threads;
+  }
+  SDL_AtomicSet(&(s->expanded), 0);
+  s->lastpoll = -PROGRESS_INTERVAL;
+  if (s->threads > 1) {
+    SDL_LockMutex(s->poollock);
+    s->busy = s->threads - 1;
+    s->generation += 1;
+    SDL_CondBroadcast(s->poolstart);
+    SDL_UnlockMutex(s->poollock);
+  }
+  worklayer(&(s->workers[0]));
+  if (s->threads > 1) {
+    SDL_LockMutex(s->poollock);
+    while (s->busy > 0) SDL_CondWait(s->pooldone, s->poollock);
+    SDL_UnlockMutex(s->poollock);
+  }
+}
+
+/* appends a move to a growable string */
+static int appendmove(char **str, long *len, long *alloc, char move) {
+  if (*len + 2 > *alloc) {
+    char *newstr;
+    newstr = realloc(*str, *alloc * 2);
+    if (newstr == NULL) return(-1);
+    *str = newstr;
+    *alloc *= 2;
+  }
+  (*str)[*len] = move;
+  *len += 1;
+  (*str)[*len] = 0;
+  return(0);
+}
+
+/* appends to str the walking moves that lead the player from tile start to tile target, without pushing anything */
+static int appendpath(char **str, long *len, long *alloc, unsigned char *field, int start, int target) {
+  short queue[field_tiles];
+  signed char camefrom[field_tiles];
+  char path[field_tiles];
+  int queuehead = 0, queuetail = 0, tile, d, pathlen = 0;
+  memset(camefrom, -1, sizeof(camefrom));
+  queue[queuetail++] = start;
+  camefrom[start] = 4;
+  while ((queuehead < queuetail) && (camefrom[target] < 0)) {
+    tile = queue[queuehead++];
+    for (d = 0; d < 4; d++) {
+      if (camefrom[tile + dirvectors[d]] >= 0) continue;
+      if (field[tile + dirvectors[d]] & (field_wall | field_atom)) continue;
+      camefrom[tile + dirvectors[d]] = d;
+      queue[queuetail++] = tile + dirvectors[d];
+    }
+  }
+  if (camefrom[target] < 0) return(-1);
+  for (tile = target; tile != start; tile -= dirvectors[(int)camefrom[tile]]) path[pathlen++] = dirmoves[(int)camefrom[tile]];
+  while (pathlen > 0) {
+    pathlen -= 1;
+    if (appendmove(str, len, alloc, path[pathlen]) != 0) return(-1);
+  }
+  return(0);
+}
+
+/* turns a chain of pushes (squares of the pushed atoms, and directions) into a full LURD string, walking moves included */
+static char *replaypushes(struct solver *s, struct sokgame *game, uint16_t *pushfrom, unsigned char *pushdir, long pushes) {
+  struct sokgame *work;
+  char *res;
+  long i, len = 0, alloc = 256;
+  int player, atom;
+  work = malloc(sizeof(struct sokgame));
+  res = malloc(alloc);
+  if ((work == NULL) || (res == NULL)) goto failed;
+  res[0] = 0;
+  /* replay the pushes on a copy of the game, filling the walking moves in between */
+  memcpy(work, game, sizeof(struct sokgame));
+  player = sok_fieldidx(game->positionx, game->positiony);
+  for (i = 0; i < pushes; i++) {
+    atom = s->lvl->sq2tile[pushfrom[i]];
+    if (appendpath(&res, &len, &alloc, work->field, player, atom - dirvectors[pushdir[i]]) != 0) goto failed;
+    if (appendmove(&res, &len, &alloc, dirmoves[pushdir[i]] - 32) != 0) goto failed; /* uppercase marks a push */
+    work->field[atom] &= ~field_atom;
+    work->field[atom + dirvectors[pushdir[i]]] |= field_atom;
+    player = atom;
+  }
+  free(work);
+  return(res);
+
+  failed:
+  if (work != NULL) free(work);
+  if (res != NULL) free(res);
+  return(NULL);
+}
+
+/* turns the chain of pushes that leads to position id into a full LURD string, walking moves included. if back is not NULL, the
+ * position is also the one backid of the backward search back, and its chain of pushes to the goals follows. */
+static char *buildsolution(struct solver *s, struct sokgame *game, uint32_t id, struct solver *back, uint32_t backid) {
+  struct worker *w = &(s->workers[0]);
+  struct nodehdr *node, *parent, *backnode = NULL;
+  uint16_t *pushfrom, *state;
+  unsigned char *pushdir;
+  char *res = NULL;
+  long pushes, i, j, k;
+  node = getnode(s, id);
+  pushes = node->depth;
+  if (back != NULL) {
+    backnode = getnode(back, backid);
+    pushes += backnode->depth;
+  }
+  pushfrom = malloc(sizeof(uint16_t) * (pushes + 1));
+  pushdir = malloc(pushes + 1);
+  if ((pushfrom != NULL) && (pushdir != NULL)) {
+    /* walk the chain back to the start. macro pushes are worked out again, from the position they have been made from. */
+    for (i = node->depth - 1; i >= 0; i -= k) {
+      parent = getnode(s, node->parent);
+      k = node->depth - parent->depth;
+      if (k == 1) {
+          pushfrom[i] = node->pushfrom;
+          pushdir[i] = node->pushdir;
+        } else {
+          state = NODESTATE(parent);
+          for (j = 1; j <= s->lvl->boxes; j++) w->boxat[state[j]] = 1;
+          macropush(w, state, node->pushfrom, node->pushdir);
+          for (j = 1; j <= s->lvl->boxes; j++) w->boxat[state[j]] = 0;
+          for (j = 0; j < k; j++) {
+            pushfrom[i - k + 1 + j] = w->macrofrom[j];
+            pushdir[i - k + 1 + j] = w->macrodir[j];
+          }
+      }
+      node = parent;
+    }
+    /* then the backward one to the goals, it holds pushes already */
+    for (i = pushes - ((backnode != NULL) ? backnode->depth : 0); i < pushes; i++) {
+      pushfrom[i] = backnode->pushfrom;
+      pushdir[i] = backnode->pushdir;
+      backnode = getnode(back, backnode->parent);
+    }
+    res = replaypushes(s, game, pushfrom, pushdir, pushes);
+  }
+  if (pushfrom != NULL) free(pushfrom);
+  if (pushdir != NULL) free(pushdir);
+  return(res);
+}
+
+/* turns the solved position found by a search on disk, pushes pushes away from the start, into a full LURD string. the chain of
+ * pushes is traced back one layer at a time: the parent of a position is the first position of the previous layer that leads to
+ * it. returns NULL on error. */
+static char *tracesolution(struct solver *s, struct sokgame *game, long pushes) {
+  struct worker *w = &(s->workers[0]);
+  struct nodehdr *node;
+  uint16_t *pushfrom;
+  unsigned char *pushdir, *noderec;
+  char *res = NULL;
+  long i;
+  int found;
+  pushfrom = malloc(sizeof(uint16_t) * (pushes + 1));
+  pushdir = malloc(pushes + 1);
+  noderec = calloc(1, s->recsize);
+  s->tracestate = malloc(s->statelen);
+  if ((pushfrom == NULL) || (pushdir == NULL) || (noderec == NULL) || (s->tracestate == NULL)) goto done;
+  node = (struct nodehdr *)noderec;
+  memcpy(s->tracestate, s->solvedstate, s->statelen);
+  for (i = pushes - 1; i >= 0; i--) {
+    if (sok_visited_rewind(s->visited, i) != 0) goto done;
+    found = 0;
+    while ((found == 0) && (sok_visited_read(s->visited, NODESTATE(node)) == 1)) found = expand(w, 0, node);
+    if (found != 1) goto done;
+    pushfrom[i] = s->tracefrom;
+    pushdir[i] = s->tracedir;
+    memcpy(s->tracestate, NODESTATE(node), s->statelen);
+  }
+  res = replaypushes(s, game, pushfrom, pushdir, pushes);
+
+  done:
+  if (pushfrom != NULL) free(pushfrom);
+  if (pushdir != NULL) free(pushdir);
+  if (noderec != NULL) free(noderec);
+  return(res);
+}
+
+/* allocates the scratch buffers of a worker. returns 0 on success, non-zero otherwise. */
+static int allocworker(struct solver *s, struct worker *w, int index, struct sokgame *game) {
+  int squares = s->lvl->squares, tile;
+  w->s = s;
+  w->index = index;
+  w->reach = calloc(squares, sizeof(uint32_t));
+  w->seen = calloc(squares, sizeof(uint32_t));
+  w->boxat = calloc(squares, sizeof(short));
+  w->queue = malloc(squares * sizeof(short));
+  w->childstate = malloc(s->statelen);
+  w->board = malloc(sizeof(struct sokgame));
+  w->atomtiles = malloc(s->lvl->boxes * sizeof(int));
+  s->stats->memory += squares * (sizeof(uint32_t) * 2 + sizeof(short) * 2) + s->statelen + sizeof(struct sokgame) + s->lvl->boxes * sizeof(int);
+  if ((w->reach == NULL) || (w->seen == NULL) || (w->boxat == NULL) || (w->queue == NULL) || (w->childstate == NULL) || (w->board == NULL) || (w->atomtiles == NULL)) return(-1);
+  if (s->params.macros != 0) {
+    w->macrofrom = malloc(sizeof(uint16_t) * (squares * 4 + 1));
+    w->macrodir = malloc(squares * 4 + 1);
+    s->stats->memory += (squares * 4 + 1) * (sizeof(uint16_t) + 1);
+    if ((w->macrofrom == NULL) || (w->macrodir == NULL)) return(-1);
+  }
+  if (s->params.macros >= 2) {
+    w->rs.seen = calloc(squares * 4, sizeof(uint32_t));
+    w->rs.prev = malloc(squares * 4 * sizeof(int));
+    w->rs.queue = malloc(squares * 4 * sizeof(int));
+    w->rs.reach = calloc(squares, sizeof(uint32_t));
+    w->rs.walkqueue = malloc(squares * sizeof(short));
+    s->stats->memory += squares * 4 * (sizeof(uint32_t) + sizeof(int) * 2) + squares * (sizeof(uint32_t) + sizeof(short));
+    if ((w->rs.seen == NULL) || (w->rs.prev == NULL) || (w->rs.queue == NULL) || (w->rs.reach == NULL) || (w->rs.walkqueue == NULL)) return(-1);
+  }
+  if (s->bound != NULL) {
+    w->match = sok_lowerbound_newmatching(s->bound);
+    w->childmatch = sok_lowerbound_newmatching(s->bound);
+    s->stats->memory += 2 * 8 * (s->lvl->boxes + 1) * sizeof(int);
+    if ((w->match == NULL) || (w->childmatch == NULL)) return(-1);
+  }
+  /* the board starts without the atoms the player can push, expand() places the ones of each position it looks at */
+  memcpy(w->board, game, sizeof(struct sokgame));
+  for (tile = 0; tile < field_tiles; tile++) {
+    if (s->lvl->tile2sq[tile] >= 0) w->board->field[tile] &= ~field_atom;
+  }
+  return(0);
+}
+
+static void freeworker(struct worker *w) {
+  if (w->reach != NULL) free(w->reach);
+  if (w->seen != NULL) free(w->seen);
+  if (w->boxat != NULL) free(w->boxat);
+  if (w->queue != NULL) free(w->queue);
+  if (w->childstate != NULL) free(w->childstate);
+  if (w->board != NULL) free(w->board);
+  if (w->atomtiles != NULL) free(w->atomtiles);
+  if (w->macrofrom != NULL) free(w->macrofrom);
+  if (w->macrodir != NULL) free(w->macrodir);
+  if (w->rs.seen != NULL) free(w->rs.seen);
+  if (w->rs.prev != NULL) free(w->rs.prev);
+  if (w->rs.queue != NULL) free(w->rs.queue);
+  if (w->rs.reach != NULL) free(w->rs.reach);
+  if (w->rs.walkqueue != NULL) free(w->rs.walkqueue);
+  sok_lowerbound_freematching(w->match);
+  sok_lowerbound_freematching(w->childmatch);
+}
+
+/* allocates the tables of a solver, sized after the memory budget, and starts its threads. returns 0 on success, non-zero otherwise. */
+static int allocsolver(struct solver *s, struct sokgame *game) {
+  long budget = s->params.maxmemory, slots = STRIPES * 64, tablesize;
+  int i;
+  s->statelen = sizeof(uint16_t) * (1 + s->lvl->boxes);
+  s->recsize = (sizeof(struct nodehdr) + s->statelen - sizeof(uint16_t) + 3) & ~3;
+  /* a search on disk needs no table, the whole budget goes to the visited store */
+  if (s->params.spilldir != NULL) {
+    s->threads = 1;
+    s->visited = sok_visited_new(s->lvl->squares, s->lvl->boxes, budget, s->params.spilldir);
+    s->solvedstate = malloc(s->statelen);
+    if ((s->visited == NULL) || (s->solvedstate == NULL)) return(-1);
+    s->stats->memory += sizeof(struct solverlevel) + sok_visited_memory(s->visited);
+    s->workers = calloc(1, sizeof(struct worker));
+    if (s->workers == NULL) return(-1);
+    return(allocworker(s, s->workers, 0, game));
+  }
+  /* a quarter of the budget goes to the visited table, the rest to positions (but never fill the table more than 75%) */
+  while ((slots * 2) * (long)(sizeof(uint32_t) * 2) <= budget / 4) slots *= 2;
+  tablesize = slots * (long)(sizeof(uint32_t) * 2);
+  s->stripemask = slots / STRIPES - 1;
+  s->stripemax = slots / STRIPES / 16 * 15;
+  s->capacity = slots / 4 * 3;
+  /* stored positions and the ones waiting in the current layer both take room, and so do the buckets */
+  if ((budget - tablesize) / (s->recsize + (long)sizeof(uint32_t)) < (long)s->capacity) s->capacity = (budget - tablesize) / (s->recsize + sizeof(uint32_t));
+  s->stats->memory += sizeof(struct solverlevel) + tablesize;
+  for (i = 0; i < STRIPES; i++) {
+    s->stripes[i].table = calloc(slots / STRIPES, sizeof(uint32_t));
+    s->stripes[i].check = malloc(slots / STRIPES * sizeof(uint32_t));
+    if ((s->stripes[i].table == NULL) || (s->stripes[i].check == NULL)) return(-1);
+  }
+  s->blocks = calloc(s->capacity / NODESPERBLOCK + 1, sizeof(unsigned char *));
+  s->pending = calloc(s->capacity / NODESPERBLOCK + 1, sizeof(void *));
+  s->pendinglock = SDL_CreateMutex();
+  if ((s->blocks == NULL) || (s->pending == NULL) || (s->pendinglock == NULL)) return(-1);
+  /* workers: the calling thread is worker 0, the others get a thread of their own */
+  if (s->threads < 1) s->threads = SDL_GetCPUCount();
+  if (s->threads < 1) s->threads = 1;
+  if (s->threads > MAXTHREADS) s->threads = MAXTHREADS;
+  s->workers = calloc(s->threads, sizeof(struct worker));
+  if (s->workers == NULL) return(-1);
+  for (i = 0; i < s->threads; i++) {
+    if (allocworker(s, &(s->workers[i]), i, game) != 0) return(-1);
+  }
+  if (s->threads > 1) {
+    s->poollock = SDL_CreateMutex();
+    s->poolstart = SDL_CreateCond();
+    s->pooldone = SDL_CreateCond();
+    if ((s->poollock == NULL) || (s->poolstart == NULL) || (s->pooldone == NULL)) return(-1);
+    for (i = 1; i < s->threads; i++) {
+      s->workers[i].thread = SDL_CreateThread(workerthread, "sok_solve", &(s->workers[i]));
+      if (s->workers[i].thread == NULL) break;
+    }
+    /* if some threads could not be created, go on with the ones that were */
+    s->threads = i;
+  }
+  return(0);
+}
+
+static void freesolver(struct solver *s) {
+  long i;
+  if (s->poollock != NULL) {
+    SDL_LockMutex(s->poollock);
+    s->quit = 1;
+    SDL_CondBroadcast(s->poolstart);
+    SDL_UnlockMutex(s->poollock);
+  }
+  if (s->workers != NULL) {
+    for (i = 0; i < s->threads; i++) {
+      if (s->workers[i].thread != NULL) SDL_WaitThread(s->workers[i].thread, NULL);
+      freeworker(&(s->workers[i]));
+    }
+    free(s->workers);
+  }
+  if (s->poollock != NULL) SDL_DestroyMutex(s->poollock);
+  if (s->poolstart != NULL) SDL_DestroyCond(s->poolstart);
+  if (s->pooldone != NULL) SDL_DestroyCond(s->pooldone);
+  for (i = 0; i < s->blockscount; i++) free(s->blocks[i]);
+  if (s->blocks != NULL) free(s->blocks);
+  if (s->pending != NULL) {
+    for (i = 0; i <= (long)(s->capacity / NODESPERBLOCK); i++) {
+      if (s->pending[i] != NULL) free(s->pending[i]);
+    }
+    free(s->pending);
+  }
+  if (s->pendinglock != NULL) SDL_DestroyMutex(s->pendinglock);
+  for (i = 0; i < s->bucketscount; i++) {
+    if (s->buckets[i].ids != NULL) free(s->buckets[i].ids);
+  }
+  if (s->buckets != NULL) free(s->buckets);
+  for (i = 0; i < STRIPES; i++) {
+    if (s->stripes[i].table != NULL) free(s->stripes[i].table);
+    if (s->stripes[i].check != NULL) free(s->stripes[i].check);
+  }
+  if (s->lvl != NULL) free(s->lvl);
+  sok_visited_free(s->visited);
+  if (s->solvedstate != NULL) free(s->solvedstate);
+  if (s->tracestate != NULL) free(s->tracestate);
+  sok_lowerbound_free(s->bound);
+  sok_pdb_free(s->pdb);
+}
+
+/* returns the id of the stored position state, or 0 if it has never been seen */
+static uint32_t findnode(struct solver *s, uint16_t *state) {
+  uint64_t hash = hashstate(s, state);
+  struct stripe *stripe = &(s->stripes[hash >> (64 - STRIPEBITS)]);
+  uint32_t i, check = (uint32_t)(hash >> 32);
+  for (i = (uint32_t)hash & s->stripemask; stripe->table[i] != 0; i = (i + 1) & s->stripemask) {
+    if ((stripe->check[i] == check) && (memcmp(NODESTATE(getentry(s, stripe->table[i])), state, s->statelen) == 0)) return(stripe->table[i]);
+  }
+  return(0);
+}
+
+/* expands the next layer: whatever is left in the lowest bucket that still holds positions. returns 0 once done, or non-zero if the
+ * search is over, stats->result telling why (soksolveSOLVED if the lowest bucket holds a solved position, s->solvedid). */
+static int nextlayer(struct solver *s) {
+  struct bucket *b;
+  while (s->f < s->bucketscount) {
+    b = &(s->buckets[s->f]);
+    if (b->solvedid != 0) {
+      s->solvedid = b->solvedid;
+      s->stats->result = soksolveSOLVED;
+      return(-1);
+    }
+    if (b->next == b->count) {
+      /* nothing will ever be added to that bucket anymore */
+      if (b->ids != NULL) free(b->ids);
+      s->stats->memory -= sizeof(uint32_t) * b->alloc;
+      memset(b, 0, sizeof(struct bucket));
+      s->f += 1;
+      continue;
+    }
+    /* leave out stale positions. that's done here rather than by the workers, since positions of the layer may turn stale while
+     * it is being expanded, and whether they get expanded must not depend on timing. */
+    s->layer = b->ids + b->next;
+    s->layercount = 0;
+    for (; b->next < b->count; b->next++) {
+      if ((getnode(s, b->ids[b->next])->flags & NODE_STALE) == 0) s->layer[s->layercount++] = b->ids[b->next];
+    }
+    if (s->layercount == 0) continue;
+    if ((s->params.maxnodes > 0) && (s->stats->nodes + s->layercount > s->params.maxnodes)) {
+      s->stats->result = soksolveNODELIMIT;
+      return(-1);
+    }
+    s->stats->depth = s->f;
+    runlayer(s);
+    s->stats->nodes += SDL_AtomicGet(&(s->expanded));
+    if (SDL_AtomicGet(&(s->abort)) == ABORT_CANCELED) {
+      s->stats->result = soksolveCANCELED;
+      return(-1);
+    }
+    if ((SDL_AtomicGet(&(s->abort)) == ABORT_OUTOFMEMORY) || (finishlayer(s) != 0)) {
+      s->stats->result = soksolveOUTOFMEMORY;
+      return(-1);
+    }
+    return(0);
+  }
+  s->stats->result = soksolveUNSOLVABLE;
+  return(-1);
+}
+
+/* returns the number of positions (stale ones included) of the layer nextlayer() would expand, or 0 if there is none left */
+static long nextlayersize(struct solver *s) {
+  long f;
+  for (f = s->f; f < s->bucketscount; f++) {
+    if (s->buckets[f].next < s->buckets[f].count) return(s->buckets[f].count - s->buckets[f].next);
+  }
+  return(0);
+}
+
+/* breadth-first search from both ends: forward from the position stored in s, backward from the positions stored in back. returns
+ * the solution, or NULL if none has been found (s->stats->result tells why). */
+static char *searchbothways(struct solver *s, struct solver *back, struct sokgame *game) {
+  struct solver *side, *other;
+  long forwardsize, backsize;
+  uint32_t id, first, match;
+  for (;;) {
+    forwardsize = nextlayersize(s);
+    backsize = nextlayersize(back);
+    /* once one side runs out of positions, the other one can't meet it anymore */
+    if ((forwardsize == 0) || (backsize == 0)) {
+      s->stats->result = soksolveUNSOLVABLE;
+      return(NULL);
+    }
+    side = s;
+    other = back;
+    if (backsize < forwardsize) {
+      side = back;
+      other = s;
+    }
+    first = side->nodecount + 1;
+    if (nextlayer(side) != 0) break;
+    s->stats->depth = s->f + back->f;
+    /* both sides hold all positions up to some depth, and did not meet before: any position of the new layer that the other side
+     * knows already is on a shortest solution */
+    for (id = first; id <= side->nodecount; id++) {
+      match = findnode(other, NODESTATE(getnode(side, id)));
+      if (match == 0) continue;
+      s->stats->result = soksolveSOLVED;
+      if (side == s) return(buildsolution(s, game, id, back, match));
+      return(buildsolution(s, game, match, back, id));
+    }
+  }
+  /* a solved position of the forward side would have met the goals of the backward side already, but just in case */
+  if ((side == s) && (s->stats->result == soksolveSOLVED)) return(buildsolution(s, game, s->solvedid, NULL, 0));
+  return(NULL);
+}
+
+/* saves the state of a search on disk to the checkpoint file of the level: the visited store, whose layers up to depth are closed,
+ * and the starting position root. the file is written aside first, and only replaces the previous checkpoint once complete. returns
+ * 0 on success, non-zero otherwise. */
+static int writecheckpoint(struct solver *s, struct sokgame *game, uint16_t *root, long depth) {
+  struct checkpointheader hdr;
+  char path[4096], tmppath[4096];
+  FILE *fd;
+  int res = 0;
+  if (savefile_path(path, sizeof(path), game->crc32, CHECKPOINT_EXT) != 0) return(-1);
+  if (savefile_path(tmppath, sizeof(tmppath), game->crc32, CHECKPOINT_TMPEXT) != 0) return(-1);
+  fd = fopen(tmppath, "wb");
+  if (fd == NULL) return(-1);
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = CHECKPOINTMAGIC;
+  hdr.version = CHECKPOINTVERSION;
+  hdr.crc32 = game->crc32;
+  hdr.squares = s->lvl->squares;
+  hdr.boxes = s->lvl->boxes;
+  hdr.depth = depth;
+  if ((fwrite(&hdr, sizeof(hdr), 1, fd) != 1) || (fwrite(root, s->statelen, 1, fd) != 1) || (sok_visited_save(s->visited, fd) != 0)) res = -1;
+  if (fclose(fd) != 0) res = -1;
+  if (res == 0) {
+#ifdef _WIN32
+    remove(path); /* rename() does not replace files there */
+#endif
+    if (rename(tmppath, path) != 0) res = -1;
+  }
+  if (res != 0) remove(tmppath);
+  return(res);
+}
+
+/* fills the visited store of a search on disk from the checkpoint file of the level, if it has been saved by a search from the same
+ * starting position root. *depth receives the layer to expand next. returns the number of positions of that layer, or -1 if there is
+ * no checkpoint to resume from. s->visited is then as it was, or a new empty store if it has been spoiled (NULL if out of memory). */
+static long readcheckpoint(struct solver *s, struct sokgame *game, uint16_t *root, long *depth) {
+  struct checkpointheader hdr;
+  char path[4096];
+  uint16_t *state;
+  FILE *fd;
+  long res = -1;
+  int restored = 0;
+  if (savefile_path(path, sizeof(path), game->crc32, CHECKPOINT_EXT) != 0) return(-1);
+  fd = fopen(path, "rb");
+  if (fd == NULL) return(-1);
+  state = malloc(s->statelen);
+  if ((state != NULL) && (fread(&hdr, sizeof(hdr), 1, fd) == 1) && (fread(state, s->statelen, 1, fd) == 1)) {
+    if ((hdr.magic == CHECKPOINTMAGIC) && (hdr.version == CHECKPOINTVERSION) && (hdr.crc32 == (uint32_t)game->crc32)
+      && (hdr.squares == (uint32_t)s->lvl->squares) && (hdr.boxes == (uint32_t)s->lvl->boxes) && (memcmp(state, root, s->statelen) == 0)) {
+      restored = 1;
+      res = sok_visited_restore(s->visited, fd);
+      /* the store must hold every layer up to the one to expand, and no other */
+      if ((res > 0) && ((sok_visited_rewind(s->visited, hdr.depth) != 0) || (sok_visited_rewind(s->visited, hdr.depth + 1) == 0))) res = -1;
+      *depth = hdr.depth;
+    }
+  }
+  fclose(fd);
+  if (state != NULL) free(state);
+  if ((restored != 0) && (res <= 0)) {
+    res = -1;
+    sok_visited_free(s->visited);
+    s->visited = sok_visited_new(s->lvl->squares, s->lvl->boxes, s->params.maxmemory, s->params.spilldir);
+  }
+  return(res);
+}
+
+void sok_solve_dropcheckpoint(struct sokgame *game) {
+  char path[4096];
+  if (savefile_path(path, sizeof(path), game->crc32, CHECKPOINT_EXT) == 0) remove(path);
+}
+
+/* breadth-first search from position root, over the visited store on disk. returns the solution, or NULL if none has been found
+ * (s->stats->result tells why). */
+static char *searchondisk(struct solver *s, struct sokgame *game, uint16_t *root) {
+  struct worker *w = &(s->workers[0]);
+  struct nodehdr *node;
+  uint16_t *start;
+  char *solution = NULL;
+  long layersize = -1, depth = 0, k, storememory;
+  unsigned long lastcheckpoint;
+  node = calloc(1, s->recsize);
+  start = malloc(s->statelen); /* root is the scratch state of the worker, expand() overwrites it */
+  if ((node == NULL) || (start == NULL)) {
+    if (node != NULL) free(node);
+    if (start != NULL) free(start);
+    s->stats->result = soksolveOUTOFMEMORY;
+    return(NULL);
+  }
+  memcpy(start, root, s->statelen);
+  s->stats->result = soksolveUNSOLVABLE;
+  /* pick up from the checkpoint of an earlier search, if there is one */
+  if (s->params.checkpointms > 0) {
+    layersize = readcheckpoint(s, game, start, &depth);
+    if (layersize > 0) s->stats->resumed = depth + 1;
+    if (s->visited == NULL) {
+      s->stats->result = soksolveOUTOFMEMORY;
+      free(node);
+      free(start);
+      return(NULL);
+    }
+  }
+  if (layersize < 0) {
+    depth = 0;
+    if (sok_visited_add(s->visited, start) == 0) layersize = sok_visited_nextlayer(s->visited);
+  }
+  s->stats->positions = sok_visited_count(s->visited);
+  storememory = sok_visited_memory(s->visited);
+  lastcheckpoint = SDL_GetTicks();
+  for (; layersize != 0; depth++) {
+    if (layersize < 0) {
+      s->stats->result = soksolveERROR;
+      break;
+    }
+    if ((s->params.maxnodes > 0) && (s->stats->nodes + layersize > s->params.maxnodes)) {
+      s->stats->result = soksolveNODELIMIT;
+      /* a later search with a higher limit may go on from there */
+      if (s->params.checkpointms > 0) writecheckpoint(s, game, start, depth);
+      break;
+    }
+    s->stats->depth = depth;
+    SDL_AtomicSet(&(s->expanded), 0);
+    s->lastpoll = -PROGRESS_INTERVAL;
+    if (sok_visited_rewind(s->visited, depth) != 0) layersize = -1;
+    for (k = 0; k < layersize; k++) {
+      if ((sok_visited_read(s->visited, NODESTATE(node)) != 1) || (expand(w, 0, node) != 0)) {
+        layersize = -1;
+        break;
+      }
+      SDL_AtomicAdd(&(s->expanded), 1);
+      pollcallbacks(s);
+      if ((SDL_AtomicGet(&(s->abort)) != 0) || (s->solved != 0)) break;
+    }
+    s->stats->nodes += SDL_AtomicGet(&(s->expanded));
+    s->stats->diskbytes = sok_visited_diskbytes(s->visited);
+    s->stats->memory += sok_visited_memory(s->visited) - storememory; /* the store grows up to its budget */
+    storememory = sok_visited_memory(s->visited);
+    if (layersize < 0) continue;
+    if (SDL_AtomicGet(&(s->abort)) == ABORT_CANCELED) {
+      s->stats->result = soksolveCANCELED;
+      break;
+    }
+    /* any solution found in this layer is as short as it gets */
+    if (s->solved != 0) {
+      solution = tracesolution(s, game, depth + 1);
+      s->stats->result = (solution != NULL) ? soksolveSOLVED : soksolveERROR;
+      break;
+    }
+    layersize = sok_visited_nextlayer(s->visited);
+    s->stats->positions = sok_visited_count(s->visited);
+    /* failing to save a checkpoint is no reason to stop, the next one may do better */
+    if ((layersize > 0) && (s->params.checkpointms > 0) && (SDL_GetTicks() - lastcheckpoint >= (unsigned long)s->params.checkpointms)) {
+      writecheckpoint(s, game, start, depth + 1);
+      lastcheckpoint = SDL_GetTicks();
+    }
+  }
+  /* nothing left to resume once the level is proved unsolvable */
+  if ((s->params.checkpointms > 0) && (s->stats->result == soksolveUNSOLVABLE)) sok_solve_dropcheckpoint(game);
+  s->stats->diskbytes = sok_visited_diskbytes(s->visited);
+  free(node);
+  free(start);
+  return(solution);
+}
+
+/* sets up a backward search next to the forward search s, and runs both. returns the solution, or NULL if none has been found
+ * (s->stats->result tells why). */
+static char *solvebothways(struct solver *s, struct sokgame *game) {
+  struct solver back;
+  struct worker *w;
+  uint16_t *root;
+  int sq, i;
+  char *solution = NULL;
+  memset(&back, 0, sizeof(back));
+  memcpy(&(back.params), &(s->params), sizeof(struct soksolveparams));
+  back.stats = s->stats;
+  back.threads = s->threads;
+  back.startticks = s->startticks;
+  back.pull = 1;
+  back.lvl = malloc(sizeof(struct solverlevel));
+  if (back.lvl != NULL) memcpy(back.lvl, s->lvl, sizeof(struct solverlevel));
+  if ((back.lvl == NULL) || (allocsolver(&back, game) != 0)) {
+    s->stats->result = soksolveOUTOFMEMORY;
+    freesolver(&back);
+    return(NULL);
+  }
+  /* the first layer has all atoms on goals, and the player in any of the areas they leave free */
+  w = &(back.workers[0]);
+  root = w->childstate;
+  i = 1;
+  for (sq = 0; sq < back.lvl->squares; sq++) {
+    if (back.lvl->goal[sq] == 0) continue;
+    root[i++] = sq;
+    w->boxat[sq] = 1;
+  }
+  w->stamp = 1;
+  for (sq = 0; sq < back.lvl->squares; sq++) {
+    if ((w->boxat[sq] != 0) || (w->reach[sq] == w->stamp)) continue;
+    root[0] = walk(w, w->reach, w->stamp, sq);
+    if (addpending(&back, root, hashstate(&back, root), 0, root[0], 0, 0, 0, 0) != 0) break;
+  }
+  memset(w->boxat, 0, sizeof(short) * back.lvl->squares);
+  w->stamp = 2;
+  if ((sq < back.lvl->squares) || (finishlayer(&back) != 0)) {
+      s->stats->result = soksolveOUTOFMEMORY;
+    } else {
+      solution = searchbothways(s, &back, game);
+  }
+  freesolver(&back);
+  return(solution);
+}
+
+char *sok_solve(struct sokgame *game, struct soksolveparams *params, struct soksolvestats *stats) {
+  struct solver s;
+  struct soksolvestats localstats;
+  struct worker *w;
+  uint16_t *root;
+  int i, tile, estimate = 0;
+  char *solution = NULL;
+  memset(&s, 0, sizeof(s));
+  if (stats == NULL) stats = &localstats;
+  memset(stats, 0, sizeof(struct soksolvestats));
+  s.stats = stats;
+  if (params != NULL) {
+      memcpy(&(s.params), params, sizeof(struct soksolveparams));
+    } else {
+      sok_solve_defaults(&(s.params));
+  }
+  if (s.params.maxmemory <= 0) s.params.maxmemory = DEFAULT_MAXMEMORY;
+  s.threads = s.params.threads;
+  s.startticks = SDL_GetTicks();
+
+  /* nothing to search if the level is solved already */
+  if (game->goalsleft == 0) {
+    stats->result = soksolveSOLVED;
+    solution = malloc(1);
+    if (solution != NULL) solution[0] = 0;
+    return(solution);
+  }
+
+  s.lvl = malloc(sizeof(struct solverlevel));
+  if (s.lvl == NULL) {
+    stats->result = soksolveOUTOFMEMORY;
+    return(NULL);
+  }
+  stats->result = setuplevel(s.lvl, game);
+  if (stats->result != soksolveSOLVED) {
+    freesolver(&s);
+    return(NULL);
+  }
+  /* a search from both ends needs the goals to tell where every atom ends up, and is breadth-first */
+  if ((s.params.bidirectional != 0) && ((s.params.spilldir != NULL) || (s.lvl->boxes != s.lvl->goals))) s.params.bidirectional = 0;
+  if (s.params.bidirectional != 0) {
+    s.params.blind = 1;
+    s.params.maxmemory /= 2; /* the other half goes to the backward search */
+  }
+  /* macro pushes take several pushes at once, which searches that go one push per layer can't do. they also need every atom to end
+   * up on a goal, so that an atom in a tunnel is sure to be pushed out of it some day, and goal rooms are sure to get filled. */
+  if ((s.params.bidirectional != 0) || (s.params.spilldir != NULL) || (s.lvl->boxes != s.lvl->goals)) s.params.macros = 0;
+  /* the bound only knows about the atoms and goals of the whole field: if some are out of the player's reach, go without it. searches
+   * on disk are breadth-first only. */
+  if ((s.params.blind == 0) && (s.params.spilldir == NULL)) {
+    s.bound = sok_lowerbound_new(game);
+    if ((s.bound != NULL) && ((s.bound->atoms != s.lvl->boxes) || (s.bound->goals != s.lvl->goals))) {
+      sok_lowerbound_free(s.bound);
+      s.bound = NULL;
+    }
+    if (s.bound != NULL) stats->memory += sizeof(struct soklowerbound) + sizeof(unsigned short) * field_tiles * s.bound->goals;
+    if ((s.bound != NULL) && (s.params.nopdb == 0)) s.pdb = sok_pdb_load(game);
+  }
+  if ((allocsolver(&s, game) != 0) || ((s.params.macros >= 2) && (findrooms(&s, game) != 0))) {
+    stats->result = soksolveOUTOFMEMORY;
+    freesolver(&s);
+    return(NULL);
+  }
+  stats->threads = s.threads;
+
+  /* the starting position is the only one of the first layer */
+  w = &(s.workers[0]);
+  root = w->childstate;
+  i = 1;
+  for (tile = 0; tile < field_tiles; tile++) {
+    if ((s.lvl->tile2sq[tile] >= 0) && (game->field[tile] & field_atom)) root[i++] = s.lvl->tile2sq[tile];
+  }
+  for (i = 1; i <= s.lvl->boxes; i++) w->boxat[root[i]] = 1;
+  w->stamp = 1;
+  root[0] = walk(w, w->reach, w->stamp, s.lvl->tile2sq[sok_fieldidx(game->positionx, game->positiony)]);
+  for (i = 1; i <= s.lvl->boxes; i++) w->boxat[root[i]] = 0;
+  w->stamp = 2;
+  if (s.visited != NULL) {
+    solution = searchondisk(&s, game, root);
+    stats->elapsedms = SDL_GetTicks() - s.startticks;
+    freesolver(&s);
+    return(solution);
+  }
+  if (s.bound != NULL) {
+    for (i = 1; i <= s.lvl->boxes; i++) w->atomtiles[i - 1] = s.lvl->sq2tile[root[i]];
+    estimate = sok_lowerbound_compute(s.bound, w->match, w->atomtiles);
+    if ((estimate >= 0) && (s.pdb != NULL)) {
+      i = sok_pdb_bound(s.pdb, w->atomtiles, s.lvl->boxes);
+      if ((i < 0) || (i > estimate)) estimate = i;
+    }
+    if (estimate < 0) {
+      stats->result = soksolveUNSOLVABLE;
+      freesolver(&s);
+      return(NULL);
+    }
+  }
+  if ((addpending(&s, root, hashstate(&s, root), 0, 0, 0, 0, estimate, 0) != 0) || (finishlayer(&s) != 0)) {
+    stats->result = soksolveOUTOFMEMORY;
+    freesolver(&s);
+    return(NULL);
+  }
+
+  if (s.params.bidirectional != 0) {
+      solution = solvebothways(&s, game);
+    } else {
+      /* expand the lowest bucket until it is empty, the positions it produces with the same estimated length go back into it.
+       * without a bound, every layer produces positions of the next buckets only (the next one, but for macro pushes), and the search
+       * is breadth-first. */
+      s.f = estimate;
+      while (nextlayer(&s) == 0);
+      if (stats->result == soksolveSOLVED) solution = buildsolution(&s, game, s.solvedid, NULL, 0);
+  }
+  if ((stats->result == soksolveSOLVED) && (solution == NULL)) stats->result = soksolveOUTOFMEMORY;
+  stats->elapsedms = SDL_GetTicks() - s.startticks;
+  freesolver(&s);
+  return(solution);
+}
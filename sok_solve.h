@@ -0,0 +1,86 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef sok_solve_h_sentinel
+#define sok_solve_h_sentinel
+
+  #include "sok_core.h"
+
+  enum SOKSOLVE {
+    soksolveSOLVED = 0,
+    soksolveUNSOLVABLE = 1,
+    soksolveNODELIMIT = 2,
+    soksolveOUTOFMEMORY = 3,
+    soksolveCANCELED = 4,
+    soksolveERROR = 5
+  };
+
+  struct soksolvestats {
+    long nodes;           /* number of positions expanded so far */
+    long positions;       /* number of distinct positions stored */
+    int depth;            /* estimated solution length of the positions being expanded: no solution needs fewer pushes */
+    long memory;          /* amount of bytes allocated by the search */
+    long diskbytes;       /* amount of bytes written to disk by the search (see spilldir) */
+    long elapsedms;       /* time spent searching, in ms */
+    int threads;          /* number of threads the search runs on */
+    int resumed;          /* number of layers the search got from a checkpoint rather than by searching (see checkpointms) */
+    enum SOKSOLVE result;
+  };
+
+  struct soksolveparams {
+    long maxnodes;        /* give up rather than expanding more than that many positions (0 = no limit) */
+    long maxmemory;       /* memory budget of the search, in bytes */
+    int threads;          /* number of threads to search with (0 = one per CPU) */
+    int blind;            /* non-zero for a plain breadth-first search, without the lower bound of the pushes left to guide it */
+    int nopdb;            /* non-zero to leave the pattern database of the level aside, even if one has been built */
+    int bidirectional;    /* non-zero for a breadth-first search from both the start and the goals, that meet halfway (only for levels
+                           * with as many atoms as goals, others are searched the usual way) */
+    int macros;           /* 0 (the default) to push atoms one square at a time. 1 to push an atom that enters a tunnel all the way
+                           * through it at once. 2 to also push an atom that enters a goal room straight to the goal it should fill.
+                           * macro pushes save positions, but may cost a few pushes (see sok_solve.c), so the solution is no longer
+                           * sure to be push-optimal. only used by forward searches in memory, on levels with as many atoms as goals. */
+    char *spilldir;       /* if not NULL, runs a single-threaded breadth-first search that keeps its visited positions on disk, in that
+                           * directory ("" for the system's temporary directory), and only maxmemory bytes of them in memory */
+    long checkpointms;    /* with spilldir: saves the state of the search next to the solution of the level every that many ms (0 =
+                           * never). a later search of the same position with checkpointms set picks up from there. the checkpoint
+                           * is deleted once the level is proved unsolvable, or by sok_solve_dropcheckpoint(). */
+    void (*progress)(struct soksolvestats *stats, void *userdata); /* called from time to time with the current stats (may be NULL) */
+    int (*cancel)(void *userdata); /* polled from time to time, the search is aborted as soon as it returns non-zero (may be NULL) */
+                          /* both callbacks are always called from the thread that called sok_solve() */
+    void *userdata;       /* passed as-is to the progress and cancel callbacks */
+  };
+
+  /* fills params with default values */
+  void sok_solve_defaults(struct soksolveparams *params);
+
+  /* searches for a push-optimal solution of game (unless params->macros is set), starting from its current position. returns a malloc()'ed string
+   * of moves in the LURD notation that can be fed to sok_play(), or NULL if no solution has been found (stats->result tells why).
+   * params and stats may be NULL. the solution does not depend on the number of threads. */
+  char *sok_solve(struct sokgame *game, struct soksolveparams *params, struct soksolvestats *stats);
+
+  /* deletes the checkpoint of the level of game, if any. to be called once the solution found by a search with checkpoints has been
+   * saved. */
+  void sok_solve_dropcheckpoint(struct sokgame *game);
+
+  /* returns a human string for a solver result */
+  char *sok_solve_strresult(enum SOKSOLVE result);
+
+#endif
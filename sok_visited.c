@@ -0,0 +1,485 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+/*
+ * A store of visited positions that does not need to fit in memory, for
+ * breadth-first searches larger than RAM. Duplicates are detected late,
+ * one layer at a time, the way external-memory BFS does it:
+ *
+ *  - positions of the layer being generated go to an open addressing hash
+ *    table, which drops the duplicates it sees. the table grows as needed,
+ *    and once it can't grow within the memory budget anymore, it is sorted
+ *    and written to disk as a run, then emptied.
+ *  - when the layer is over, all runs are merged with the sorted file of
+ *    every position seen so far. positions found in no earlier layer make
+ *    the new layer, which is appended to the file of layers, and the two
+ *    get merged into the new file of all positions.
+ *
+ * Between two layers, the store is nothing but these two files (plus the
+ * offsets of the layers), so it can be saved as a whole and restored by a
+ * later search, that picks up where the first one stopped.
+ *
+ * Positions are packed into fixed-size keys, compared with memcmp(): the
+ * player square (plus one, so that no key is ever all zeroes, which marks
+ * empty slots) on 13 bits, followed by the atoms as 12-bit square numbers,
+ * or as one bit per square of the level, whichever is shorter.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>             /* malloc(), free() */
+#include <string.h>             /* memset(), memcpy(), memcmp() */
+#include <time.h>               /* time() */
+#include "sok_visited.h"
+
+#define PLAYERBITS 13
+#define SQUAREBITS 12
+#define MAXRUNS 32              /* once that many runs are on disk, they are merged into one */
+#define MINSLOTS 1024
+#define COPYBUFFSIZE 65536      /* bytes copied at once when saving or restoring the store */
+
+struct spillfile {
+  FILE *fd;
+  char *path;             /* NULL for files created by tmpfile(), which delete themselves */
+};
+
+struct sokvisited {
+  int squares;
+  int boxes;
+  int keylen;             /* size of a packed position, in bytes */
+  int bitset;             /* non-zero if atoms are packed as one bit per square */
+  unsigned char *table;   /* hash table of the positions of the layer being generated */
+  long slotmask;
+  long count;
+  long maxcount;          /* the table grows, or is spilled to disk, once it holds that many positions */
+  long maxslots;          /* largest table the memory budget allows */
+  unsigned char *key;     /* scratch key */
+  unsigned char *heads;   /* current key of every input of a merge */
+  char *dir;
+  long filecount;
+  struct spillfile runs[MAXRUNS];
+  int runscount;
+  struct spillfile all;   /* every position of the closed layers, sorted */
+  struct spillfile layers; /* the closed layers, one after another, each of them sorted */
+  long *layerstart;       /* layer i goes from key layerstart[i] to key layerstart[i + 1] of the layers file */
+  long layerscount;
+  long layersalloc;
+  long readpos;           /* next key to read, and end of the layer being read */
+  long readend;
+  long memory;
+  long diskbytes;
+};
+
+static uint64_t hashkey(unsigned char *key, int keylen) {
+  uint64_t res = 0xcbf29ce484222325ull;
+  int i;
+  for (i = 0; i < keylen; i++) res = (res ^ key[i]) * 0x100000001b3ull;
+  return(res ^ (res >> 29));
+}
+
+/* appends the bits lowest bits of value to key, starting at bit *pos */
+static void putbits(unsigned char *key, long *pos, unsigned int value, int bits) {
+  while (bits > 0) {
+    bits -= 1;
+    if ((value >> bits) & 1) key[*pos >> 3] |= 0x80 >> (*pos & 7);
+    *pos += 1;
+  }
+}
+
+/* reads bits bits of key, starting at bit *pos */
+static unsigned int getbits(unsigned char *key, long *pos, int bits) {
+  unsigned int res = 0;
+  while (bits > 0) {
+    bits -= 1;
+    res = (res << 1) | ((key[*pos >> 3] >> (7 - (*pos & 7))) & 1);
+    *pos += 1;
+  }
+  return(res);
+}
+
+static void encode(struct sokvisited *v, uint16_t *state, unsigned char *key) {
+  long pos = 0, sqpos;
+  int i;
+  memset(key, 0, v->keylen);
+  putbits(key, &pos, state[0] + 1, PLAYERBITS);
+  for (i = 1; i <= v->boxes; i++) {
+    if (v->bitset != 0) {
+        sqpos = pos + state[i];
+        putbits(key, &sqpos, 1, 1);
+      } else {
+        putbits(key, &pos, state[i], SQUAREBITS);
+    }
+  }
+}
+
+static void decode(struct sokvisited *v, unsigned char *key, uint16_t *state) {
+  long pos = 0;
+  int i, sq;
+  state[0] = getbits(key, &pos, PLAYERBITS) - 1;
+  if (v->bitset == 0) {
+    for (i = 1; i <= v->boxes; i++) state[i] = getbits(key, &pos, SQUAREBITS);
+    return;
+  }
+  i = 1;
+  for (sq = 0; (sq < v->squares) && (i <= v->boxes); sq++) {
+    if (getbits(key, &pos, 1) != 0) state[i++] = sq;
+  }
+}
+
+/* creates a temporary file. returns 0 on success, non-zero otherwise. */
+static int openspill(struct sokvisited *v, struct spillfile *f) {
+  f->path = NULL;
+  if ((v->dir == NULL) || (v->dir[0] == 0)) {
+    f->fd = tmpfile();
+    return(f->fd == NULL);
+  }
+  f->path = malloc(strlen(v->dir) + 64);
+  if (f->path == NULL) return(-1);
+  sprintf(f->path, "%s/soksolve-%lx-%lx-%ld.tmp", v->dir, (unsigned long)time(NULL), (unsigned long)(size_t)v, v->filecount++);
+  f->fd = fopen(f->path, "w+b");
+  if (f->fd == NULL) {
+    free(f->path);
+    f->path = NULL;
+    return(-1);
+  }
+  return(0);
+}
+
+static void closespill(struct spillfile *f) {
+  if (f->fd != NULL) fclose(f->fd);
+  if (f->path != NULL) {
+    remove(f->path);
+    free(f->path);
+  }
+  f->fd = NULL;
+  f->path = NULL;
+}
+
+static int writekey(struct sokvisited *v, FILE *fd, unsigned char *key) {
+  if (fwrite(key, v->keylen, 1, fd) != 1) return(-1);
+  v->diskbytes += v->keylen;
+  return(0);
+}
+
+static void siftdown(unsigned char *keys, int keylen, long root, long count, unsigned char *swap) {
+  long child;
+  for (;;) {
+    child = root * 2 + 1;
+    if (child >= count) return;
+    if ((child + 1 < count) && (memcmp(keys + child * keylen, keys + (child + 1) * keylen, keylen) < 0)) child += 1;
+    if (memcmp(keys + root * keylen, keys + child * keylen, keylen) >= 0) return;
+    memcpy(swap, keys + root * keylen, keylen);
+    memcpy(keys + root * keylen, keys + child * keylen, keylen);
+    memcpy(keys + child * keylen, swap, keylen);
+    root = child;
+  }
+}
+
+/* sorts count keys in place. a heap sort, since it needs no memory besides the keys. */
+static void sortkeys(unsigned char *keys, int keylen, long count, unsigned char *swap) {
+  long i;
+  for (i = count / 2 - 1; i >= 0; i--) siftdown(keys, keylen, i, count, swap);
+  for (i = count - 1; i > 0; i--) {
+    memcpy(swap, keys, keylen);
+    memcpy(keys, keys + i * keylen, keylen);
+    memcpy(keys + i * keylen, swap, keylen);
+    siftdown(keys, keylen, 0, i, swap);
+  }
+}
+
+/* merges all runs, and the sorted file old if not NULL, into out, without duplicates. fresh, if not NULL, gets the positions that
+ * old does not have, and *freshcount their number. runs are deleted. returns 0 on success, non-zero on I/O error. */
+static int mergeruns(struct sokvisited *v, FILE *old, FILE *out, FILE *fresh, long *freshcount) {
+  FILE *inputs[MAXRUNS + 1];
+  int live[MAXRUNS + 1];
+  int count = 0, i, best, isold, res = 0;
+  for (i = 0; i < v->runscount; i++) inputs[count++] = v->runs[i].fd;
+  if (old != NULL) inputs[count++] = old;
+  for (i = 0; i < count; i++) {
+    rewind(inputs[i]);
+    live[i] = (fread(v->heads + i * v->keylen, v->keylen, 1, inputs[i]) == 1);
+  }
+  if (freshcount != NULL) *freshcount = 0;
+  for (;;) {
+    best = -1;
+    for (i = 0; i < count; i++) {
+      if (live[i] == 0) continue;
+      if ((best < 0) || (memcmp(v->heads + i * v->keylen, v->heads + best * v->keylen, v->keylen) < 0)) best = i;
+    }
+    if (best < 0) break;
+    memcpy(v->key, v->heads + best * v->keylen, v->keylen);
+    isold = (old != NULL) && (live[count - 1] != 0) && (memcmp(v->heads + (count - 1) * v->keylen, v->key, v->keylen) == 0);
+    if (writekey(v, out, v->key) != 0) res = -1;
+    if ((fresh != NULL) && (isold == 0)) {
+      if (writekey(v, fresh, v->key) != 0) res = -1;
+      *freshcount += 1;
+    }
+    if (res != 0) break;
+    /* skip the key in every input that has it */
+    for (i = 0; i < count; i++) {
+      if ((live[i] == 0) || (memcmp(v->heads + i * v->keylen, v->key, v->keylen) != 0)) continue;
+      live[i] = (fread(v->heads + i * v->keylen, v->keylen, 1, inputs[i]) == 1);
+    }
+  }
+  for (i = 0; i < count; i++) {
+    if (ferror(inputs[i])) res = -1;
+  }
+  for (i = 0; i < v->runscount; i++) closespill(&(v->runs[i]));
+  v->runscount = 0;
+  if ((fflush(out) != 0) || ((fresh != NULL) && (fflush(fresh) != 0))) res = -1;
+  return(res);
+}
+
+/* writes the content of the table to disk as a sorted run, and empties it. returns 0 on success, non-zero on I/O error. */
+static int spill(struct sokvisited *v) {
+  struct spillfile merged;
+  long i, count = 0;
+  if (v->count == 0) return(0);
+  /* gather the keys at the start of the table */
+  for (i = 0; i <= v->slotmask; i++) {
+    if ((v->table[i * v->keylen] | v->table[i * v->keylen + 1]) == 0) continue;
+    if (i != count) memcpy(v->table + count * v->keylen, v->table + i * v->keylen, v->keylen);
+    count += 1;
+  }
+  sortkeys(v->table, v->keylen, count, v->key);
+  if (openspill(v, &(v->runs[v->runscount])) != 0) return(-1);
+  v->runscount += 1;
+  if (fwrite(v->table, v->keylen, count, v->runs[v->runscount - 1].fd) != (size_t)count) return(-1);
+  v->diskbytes += count * v->keylen;
+  memset(v->table, 0, (v->slotmask + 1) * v->keylen);
+  v->count = 0;
+  if (v->runscount < MAXRUNS) return(0);
+  /* too many files open: merge them all into one */
+  if (openspill(v, &merged) != 0) return(-1);
+  if (mergeruns(v, NULL, merged.fd, NULL, NULL) != 0) {
+    closespill(&merged);
+    return(-1);
+  }
+  v->runs[0] = merged;
+  v->runscount = 1;
+  return(0);
+}
+
+struct sokvisited *sok_visited_new(int squares, int boxes, long budget, char *dir) {
+  struct sokvisited *v;
+  long slots = MINSLOTS, maxslots = MINSLOTS;
+  v = calloc(1, sizeof(struct sokvisited));
+  if (v == NULL) return(NULL);
+  v->squares = squares;
+  v->boxes = boxes;
+  v->bitset = (squares < boxes * SQUAREBITS);
+  v->keylen = (PLAYERBITS + ((v->bitset != 0) ? squares : boxes * SQUAREBITS) + 7) / 8;
+  /* the table starts small, and may grow up to the budget (minus the half it takes while growing) */
+  while ((maxslots * 3) * v->keylen <= budget) maxslots *= 2;
+  v->maxslots = maxslots;
+  v->slotmask = slots - 1;
+  v->maxcount = slots / 4 * 3;
+  v->table = calloc(slots, v->keylen);
+  v->key = malloc(v->keylen);
+  v->heads = malloc((MAXRUNS + 1) * v->keylen);
+  v->layersalloc = 64;
+  v->layerstart = malloc(sizeof(long) * v->layersalloc);
+  if ((dir != NULL) && (dir[0] != 0)) {
+    v->dir = malloc(strlen(dir) + 1);
+    if (v->dir != NULL) strcpy(v->dir, dir);
+  }
+  v->memory = sizeof(struct sokvisited) + slots * v->keylen + (MAXRUNS + 2) * v->keylen + sizeof(long) * v->layersalloc;
+  if ((v->table == NULL) || (v->key == NULL) || (v->heads == NULL) || (v->layerstart == NULL) || ((dir != NULL) && (dir[0] != 0) && (v->dir == NULL))) {
+    sok_visited_free(v);
+    return(NULL);
+  }
+  v->layerstart[0] = 0;
+  if ((openspill(v, &(v->all)) != 0) || (openspill(v, &(v->layers)) != 0)) {
+    sok_visited_free(v);
+    return(NULL);
+  }
+  return(v);
+}
+
+void sok_visited_free(struct sokvisited *v) {
+  int i;
+  if (v == NULL) return;
+  for (i = 0; i < v->runscount; i++) closespill(&(v->runs[i]));
+  closespill(&(v->all));
+  closespill(&(v->layers));
+  if (v->table != NULL) free(v->table);
+  if (v->key != NULL) free(v->key);
+  if (v->heads != NULL) free(v->heads);
+  if (v->layerstart != NULL) free(v->layerstart);
+  if (v->dir != NULL) free(v->dir);
+  free(v);
+}
+
+/* doubles the size of the table. returns 0 on success, non-zero if out of memory. */
+static int grow(struct sokvisited *v) {
+  unsigned char *newtable, *key, *slot;
+  long slots = (v->slotmask + 1) * 2, i, j;
+  newtable = calloc(slots, v->keylen);
+  if (newtable == NULL) return(-1);
+  for (i = 0; i <= v->slotmask; i++) {
+    key = v->table + i * v->keylen;
+    if ((key[0] | key[1]) == 0) continue;
+    for (j = hashkey(key, v->keylen) & (slots - 1);; j = (j + 1) & (slots - 1)) {
+      slot = newtable + j * v->keylen;
+      if ((slot[0] | slot[1]) == 0) break;
+    }
+    memcpy(slot, key, v->keylen);
+  }
+  free(v->table);
+  v->memory += (slots / 2) * v->keylen;
+  v->table = newtable;
+  v->slotmask = slots - 1;
+  v->maxcount = slots / 4 * 3;
+  return(0);
+}
+
+int sok_visited_add(struct sokvisited *v, uint16_t *state) {
+  unsigned char *slot;
+  long i;
+  encode(v, state, v->key);
+  for (i = hashkey(v->key, v->keylen) & v->slotmask;; i = (i + 1) & v->slotmask) {
+    slot = v->table + i * v->keylen;
+    if ((slot[0] | slot[1]) == 0) break;
+    if (memcmp(slot, v->key, v->keylen) == 0) return(0);
+  }
+  memcpy(slot, v->key, v->keylen);
+  v->count += 1;
+  if (v->count < v->maxcount) return(0);
+  if ((v->slotmask + 1 < v->maxslots) && (grow(v) == 0)) return(0);
+  return(spill(v));
+}
+
+long sok_visited_nextlayer(struct sokvisited *v) {
+  struct spillfile all;
+  long freshcount;
+  if (v->layerscount + 1 == v->layersalloc) {
+    long *newstart;
+    newstart = realloc(v->layerstart, sizeof(long) * v->layersalloc * 2);
+    if (newstart == NULL) return(-1);
+    v->memory += sizeof(long) * v->layersalloc;
+    v->layersalloc *= 2;
+    v->layerstart = newstart;
+  }
+  if (spill(v) != 0) return(-1);
+  if (openspill(v, &all) != 0) return(-1);
+  if (fseek(v->layers.fd, 0, SEEK_END) != 0) {
+    closespill(&all);
+    return(-1);
+  }
+  if (mergeruns(v, v->all.fd, all.fd, v->layers.fd, &freshcount) != 0) {
+    closespill(&all);
+    return(-1);
+  }
+  closespill(&(v->all));
+  v->all = all;
+  v->layerscount += 1;
+  v->layerstart[v->layerscount] = v->layerstart[v->layerscount - 1] + freshcount;
+  return(freshcount);
+}
+
+int sok_visited_rewind(struct sokvisited *v, int layer) {
+  if ((layer < 0) || (layer >= v->layerscount)) return(-1);
+  v->readpos = v->layerstart[layer];
+  v->readend = v->layerstart[layer + 1];
+  if (fseek(v->layers.fd, v->readpos * v->keylen, SEEK_SET) != 0) return(-1);
+  return(0);
+}
+
+int sok_visited_read(struct sokvisited *v, uint16_t *state) {
+  if (v->readpos == v->readend) return(0);
+  if (fread(v->key, v->keylen, 1, v->layers.fd) != 1) return(-1);
+  v->readpos += 1;
+  decode(v, v->key, state);
+  return(1);
+}
+
+/* copies count keys from the current position of in to the current position of out. returns 0 on success, non-zero otherwise. */
+static int copykeys(struct sokvisited *v, FILE *in, FILE *out, long count) {
+  unsigned char *buff;
+  long chunk, n;
+  int res = 0;
+  chunk = COPYBUFFSIZE / v->keylen;
+  buff = malloc(chunk * v->keylen);
+  if (buff == NULL) return(-1);
+  while ((count > 0) && (res == 0)) {
+    n = (count < chunk) ? count : chunk;
+    if ((fread(buff, v->keylen, n, in) != (size_t)n) || (fwrite(buff, v->keylen, n, out) != (size_t)n)) res = -1;
+    count -= n;
+  }
+  free(buff);
+  return(res);
+}
+
+int sok_visited_save(struct sokvisited *v, FILE *fd) {
+  int32_t keylen = v->keylen;
+  int64_t layerscount = v->layerscount, start;
+  long i;
+  if ((v->count != 0) || (v->runscount != 0)) return(-1);
+  if ((fwrite(&keylen, sizeof(keylen), 1, fd) != 1) || (fwrite(&layerscount, sizeof(layerscount), 1, fd) != 1)) return(-1);
+  for (i = 0; i <= v->layerscount; i++) {
+    start = v->layerstart[i];
+    if (fwrite(&start, sizeof(start), 1, fd) != 1) return(-1);
+  }
+  /* every position seen so far, sorted, then the layers one after another */
+  rewind(v->all.fd);
+  rewind(v->layers.fd);
+  if (copykeys(v, v->all.fd, fd, v->layerstart[v->layerscount]) != 0) return(-1);
+  if (copykeys(v, v->layers.fd, fd, v->layerstart[v->layerscount]) != 0) return(-1);
+  return(0);
+}
+
+long sok_visited_restore(struct sokvisited *v, FILE *fd) {
+  int32_t keylen;
+  int64_t layerscount, start;
+  long i;
+  if ((v->layerscount != 0) || (fread(&keylen, sizeof(keylen), 1, fd) != 1) || (fread(&layerscount, sizeof(layerscount), 1, fd) != 1)) return(-1);
+  if ((keylen != v->keylen) || (layerscount < 1) || (layerscount > 0x7fffffffl)) return(-1);
+  if (layerscount + 1 >= v->layersalloc) {
+    long *newstart;
+    newstart = realloc(v->layerstart, sizeof(long) * (layerscount + 2));
+    if (newstart == NULL) return(-1);
+    v->memory += sizeof(long) * (layerscount + 2 - v->layersalloc);
+    v->layersalloc = layerscount + 2;
+    v->layerstart = newstart;
+  }
+  for (i = 0; i <= layerscount; i++) {
+    if (fread(&start, sizeof(start), 1, fd) != 1) return(-1);
+    if ((start < ((i > 0) ? v->layerstart[i - 1] : 0)) || ((i == 0) && (start != 0))) return(-1);
+    v->layerstart[i] = start;
+  }
+  v->layerscount = layerscount;
+  if (copykeys(v, fd, v->all.fd, v->layerstart[v->layerscount]) != 0) return(-1);
+  if (copykeys(v, fd, v->layers.fd, v->layerstart[v->layerscount]) != 0) return(-1);
+  if ((fflush(v->all.fd) != 0) || (fflush(v->layers.fd) != 0)) return(-1);
+  v->diskbytes += v->layerstart[v->layerscount] * v->keylen * 2;
+  return(v->layerstart[v->layerscount] - v->layerstart[v->layerscount - 1]);
+}
+
+long sok_visited_count(struct sokvisited *v) {
+  return(v->layerstart[v->layerscount]);
+}
+
+long sok_visited_memory(struct sokvisited *v) {
+  return(v->memory);
+}
+
+long sok_visited_diskbytes(struct sokvisited *v) {
+  return(v->diskbytes);
+}
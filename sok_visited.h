@@ -0,0 +1,68 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef sok_visited_h_sentinel
+#define sok_visited_h_sentinel
+
+  #include <stdint.h>
+  #include <stdio.h>
+
+  struct sokvisited;
+
+  /* creates an empty store for positions made of a player square followed by the sorted squares of boxes atoms, on a level of
+   * squares squares (at most 4096). budget is the max amount of bytes the store keeps in memory, whatever does not fit goes to
+   * temporary files in dir (or in the system's temporary directory if dir is NULL or empty). returns NULL on error. */
+  struct sokvisited *sok_visited_new(int squares, int boxes, long budget, char *dir);
+
+  /* releases the store and deletes its files */
+  void sok_visited_free(struct sokvisited *v);
+
+  /* adds a position to the layer being generated. it may still be a duplicate of a position seen before, that's only sorted out
+   * by sok_visited_nextlayer(). returns 0 on success, non-zero on I/O error. */
+  int sok_visited_add(struct sokvisited *v, uint16_t *state);
+
+  /* closes the layer being generated: all the positions it got that have never been seen before become the newest layer. returns
+   * the number of positions of that layer, or -1 on I/O error. */
+  long sok_visited_nextlayer(struct sokvisited *v);
+
+  /* starts reading the positions of a layer (0 being the first one ever closed). returns 0 on success, non-zero otherwise. */
+  int sok_visited_rewind(struct sokvisited *v, int layer);
+
+  /* reads the next position of the layer being read into state. returns 1 if a position has been read, 0 once the layer is over,
+   * or -1 on I/O error. layers are read in no particular order, but always in the same one. */
+  int sok_visited_read(struct sokvisited *v, uint16_t *state);
+
+  /* writes the whole store (all the layers closed so far) to fd, at its current position. only possible between two layers, ie.
+   * when nothing has been added since the last sok_visited_nextlayer(). returns 0 on success, non-zero otherwise. */
+  int sok_visited_save(struct sokvisited *v, FILE *fd);
+
+  /* fills an empty store, created for the same level, with what sok_visited_save() wrote to fd. returns the number of positions of
+   * the newest layer, or -1 on error (the store must then be freed). */
+  long sok_visited_restore(struct sokvisited *v, FILE *fd);
+
+  /* number of distinct positions in all the layers closed so far */
+  long sok_visited_count(struct sokvisited *v);
+
+  /* amount of bytes the store took: in memory, and written to disk so far */
+  long sok_visited_memory(struct sokvisited *v);
+  long sok_visited_diskbytes(struct sokvisited *v);
+
+#endif
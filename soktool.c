@@ -0,0 +1,1470 @@
+/*
+ * This file is part of the 'Simple Sokoban' project.
+ *
+ * Copyright (C) Mateusz Viste 2014
+ *
+ * ----------------------------------------------------------------------
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------
+ */
+
+/*
+ * soktool is the command-line companion of Simple Sokoban. It runs the
+ * sok_core engine headless (no window is ever created), and is meant for
+ * batch jobs and benchmarks over level sets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>             /* malloc() */
+#include <string.h>             /* strcmp() */
+#include <time.h>               /* clock() */
+#ifndef _WIN32
+#include <sys/resource.h>       /* getrusage() */
+#endif
+#include <SDL2/SDL.h>           /* SDL_GetCPUCount() */
+#include "sok_core.h"
+#include "sok_bits.h"
+#include "sok_deadlock.h"
+#include "sok_lowerbound.h"
+#include "sok_optimize.h"
+#include "sok_pdb.h"
+#include "sok_solve.h"
+#include "save.h"
+
+#define DEFAULT_LEVELFILE "levels/microban.xsb"
+
+#define BENCH_SWEEP_ROUNDS 20000
+#define BENCH_DEADLOCK_PUSHES 200000
+#define BENCH_REACH_ROUNDS 20000
+#define BENCH_BOUND_MOVES 200000
+#define BENCH_BOUND_MAXNODES 50000
+#define BENCH_MACROS_MAXNODES 1000000
+#define PROFILE_MAXNODES 1000000
+#define BENCH_LOAD_COPIES 200
+#define BENCH_LOAD_ROUNDS 3
+
+/* a result accumulator, so the compiler can't optimize the benchmarked loops away */
+static volatile long benchsink;
+
+static void help(void) {
+  puts("usage: soktool command [parameters]\n"
+       "\n"
+       "commands:\n"
+       "  bench-sweep [file.xsb]  compares full-board sweep throughput of the former\n"
+       "                          column-major field layout and the row-major one\n"
+       "  solve [file.xsb] [level] [maxnodes]\n"
+       "                          solves every level of a file (or only one of them)\n"
+       "                          and reports pushes, moves and nodes/s of each");
+  puts("  solve-disk [file.xsb] [level] [budget KiB] [dir] [checkpoint s]\n"
+       "                          solves levels breadth-first, keeping only budget KiB\n"
+       "                          of visited positions in memory and the others on disk\n"
+       "                          (in dir, - for the temporary directory). with a\n"
+       "                          checkpoint interval, the search is saved that often and\n"
+       "                          resumed by the next run, and solutions get saved");
+  puts("  bench-solve [file.xsb] [level] [maxnodes]\n"
+       "                          runs the solver with 1, 2, 4, 8 and one thread per CPU,\n"
+       "                          and reports nodes/s and peak memory of each run");
+  puts("  bench-deadlock [file.xsb ...]\n"
+       "                          plays random pushes on every level of the given files\n"
+       "                          (all bundled sets by default) and reports how many\n"
+       "                          deadlock verdicts per second sok_deadlock_check() makes\n"
+       "  bench-reach             times sok_reach() on the largest boards allowed");
+  puts("  bench-bound [maxnodes] [file.xsb ...]\n"
+       "                          reports how many lower bound evaluations per second\n"
+       "                          are made (incremental and from scratch), and how many\n"
+       "                          nodes the solver saves with the bound, compared to a\n"
+       "                          plain breadth-first search");
+  puts("  pdb-build [file.xsb] [level] [budget KiB]\n"
+       "                          builds the pattern databases of the levels of a file\n"
+       "                          (or of only one of them) in the save directory\n"
+       "  bench-pdb [file.xsb] [level] [maxnodes]\n"
+       "                          solves levels with and without their pattern database,\n"
+       "                          and reports the speedup");
+  puts("  bench-bidir [file.xsb] [level] [maxnodes]\n"
+       "                          solves levels forward only (breadth-first and A*) and\n"
+       "                          from both ends at once, and reports how they compare");
+  puts("  bench-macros [file.xsb] [level] [maxnodes]\n"
+       "                          solves levels without macro pushes, with tunnel macros\n"
+       "                          and with goal room macros too, and reports the nodes\n"
+       "                          and pushes of each");
+  puts("  optimize [file.xsb] [level] [window] [maxnodes]\n"
+       "                          shortens the saved solutions of the levels of a file\n"
+       "                          (or of only one of them), one level per thread, and\n"
+       "                          saves those that got better");
+  puts("  verify [file.xsb ...]   replays the saved solution of every level of the given\n"
+       "                          files (all bundled sets by default), one level per\n"
+       "                          thread, and reports which are valid, invalid or missing");
+  puts("  profile [file.xsb] [maxnodes] [sorted.xsb]\n"
+       "                          measures every level of a file (atoms, area, ratio of\n"
+       "                          dead squares, solver nodes and time to a first solution)\n"
+       "                          on one level per thread, prints them as CSV, and writes\n"
+       "                          the set sorted from the easiest level to sorted.xsb");
+  puts("  bench-load [copies] [file.xsb ...]\n"
+       "                          indexes a large set made of copies of the given files\n"
+       "                          (all bundled sets by default) one after another, with\n"
+       "                          1, 2, 4, 8 and one thread per CPU, and reports the time\n"
+       "                          each takes");
+}
+
+/* returns the amount of seconds elapsed since start, never 0 */
+static double elapsed(clock_t start) {
+  double res;
+  res = (double)(clock() - start) / CLOCKS_PER_SEC;
+  if (res <= 0) res = 1.0 / CLOCKS_PER_SEC;
+  return(res);
+}
+
+/* loads all the levels of a set at once, so they can be handed over to worker threads (sok_getlevel() isn't thread-safe), and
+ * lists them in a malloc()'ed *gamelist. the levels live in the same allocation, right after the list (rounded up to keep them
+ * aligned), so freeing the list frees them too. returns the number of levels, or 0 if memory runs out (the set is freed then). */
+static int getlevels(struct soklevelset *set, struct sokgame ***gamelist) {
+  struct sokgame *games;
+  long listsize;
+  int i;
+  listsize = (sizeof(struct sokgame *) * set->count + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+  *gamelist = malloc(listsize + sizeof(struct sokgame) * set->count);
+  if (*gamelist != NULL) {
+    games = (struct sokgame *)((unsigned char *)(*gamelist) + listsize);
+    for (i = 0; i < set->count; i++) {
+      (*gamelist)[i] = games + i;
+      if (sok_getlevel(set, i, games + i) == 0) continue;
+      free(*gamelist);
+      *gamelist = NULL;
+      break;
+    }
+  }
+  if (*gamelist == NULL) {
+    sok_freefile(set);
+    return(0);
+  }
+  return(set->count);
+}
+
+/* loads a level file into set and a malloc()'ed *gamelist, and prints an error if it fails. returns the number of levels loaded. */
+static int loadlevels(struct soklevelset *set, struct sokgame ***gamelist, char *levelfile) {
+  char comment[64];
+  int levelscount;
+  levelscount = sok_loadfile(set, levelfile, NULL, 0, comment, sizeof(comment), 0);
+  if (levelscount < 1) {
+    printf("Failed to load the level file '%s' [%d]: %s\n", levelfile, levelscount, sok_strerr(levelscount));
+    return(levelscount);
+  }
+  levelscount = getlevels(set, gamelist);
+  if (levelscount < 1) printf("Out of memory while loading the levels of '%s'\n", levelfile);
+  return(levelscount);
+}
+
+/* sweeps over every level of a file, the way sok_checksolution() and the drawing routines used to do (y outer, x inner), once with the
+ * field stored column after column (the former field[x][y] layout), and once with the current row-major layout. */
+static int bench_sweep(char *levelfile) {
+  struct sokgame **gamelist;
+  struct soklevelset levelset;
+  static unsigned char colmajor[64][64];
+  int levelscount, i, x, y, round;
+  long tiles = 0, res;
+  double colsecs = 0, rowsecs = 0;
+  clock_t start;
+  levelscount = loadlevels(&levelset, &gamelist, levelfile);
+  if (levelscount < 1) return(1);
+  for (i = 0; i < levelscount; i++) {
+    struct sokgame *game = gamelist[i];
+    /* build a column-major copy of the field */
+    for (y = 0; y < 64; y++) {
+      for (x = 0; x < 64; x++) colmajor[x][y] = game->field[y * field_stride + x];
+    }
+    tiles += (long)game->field_width * game->field_height * BENCH_SWEEP_ROUNDS;
+    /* column-major sweep: count empty goals and tiles that have a wall on their right */
+    res = 0;
+    start = clock();
+    for (round = 0; round < BENCH_SWEEP_ROUNDS; round++) {
+      for (y = 1; y <= game->field_height; y++) {
+        for (x = 1; x <= game->field_width; x++) {
+          if ((colmajor[x][y] & (field_goal | field_atom)) == field_goal) res += 1;
+          if (colmajor[x + 1][y] & field_wall) res += 1;
+        }
+      }
+    }
+    colsecs += elapsed(start);
+    benchsink += res;
+    /* row-major sweep: same work */
+    res = 0;
+    start = clock();
+    for (round = 0; round < BENCH_SWEEP_ROUNDS; round++) {
+      for (y = 0; y < game->field_height; y++) {
+        unsigned char *tile = &(sok_field(game, 0, y));
+        for (x = 0; x < game->field_width; x++) {
+          if ((tile[x] & (field_goal | field_atom)) == field_goal) res += 1;
+          if (tile[x + 1] & field_wall) res += 1;
+        }
+      }
+    }
+    rowsecs += elapsed(start);
+    benchsink -= res;
+  }
+  printf("%d levels, %ld tiles swept per layout\n", levelscount, tiles);
+  printf("column-major (field[x][y]): %8.3fs  %7.1f Mtiles/s\n", colsecs, tiles / colsecs / 1000000.0);
+  printf("row-major (sok_field):      %8.3fs  %7.1f Mtiles/s\n", rowsecs, tiles / rowsecs / 1000000.0);
+  printf("speedup: %.2fx\n", colsecs / rowsecs);
+  if (benchsink != 0) puts("WARNING: both sweeps did not compute the same result!");
+  sok_freefile(&levelset);
+  free(gamelist);
+  return(0);
+}
+
+/* replays a LURD string on a bitboard copy of game (so no solution gets saved on the way). returns non-zero if it solves the level. */
+static int checksolution(struct sokgame *game, char *solution) {
+  struct sokbitboard bits;
+  enum SOKMOVE dir;
+  sok_bits_fromgame(&bits, game);
+  for (; *solution != 0; solution++) {
+    switch (*solution) {
+      case 'u':
+      case 'U':
+        dir = sokmoveUP;
+        break;
+      case 'r':
+      case 'R':
+        dir = sokmoveRIGHT;
+        break;
+      case 'd':
+      case 'D':
+        dir = sokmoveDOWN;
+        break;
+      case 'l':
+      case 'L':
+        dir = sokmoveLEFT;
+        break;
+      default:
+        return(0);
+    }
+    if (sok_bits_move(&bits, dir) < 0) return(0);
+  }
+  return(sok_bits_solved(&bits));
+}
+
+/* runs the solver on one level (or all levels) of a file */
+static int solvelevels(char *levelfile, int level, struct soksolveparams *params) {
+  struct sokgame **gamelist;
+  struct soklevelset levelset;
+  struct soksolvestats stats;
+  int levelscount, i, solved = 0, pushes;
+  long totalnodes = 0, totalms = 0, moves;
+  char *solution, *c;
+  levelscount = loadlevels(&levelset, &gamelist, levelfile);
+  if (levelscount < 1) return(1);
+  if (level > levelscount) {
+    printf("The level file '%s' contains only %d levels\n", levelfile, levelscount);
+    sok_freefile(&levelset);
+    free(gamelist);
+    return(1);
+  }
+  for (i = 0; i < levelscount; i++) {
+    if ((level > 0) && (i + 1 != level)) continue;
+    solution = sok_solve(gamelist[i], params, &stats);
+    totalnodes += stats.nodes;
+    totalms += stats.elapsedms;
+    if (solution == NULL) {
+      printf("level %3d: %s (%ld nodes, %ld ms)\n", i + 1, sok_solve_strresult(stats.result), stats.nodes, stats.elapsedms);
+      continue;
+    }
+    pushes = 0;
+    for (c = solution; *c != 0; c++) if ((*c >= 'A') && (*c <= 'Z')) pushes++;
+    printf("level %3d: %4d pushes %5d moves  %9ld nodes %7ld ms %9.0f nodes/s  %ld KiB", i + 1, pushes, (int)strlen(solution), stats.nodes, stats.elapsedms, stats.nodes * 1000.0 / (stats.elapsedms > 0 ? stats.elapsedms : 1), stats.memory / 1024);
+    if (params->spilldir != NULL) printf(" (%ld KiB on disk)", stats.diskbytes / 1024);
+    if (stats.resumed > 0) printf(" (%d layers from a checkpoint)", stats.resumed);
+    if (checksolution(gamelist[i], solution) == 0) {
+        printf("  INVALID SOLUTION!\n");
+      } else if (params->checkpointms > 0) {
+        /* a background search: keep what it found (unless a better solution is known already, ranked the way sok_checksolution()
+         * does: fewer moves, then fewer pushes), then its checkpoint can go */
+        moves = sok_history_getlen(solution);
+        if ((gamelist[i]->solutionlen < 1) || (gamelist[i]->solutionlen > moves)
+          || ((gamelist[i]->solutionlen == moves) && (gamelist[i]->solutionpushes > sok_history_getpushes(solution)))) {
+          solution_save(gamelist[i]->crc32, solution, "dat");
+          printf("  saved");
+        }
+        sok_solve_dropcheckpoint(gamelist[i]);
+        printf("\n");
+      } else {
+        printf("\n");
+    }
+    solved += 1;
+    free(solution);
+  }
+  printf("solved %d level(s), %ld nodes in %ld ms (%.0f nodes/s)\n", solved, totalnodes, totalms, totalnodes * 1000.0 / (totalms > 0 ? totalms : 1));
+  sok_freefile(&levelset);
+  free(gamelist);
+  return(0);
+}
+
+static int solve(char *levelfile, int level, long maxnodes) {
+  struct soksolveparams params;
+  sok_solve_defaults(&params);
+  params.maxnodes = maxnodes;
+  return(solvelevels(levelfile, level, &params));
+}
+
+/* runs the breadth-first solver over a visited store on disk, with budget bytes of memory, saving a checkpoint every checkpointsecs
+ * seconds (0 = never) */
+static int solve_disk(char *levelfile, int level, long budget, char *dir, long checkpointsecs) {
+  struct soksolveparams params;
+  sok_solve_defaults(&params);
+  if (budget > 0) params.maxmemory = budget;
+  params.spilldir = ((dir != NULL) && (strcmp(dir, "-") != 0)) ? dir : "";
+  params.checkpointms = checkpointsecs * 1000;
+  printf("visited positions kept in %ld KiB of memory, the rest in %s\n", params.maxmemory / 1024, (params.spilldir[0] != 0) ? params.spilldir : "the temporary directory");
+  if (checkpointsecs > 0) printf("checkpoint saved every %ld s, solutions found are saved\n", checkpointsecs);
+  return(solvelevels(levelfile, level, &params));
+}
+
+/* plays random pushes on every level of a file, checking each of them for deadlocks. pushes that lead to a deadlock are reverted,
+ * so the game keeps wandering through live positions. adds the number of verdicts to *verdicts and the time spent to *secs. */
+static int bench_deadlock_file(char *levelfile, long *verdicts, long *deadlocks, double *secs) {
+  static const int vectors[4] = {-field_stride, 1, field_stride, -1};
+  struct sokgame **gamelist, *game;
+  struct soklevelset levelset;
+  int levelscount, i, atoms, *atomtiles, tile, a, d;
+  long push;
+  enum SOKDEADLOCK verdict;
+  clock_t start;
+  atomtiles = malloc(sizeof(int) * field_tiles);
+  if (atomtiles == NULL) return(1);
+  levelscount = loadlevels(&levelset, &gamelist, levelfile);
+  if (levelscount < 1) {
+    free(atomtiles);
+    return(1);
+  }
+  srand(1);
+  for (i = 0; i < levelscount; i++) {
+    game = gamelist[i];
+    atoms = 0;
+    for (tile = 0; tile < field_tiles; tile++) {
+      if (game->field[tile] & field_atom) atomtiles[atoms++] = tile;
+    }
+    if (atoms == 0) continue;
+    start = clock();
+    for (push = 0; push < BENCH_DEADLOCK_PUSHES / levelscount; push++) {
+      /* pick an atom and a direction, push it if the player has some room behind it (whether he can get there or not) */
+      a = rand() % atoms;
+      d = rand() % 4;
+      tile = atomtiles[a];
+      if ((game->field[tile - vectors[d]] & (field_wall | field_atom)) || (game->field[tile + vectors[d]] & (field_wall | field_atom))) continue;
+      game->field[tile] &= ~field_atom;
+      game->field[tile + vectors[d]] |= field_atom;
+      game->positionx = tile % field_stride - 1;
+      game->positiony = tile / field_stride - 1;
+      verdict = sok_deadlock_check(game, tile + vectors[d]);
+      *verdicts += 1;
+      if (verdict != sokdeadlockNONE) {
+          *deadlocks += 1;
+          game->field[tile + vectors[d]] &= ~field_atom;
+          game->field[tile] |= field_atom;
+        } else {
+          atomtiles[a] = tile + vectors[d];
+      }
+    }
+    *secs += elapsed(start);
+  }
+  sok_freefile(&levelset);
+  free(gamelist);
+  free(atomtiles);
+  return(0);
+}
+
+/* runs the deadlock checks benchmark over a list of level files */
+static int bench_deadlock(char **levelfiles, int count) {
+  static char *defaultfiles[] = {"levels/microban.xsb", "levels/sasquatch.xsb", "levels/sasquatch3.xsb"};
+  long verdicts, deadlocks, totalverdicts = 0;
+  double secs, totalsecs = 0;
+  int i;
+  if (count == 0) {
+    levelfiles = defaultfiles;
+    count = 3;
+  }
+  for (i = 0; i < count; i++) {
+    verdicts = 0;
+    deadlocks = 0;
+    secs = 0;
+    if (bench_deadlock_file(levelfiles[i], &verdicts, &deadlocks, &secs) != 0) return(1);
+    printf("%-24s %9ld verdicts (%5.1f%% deadlocks)  %10.0f verdicts/s\n", levelfiles[i], verdicts, deadlocks * 100.0 / (verdicts > 0 ? verdicts : 1), verdicts / secs);
+    totalverdicts += verdicts;
+    totalsecs += secs;
+  }
+  printf("total: %ld verdicts in %.3fs, %.0f verdicts/s\n", totalverdicts, totalsecs, totalverdicts / totalsecs);
+  return(0);
+}
+
+/* builds a board of the largest size allowed: all floor if serpentine is zero, or else a single corridor winding through columns */
+static void buildlargeboard(struct sokgame *game, int serpentine) {
+  int x, y;
+  memset(game, 0, sizeof(struct sokgame));
+  game->field_width = 62;
+  game->field_height = 62;
+  for (y = -1; y < 63; y++) {
+    for (x = -1; x < 63; x++) {
+      sok_field(game, x, y) = field_floor;
+      if ((x < 0) || (y < 0) || (x > 61) || (y > 61)) sok_field(game, x, y) = field_wall;
+      /* every odd column is a wall, with a gap alternately at the bottom and at the top */
+      if ((serpentine != 0) && (x >= 0) && (x < 62) && (y >= 0) && (y < 62) && (x & 1)) {
+        if (y != (((x / 2) & 1) ? 0 : 61)) sok_field(game, x, y) = field_wall;
+      }
+    }
+  }
+}
+
+struct boundbench {
+  long updates;         /* incremental evaluations */
+  double updatesecs;
+  long computes;        /* evaluations from scratch */
+  double computesecs;
+  int levels;
+  int bfssolved;        /* levels solved by the breadth-first search */
+  int astarsolved;      /* levels solved with the bound */
+  long bfsnodes;        /* nodes of both searches, counted on levels both of them solved */
+  long astarnodes;
+};
+
+/* moves atoms around at random on every level of a file, evaluating the lower bound after each move, incrementally and from scratch.
+ * then solves every level with and without the bound. */
+static int bench_bound_file(char *levelfile, long maxnodes, struct boundbench *res) {
+  static const int vectors[4] = {-field_stride, 1, field_stride, -1};
+  struct sokgame **gamelist, *game;
+  struct soklevelset levelset;
+  struct soklowerbound *bound;
+  struct sokmatching *matching;
+  struct soksolveparams params;
+  struct soksolvestats bfsstats, astarstats;
+  int levelscount, i, pass, atoms, *atomtiles, tile, a, d;
+  long moves, attempt, value;
+  char *solution;
+  clock_t start;
+  game = malloc(sizeof(struct sokgame));
+  atomtiles = malloc(sizeof(int) * field_tiles);
+  if ((game == NULL) || (atomtiles == NULL)) {
+    if (game != NULL) free(game);
+    if (atomtiles != NULL) free(atomtiles);
+    return(1);
+  }
+  levelscount = loadlevels(&levelset, &gamelist, levelfile);
+  if (levelscount < 1) {
+    free(game);
+    free(atomtiles);
+    return(1);
+  }
+  sok_solve_defaults(&params);
+  params.maxnodes = maxnodes;
+  for (i = 0; i < levelscount; i++) {
+    bound = sok_lowerbound_new(gamelist[i]);
+    if (bound == NULL) continue;
+    matching = sok_lowerbound_newmatching(bound);
+    if (matching == NULL) {
+      sok_lowerbound_free(bound);
+      continue;
+    }
+    /* both passes play the same pushes: the first one updates the bound after each, the second one computes it from scratch */
+    for (pass = 0; pass < 2; pass++) {
+      memcpy(game, gamelist[i], sizeof(struct sokgame));
+      atoms = 0;
+      for (tile = 0; tile < field_tiles; tile++) {
+        if ((game->field[tile] & (field_floor | field_wall | field_atom)) == (field_floor | field_atom)) atomtiles[atoms++] = tile;
+      }
+      value = sok_lowerbound_compute(bound, matching, atomtiles);
+      srand(i);
+      moves = 0;
+      start = clock();
+      for (attempt = 0; (moves < BENCH_BOUND_MOVES / levelscount) && (attempt < BENCH_BOUND_MOVES); attempt++) {
+        /* pick an atom and a direction, and move it there if that's free floor (the bound doesn't care whether it could be pushed) */
+        a = rand() % atoms;
+        d = rand() % 4;
+        tile = atomtiles[a];
+        if ((game->field[tile + vectors[d]] & (field_floor | field_wall | field_atom)) != field_floor) continue;
+        moves += 1;
+        game->field[tile] &= ~field_atom;
+        game->field[tile + vectors[d]] |= field_atom;
+        atomtiles[a] = tile + vectors[d];
+        if (pass == 0) {
+            value += sok_lowerbound_update(bound, matching, a, atomtiles[a]);
+            res->updates += 1;
+          } else {
+            value += sok_lowerbound_compute(bound, matching, atomtiles);
+            res->computes += 1;
+        }
+      }
+      if (pass == 0) {
+          res->updatesecs += elapsed(start);
+        } else {
+          res->computesecs += elapsed(start);
+      }
+      benchsink += value;
+    }
+    sok_lowerbound_freematching(matching);
+    sok_lowerbound_free(bound);
+    /* the searches */
+    res->levels += 1;
+    params.blind = 1;
+    solution = sok_solve(gamelist[i], &params, &bfsstats);
+    if (solution != NULL) free(solution);
+    params.blind = 0;
+    solution = sok_solve(gamelist[i], &params, &astarstats);
+    if (solution != NULL) free(solution);
+    if (bfsstats.result == soksolveSOLVED) res->bfssolved += 1;
+    if (astarstats.result == soksolveSOLVED) res->astarsolved += 1;
+    if ((bfsstats.result == soksolveSOLVED) && (astarstats.result == soksolveSOLVED)) {
+      res->bfsnodes += bfsstats.nodes;
+      res->astarnodes += astarstats.nodes;
+    }
+  }
+  sok_freefile(&levelset);
+  free(gamelist);
+  free(game);
+  free(atomtiles);
+  return(0);
+}
+
+static void printboundbench(char *name, struct boundbench *b) {
+  printf("%-24s %10.0f %10.0f   %4d/%-4d %4d/%-4d %10ld %10ld", name, b->updates / b->updatesecs, b->computes / b->computesecs,
+         b->bfssolved, b->levels, b->astarsolved, b->levels, b->bfsnodes, b->astarnodes);
+  if (b->bfsnodes > 0) {
+      printf(" %6.1f%%\n", 100.0 - b->astarnodes * 100.0 / b->bfsnodes);
+    } else {
+      printf("       -\n");
+  }
+}
+
+static int bench_bound(long maxnodes, char **levelfiles, int count) {
+  static char *defaultfiles[] = {"levels/microban.xsb", "levels/sasquatch.xsb", "levels/sasquatch3.xsb"};
+  struct boundbench b, total;
+  int i;
+  if (maxnodes <= 0) maxnodes = BENCH_BOUND_MAXNODES;
+  if (count == 0) {
+    levelfiles = defaultfiles;
+    count = 3;
+  }
+  memset(&total, 0, sizeof(total));
+  printf("search limit: %ld nodes. nodes are counted on levels solved by both searches.\n", maxnodes);
+  printf("%-24s %10s %10s   %-9s %-9s %10s %10s %7s\n", "file", "updates/s", "computes/s", "bfs", "a*", "bfs nodes", "a* nodes", "saved");
+  for (i = 0; i < count; i++) {
+    memset(&b, 0, sizeof(b));
+    if (bench_bound_file(levelfiles[i], maxnodes, &b) != 0) return(1);
+    printboundbench(levelfiles[i], &b);
+    total.updates += b.updates;
+    total.updatesecs += b.updatesecs;
+    total.computes += b.computes;
+    total.computesecs += b.computesecs;
+    total.levels += b.levels;
+    total.bfssolved += b.bfssolved;
+    total.astarsolved += b.astarsolved;
+    total.bfsnodes += b.bfsnodes;
+    total.astarnodes += b.astarnodes;
+  }
+  printboundbench("total", &total);
+  return(0);
+}
+
+/* builds the pattern database of every level of a file (or of only one of them) */
+static int pdb_build(char *levelfile, int level, long budget) {
+  struct sokgame **gamelist;
+  struct soklevelset levelset;
+  struct sokpdb *pdb;
+  int levelscount, i, built = 0;
+  long size;
+  clock_t start;
+  levelscount = loadlevels(&levelset, &gamelist, levelfile);
+  if (levelscount < 1) return(1);
+  if (budget <= 0) budget = SOKPDB_DEFAULTBUDGET;
+  for (i = 0; i < levelscount; i++) {
+    if ((level > 0) && (i + 1 != level)) continue;
+    start = clock();
+    size = sok_pdb_build(gamelist[i], budget);
+    if (size < 0) {
+        printf("level %3d: failed to write the pattern database\n", i + 1);
+      } else if (size == 0) {
+        printf("level %3d: out of scope (atoms and goals don't match, or over budget)\n", i + 1);
+      } else {
+        pdb = sok_pdb_load(gamelist[i]);
+        printf("level %3d: %6d live squares  %9ld bytes  built in %7.0f ms\n", i + 1, (pdb != NULL) ? pdb->live : -1, size, elapsed(start) * 1000);
+        sok_pdb_free(pdb);
+        built += 1;
+    }
+  }
+  printf("built %d pattern database(s)\n", built);
+  sok_freefile(&levelset);
+  free(gamelist);
+  return(0);
+}
+
+/* solves every level of a file (or only one of them) that has a pattern database, with and without it */
+static int bench_pdb(char *levelfile, int level, long maxnodes) {
+  struct sokgame **gamelist;
+  struct soklevelset levelset;
+  struct sokpdb *pdb;
+  struct soksolveparams params;
+  struct soksolvestats with, without;
+  int levelscount, i, levels = 0, solvedwith = 0, solvedwithout = 0;
+  long nodeswith = 0, nodeswithout = 0, mswith = 0, mswithout = 0;
+  double loadsecs;
+  char *solution;
+  clock_t start;
+  levelscount = loadlevels(&levelset, &gamelist, levelfile);
+  if (levelscount < 1) return(1);
+  sok_solve_defaults(&params);
+  params.maxnodes = (maxnodes > 0) ? maxnodes : BENCH_BOUND_MAXNODES;
+  printf("level     nodes w/o     ms w/o    nodes with    ms with   load us\n");
+  for (i = 0; i < levelscount; i++) {
+    if ((level > 0) && (i + 1 != level)) continue;
+    start = clock();
+    pdb = sok_pdb_load(gamelist[i]);
+    loadsecs = elapsed(start);
+    if (pdb == NULL) continue;
+    sok_pdb_free(pdb);
+    levels += 1;
+    params.nopdb = 1;
+    solution = sok_solve(gamelist[i], &params, &without);
+    if (solution != NULL) free(solution);
+    params.nopdb = 0;
+    solution = sok_solve(gamelist[i], &params, &with);
+    if (solution != NULL) free(solution);
+    printf("%5d %13ld%c %9ld %13ld%c %9ld %9.0f\n", i + 1, without.nodes, (without.result == soksolveSOLVED) ? ' ' : '+', without.elapsedms,
+           with.nodes, (with.result == soksolveSOLVED) ? ' ' : '+', with.elapsedms, loadsecs * 1000000);
+    if (without.result == soksolveSOLVED) solvedwithout += 1;
+    if (with.result == soksolveSOLVED) solvedwith += 1;
+    if ((without.result != soksolveSOLVED) || (with.result != soksolveSOLVED)) continue;
+    nodeswithout += without.nodes;
+    nodeswith += with.nodes;
+    mswithout += without.elapsedms;
+    mswith += with.elapsedms;
+  }
+  if (levels == 0) {
+    puts("no pattern database found, build some with pdb-build first");
+  } else {
+    printf("%d level(s), solved without: %d, with: %d (+ = unsolved)\n", levels, solvedwithout, solvedwith);
+    printf("on levels solved by both: %ld nodes and %ld ms without, %ld nodes and %ld ms with, speedup %.2fx\n",
+           nodeswithout, mswithout, nodeswith, mswith, (double)(mswithout > 0 ? mswithout : 1) / (mswith > 0 ? mswith : 1));
+  }
+  sok_freefile(&levelset);
+  free(gamelist);
+  return(0);
+}
+
+/* times sok_reach() on the largest boards */
+static int bench_reach(void) {
+  static char *names[2] = {"62x62 open board", "62x62 serpentine corridor"};
+  struct sokgame *game;
+  uint64_t reach[64];
+  int i, round, tiles, y;
+  long res = 0;
+  double secs;
+  clock_t start;
+  game = malloc(sizeof(struct sokgame));
+  if (game == NULL) return(1);
+  for (i = 0; i < 2; i++) {
+    buildlargeboard(game, i);
+    start = clock();
+    for (round = 0; round < BENCH_REACH_ROUNDS; round++) {
+      /* move the player around so the compiler can't hoist anything */
+      game->positionx = (round & 1) ? 0 : 60;
+      game->positiony = (round & 2) ? 0 : 61;
+      res += sok_reach(game, reach);
+    }
+    secs = elapsed(start);
+    benchsink += res;
+    tiles = 0;
+    for (y = 0; y < 64; y++) {
+      uint64_t row = reach[y];
+      while (row != 0) {
+        row &= row - 1;
+        tiles += 1;
+      }
+    }
+    printf("%-26s %5d tiles reached  %8.2f us per call\n", names[i], tiles, secs * 1000000.0 / BENCH_REACH_ROUNDS);
+  }
+  free(game);
+  return(0);
+}
+
+/* resets the peak resident set size of the process, where the system allows it */
+static void resetpeakrss(void) {
+  FILE *fd;
+  fd = fopen("/proc/self/clear_refs", "w");
+  if (fd == NULL) return;
+  fputs("5", fd);
+  fclose(fd);
+}
+
+/* returns the peak resident set size of the process in KiB, or -1 if unknown */
+static long peakrss(void) {
+  FILE *fd;
+  char line[128];
+  long res = -1;
+  fd = fopen("/proc/self/status", "r");
+  if (fd != NULL) {
+    while (fgets(line, sizeof(line), fd) != NULL) {
+      if (strncmp(line, "VmHWM:", 6) == 0) res = atol(line + 6);
+    }
+    fclose(fd);
+  }
+#ifndef _WIN32
+  if (res < 0) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) res = usage.ru_maxrss;
+  }
+#endif
+  return(res);
+}
+
+/* runs the solver on one level (or all levels) of a file with a growing number of threads, and checks that all runs agree */
+static int bench_solve(char *levelfile, int level, long maxnodes) {
+  struct sokgame **gamelist;
+  struct soklevelset levelset;
+  struct soksolveparams params;
+  struct soksolvestats stats;
+  int levelscount, i, t, threadcounts[5] = {1, 2, 4, 8, 0}, mismatches = 0;
+  long nodes, ms, memory;
+  char **reference, *solution;
+  levelscount = loadlevels(&levelset, &gamelist, levelfile);
+  if (levelscount < 1) return(1);
+  reference = calloc(levelscount, sizeof(char *));
+  if (reference == NULL) {
+    sok_freefile(&levelset);
+    free(gamelist);
+    return(1);
+  }
+  threadcounts[4] = SDL_GetCPUCount();
+  printf("%s, %s %d, %d CPU(s)\n", levelfile, (level > 0) ? "level" : "levels: all", (level > 0) ? level : levelscount, threadcounts[4]);
+  printf("threads      nodes      ms      nodes/s   solver KiB  peak RSS KiB\n");
+  sok_solve_defaults(&params);
+  params.maxnodes = maxnodes;
+  for (t = 0; t < 5; t++) {
+    /* the last run uses one thread per CPU, skip it if it has been measured already */
+    if ((t == 4) && ((threadcounts[4] == 1) || (threadcounts[4] == 2) || (threadcounts[4] == 4) || (threadcounts[4] == 8))) break;
+    params.threads = threadcounts[t];
+    nodes = 0;
+    ms = 0;
+    memory = 0;
+    resetpeakrss();
+    for (i = 0; i < levelscount; i++) {
+      if ((level > 0) && (i + 1 != level)) continue;
+      solution = sok_solve(gamelist[i], &params, &stats);
+      nodes += stats.nodes;
+      ms += stats.elapsedms;
+      if (stats.memory > memory) memory = stats.memory;
+      /* the first run is the reference all others must match */
+      if (t == 0) {
+          reference[i] = solution;
+        } else {
+          if ((solution != NULL) != (reference[i] != NULL)) {
+              mismatches += 1;
+            } else if ((solution != NULL) && (strcmp(solution, reference[i]) != 0)) {
+              mismatches += 1;
+          }
+          if (solution != NULL) free(solution);
+      }
+    }
+    printf("%7d %10ld %7ld %12.0f %12ld %13ld\n", stats.threads, nodes, ms, nodes * 1000.0 / (ms > 0 ? ms : 1), memory / 1024, peakrss());
+  }
+  if (mismatches != 0) {
+      printf("WARNING: %d solution(s) differ from the single-threaded run!\n", mismatches);
+    } else {
+      puts("all runs found the same solutions");
+  }
+  for (i = 0; i < levelscount; i++) {
+    if (reference[i] != NULL) free(reference[i]);
+  }
+  free(reference);
+  sok_freefile(&levelset);
+  free(gamelist);
+  return(mismatches != 0);
+}
+
+/* replays a solution backward from the position it leads to: pushes are undone with sok_pull(), walking moves by stepping back.
+ * returns non-zero if that leads back to the starting position of game. */
+static int checkbackward(struct sokgame *game, char *solution) {
+  static const enum SOKMOVE dirs[4] = {sokmoveUP, sokmoveRIGHT, sokmoveDOWN, sokmoveLEFT};
+  static const int vectors[4] = {-field_stride, 1, field_stride, -1};
+  static const int vectorsx[4] = {0, 1, 0, -1};
+  struct sokgame *work;
+  long i, len = strlen(solution);
+  int tile, d, res = 1;
+  work = malloc(sizeof(struct sokgame));
+  if (work == NULL) return(0);
+  memcpy(work, game, sizeof(struct sokgame));
+  /* get to the end of the solution first, checksolution() makes sure it is valid */
+  tile = sok_fieldidx(work->positionx, work->positiony);
+  for (i = 0; i < len; i++) {
+    d = strchr("urdl", solution[i] | 32) - "urdl";
+    if ((solution[i] >= 'A') && (solution[i] <= 'Z')) {
+      work->field[tile + vectors[d]] &= ~field_atom;
+      work->field[tile + vectors[d] * 2] |= field_atom;
+    }
+    tile += vectors[d];
+  }
+  work->positionx = tile % field_stride - 1;
+  work->positiony = tile / field_stride - 1;
+  work->goalsleft = 0;
+  /* and walk it back */
+  for (i = len - 1; (i >= 0) && (res != 0); i--) {
+    d = strchr("urdl", solution[i] | 32) - "urdl";
+    if ((solution[i] >= 'A') && (solution[i] <= 'Z')) {
+        if ((sok_pull(work, dirs[(d + 2) & 3], 0) & sokmove_pushed) == 0) res = 0; /* also covers a denied pull (-1 has all bits set) */
+      } else if (work->field[tile - vectors[d]] & (field_wall | field_atom)) {
+        res = 0;
+      } else {
+        work->positionx -= vectorsx[d];
+        work->positiony -= (vectors[d] - vectorsx[d]) / field_stride;
+    }
+    tile = sok_fieldidx(work->positionx, work->positiony);
+  }
+  if ((work->positionx != game->positionx) || (work->positiony != game->positiony) || (work->goalsleft != game->goalsleft)) res = 0;
+  for (tile = 0; tile < field_tiles; tile++) {
+    if ((work->field[tile] ^ game->field[tile]) & field_atom) res = 0;
+  }
+  free(work);
+  return(res);
+}
+
+/* solves levels forward (breadth-first, and A*) and from both ends at once, and reports how they compare */
+static int bench_bidir(char *levelfile, int level, long maxnodes) {
+  struct sokgame **gamelist;
+  struct soklevelset levelset;
+  struct soksolveparams params;
+  struct soksolvestats stats[3];
+  static const char *modes[3] = {"BFS", "A*", "bidir"};
+  int levelscount, i, m, pushes[3], solved[3] = {0, 0, 0}, errors = 0;
+  long nodes[3] = {0, 0, 0}, ms[3] = {0, 0, 0}, bothnodes[2] = {0, 0}, bothms[2] = {0, 0};
+  char *solution[3], *c;
+  levelscount = loadlevels(&levelset, &gamelist, levelfile);
+  if (levelscount < 1) return(1);
+  printf("level   BFS nodes      ms    A* nodes      ms  bidir nodes      ms  pushes\n");
+  for (i = 0; i < levelscount; i++) {
+    if ((level > 0) && (i + 1 != level)) continue;
+    for (m = 0; m < 3; m++) {
+      sok_solve_defaults(&params);
+      params.maxnodes = maxnodes;
+      params.blind = (m == 0);
+      params.bidirectional = (m == 2);
+      solution[m] = sok_solve(gamelist[i], &params, &stats[m]);
+      pushes[m] = 0;
+      if (solution[m] == NULL) continue;
+      for (c = solution[m]; *c != 0; c++) if ((*c >= 'A') && (*c <= 'Z')) pushes[m]++;
+      solved[m] += 1;
+      nodes[m] += stats[m].nodes;
+      ms[m] += stats[m].elapsedms;
+    }
+    printf("%5d %11ld%c %6ld %11ld%c %6ld %11ld%c %6ld  %d", i + 1, stats[0].nodes, (solution[0] == NULL) ? '+' : ' ', stats[0].elapsedms,
+           stats[1].nodes, (solution[1] == NULL) ? '+' : ' ', stats[1].elapsedms, stats[2].nodes, (solution[2] == NULL) ? '+' : ' ', stats[2].elapsedms, pushes[2]);
+    /* solutions from both ends must be valid both ways, and as short as breadth-first ones */
+    if ((solution[2] != NULL) && ((checksolution(gamelist[i], solution[2]) == 0) || (checkbackward(gamelist[i], solution[2]) == 0))) {
+      printf("  INVALID SOLUTION!");
+      errors += 1;
+    }
+    if ((solution[0] != NULL) && (solution[2] != NULL)) {
+      if (pushes[0] != pushes[2]) {
+        printf("  NOT OPTIMAL (%d pushes breadth-first)", pushes[0]);
+        errors += 1;
+      }
+      bothnodes[0] += stats[0].nodes;
+      bothms[0] += stats[0].elapsedms;
+      bothnodes[1] += stats[2].nodes;
+      bothms[1] += stats[2].elapsedms;
+    }
+    printf("\n");
+    for (m = 0; m < 3; m++) {
+      if (solution[m] != NULL) free(solution[m]);
+    }
+  }
+  for (m = 0; m < 3; m++) printf("%-6s solved %d level(s), %ld nodes in %ld ms\n", modes[m], solved[m], nodes[m], ms[m]);
+  printf("on the levels both solved, bidir expanded %ld nodes in %ld ms, BFS %ld nodes in %ld ms\n", bothnodes[1], bothms[1], bothnodes[0], bothms[0]);
+  if (errors != 0) printf("WARNING: %d solution(s) from both ends are invalid or not optimal!\n", errors);
+  sok_freefile(&levelset);
+  free(gamelist);
+  return(errors != 0);
+}
+
+/* solves levels pushing atoms one square at a time, with tunnel macros, and with goal room macros too, and reports how they compare */
+static int bench_macros(char *levelfile, int level, long maxnodes) {
+  struct sokgame **gamelist;
+  struct soklevelset levelset;
+  struct soksolveparams params;
+  struct soksolvestats stats[3];
+  static const char *modes[3] = {"none", "tunnels", "rooms"};
+  int levelscount, i, m, pushes[3], solved[3] = {0, 0, 0}, errors = 0;
+  long nodes[3] = {0, 0, 0}, ms[3] = {0, 0, 0}, allnodes[3] = {0, 0, 0};
+  char *solution[3], *c, length[3][16];
+  levelscount = loadlevels(&levelset, &gamelist, levelfile);
+  if (levelscount < 1) return(1);
+  if (maxnodes <= 0) maxnodes = BENCH_MACROS_MAXNODES;
+  printf("level  none nodes  pushes  tunnels nodes  pushes  rooms nodes  pushes\n");
+  for (i = 0; i < levelscount; i++) {
+    if ((level > 0) && (i + 1 != level)) continue;
+    for (m = 0; m < 3; m++) {
+      sok_solve_defaults(&params);
+      params.maxnodes = maxnodes;
+      params.macros = m;
+      solution[m] = sok_solve(gamelist[i], &params, &stats[m]);
+      pushes[m] = 0;
+      /* unsolved levels get the length no solution can be shorter than, as far as the search went */
+      sprintf(length[m], ">=%d", stats[m].depth);
+      if (solution[m] == NULL) continue;
+      for (c = solution[m]; *c != 0; c++) if ((*c >= 'A') && (*c <= 'Z')) pushes[m]++;
+      sprintf(length[m], "%d", pushes[m]);
+      solved[m] += 1;
+      nodes[m] += stats[m].nodes;
+      ms[m] += stats[m].elapsedms;
+    }
+    printf("%5d %11ld%c %6s %13ld%c %6s %11ld%c %6s", i + 1, stats[0].nodes, (solution[0] == NULL) ? '+' : ' ', length[0],
+           stats[1].nodes, (solution[1] == NULL) ? '+' : ' ', length[1], stats[2].nodes, (solution[2] == NULL) ? '+' : ' ', length[2]);
+    /* macro pushes must expand to plain moves that solve the level */
+    for (m = 1; m < 3; m++) {
+      if ((solution[m] != NULL) && (checksolution(gamelist[i], solution[m]) == 0)) {
+        printf("  INVALID SOLUTION (%s)!", modes[m]);
+        errors += 1;
+      }
+    }
+    if ((solution[0] != NULL) && (solution[1] != NULL) && (pushes[0] != pushes[1])) printf("  tunnels cost %d push(es)", pushes[1] - pushes[0]);
+    if ((solution[0] != NULL) && (solution[1] != NULL) && (solution[2] != NULL)) {
+      for (m = 0; m < 3; m++) allnodes[m] += stats[m].nodes;
+    }
+    printf("\n");
+    for (m = 0; m < 3; m++) {
+      if (solution[m] != NULL) free(solution[m]);
+    }
+  }
+  for (m = 0; m < 3; m++) printf("%-8s solved %d level(s), %ld nodes in %ld ms\n", modes[m], solved[m], nodes[m], ms[m]);
+  printf("(+ = unsolved, >=n = no solution has fewer than n pushes, as far as the search went)\n");
+  if (allnodes[0] > 0) {
+    printf("on the levels all solved: %ld nodes without macros, %ld with tunnels (-%.1f%%), %ld with goal rooms too (-%.1f%%)\n", allnodes[0],
+           allnodes[1], 100.0 - allnodes[1] * 100.0 / allnodes[0], allnodes[2], 100.0 - allnodes[2] * 100.0 / allnodes[0]);
+  }
+  if (errors != 0) printf("WARNING: %d solution(s) found with macros are invalid!\n", errors);
+  sok_freefile(&levelset);
+  free(gamelist);
+  return(errors != 0);
+}
+
+/* runs fn(data) on one thread per CPU, but no more than jobs threads, and waits for all of them to finish. the threads are expected to
+ * share the jobs out among themselves, and to return non-zero if they gave up (out of memory) without taking any. returns the number
+ * of threads, and fills *gaveup with the number of those that gave up: if all of them did, the jobs are left undone. */
+static int runthreads(int (*fn)(void *), void *data, int jobs, int *gaveup) {
+  SDL_Thread *threads[64];
+  int i, threadcount, status;
+  threadcount = SDL_GetCPUCount();
+  if (threadcount > jobs) threadcount = jobs;
+  if (threadcount > 64) threadcount = 64;
+  if (threadcount < 1) threadcount = 1;
+  *gaveup = 0;
+  for (i = 0; i < threadcount; i++) threads[i] = SDL_CreateThread(fn, "soktool", data);
+  for (i = 0; i < threadcount; i++) {
+    if (threads[i] != NULL) {
+        SDL_WaitThread(threads[i], &status);
+      } else {
+        status = fn(data); /* the thread could not be started: do its share of the work here */
+    }
+    if (status != 0) *gaveup += 1;
+  }
+  return(threadcount);
+}
+
+/* the optimization of the saved solution of one level */
+struct optimizejob {
+  struct sokgame *game;
+  char *before;
+  char *after;
+  struct sokoptimizestats stats;
+  long ms;
+};
+
+struct optimizebatch {
+  struct optimizejob *jobs;
+  int count;
+  int window;
+  long maxnodes;
+  SDL_atomic_t next;      /* next job to pick */
+};
+
+static int optimizethread(void *data) {
+  struct optimizebatch *batch = data;
+  struct optimizejob *job;
+  Uint32 start;
+  int i;
+  for (;;) {
+    i = SDL_AtomicAdd(&(batch->next), 1);
+    if (i >= batch->count) break;
+    job = &(batch->jobs[i]);
+    start = SDL_GetTicks();
+    job->after = sok_optimize(job->game, job->before, batch->window, batch->maxnodes, &(job->stats));
+    job->ms = SDL_GetTicks() - start;
+  }
+  return(0);
+}
+
+/* optimizes the saved solutions of one level (or all levels) of a file. levels are spread over one thread per CPU, every thread
+ * taking care of a whole level at a time. improved solutions are saved once all threads are done. */
+static int optimize(char *levelfile, int level, int window, long maxnodes) {
+  struct sokgame **gamelist;
+  struct soklevelset levelset;
+  struct optimizebatch batch;
+  int levelscount, i, improved = 0, gaveup;
+  long movesbefore = 0, pushesbefore = 0, movesafter = 0, pushesafter = 0;
+  Uint32 start;
+  levelscount = loadlevels(&levelset, &gamelist, levelfile);
+  if (levelscount < 1) return(1);
+  memset(&batch, 0, sizeof(batch));
+  batch.jobs = calloc(levelscount, sizeof(struct optimizejob));
+  if (batch.jobs == NULL) {
+    sok_freefile(&levelset);
+    free(gamelist);
+    return(1);
+  }
+  for (i = 0; i < levelscount; i++) {
+    if ((level > 0) && (i + 1 != level)) continue;
+    batch.jobs[batch.count].game = gamelist[i];
+    batch.jobs[batch.count].before = solution_load(gamelist[i]->crc32, "dat");
+    if (batch.jobs[batch.count].before != NULL) batch.count += 1;
+  }
+  batch.window = window;
+  batch.maxnodes = maxnodes;
+  SDL_AtomicSet(&(batch.next), 0);
+  printf("%s: %d saved solution(s) to optimize\n", levelfile, batch.count);
+  start = SDL_GetTicks();
+  i = runthreads(optimizethread, &batch, batch.count, &gaveup);
+  printf("optimized on %d thread(s)\n", i);
+  for (i = 0; i < batch.count; i++) {
+    struct optimizejob *job = &(batch.jobs[i]);
+    char *best = (job->after != NULL) ? job->after : job->before;
+    movesbefore += sok_history_getlen(job->before);
+    pushesbefore += sok_history_getpushes(job->before);
+    movesafter += sok_history_getlen(best);
+    pushesafter += sok_history_getpushes(best);
+    printf("level %3d: %5ld/%4ld -> %5ld/%4ld moves/pushes  %4ld windows %8ld nodes %6ld ms", job->game->level, sok_history_getlen(job->before), sok_history_getpushes(job->before), sok_history_getlen(best), sok_history_getpushes(best), job->stats.windows, job->stats.nodes, job->ms);
+    if (job->after != NULL) {
+        if (checksolution(job->game, job->after) != 0) {
+            solution_save(job->game->crc32, job->after, "dat");
+            improved += 1;
+            puts("  saved");
+          } else {
+            puts("  INVALID SOLUTION!");
+        }
+        free(job->after);
+      } else {
+        puts("");
+    }
+    free(job->before);
+  }
+  printf("improved %d of %d solution(s), %ld/%ld -> %ld/%ld moves/pushes in %ld ms\n", improved, batch.count, movesbefore, pushesbefore, movesafter, pushesafter, (long)(SDL_GetTicks() - start));
+  free(batch.jobs);
+  sok_freefile(&levelset);
+  free(gamelist);
+  return(0);
+}
+
+#define VERIFY_VALID 0
+#define VERIFY_INVALID 1
+#define VERIFY_MISSING 2
+#define VERIFY_UNCHECKED 3  /* no thread got to check it (out of memory) */
+
+/* the check of the saved solution of one level */
+struct verifyjob {
+  struct sokgame *game;
+  int result;             /* VERIFY_xxx */
+  int badmoves;           /* moves sok_play() could not play */
+};
+
+struct verifybatch {
+  struct verifyjob *jobs;
+  int count;
+  SDL_atomic_t next;      /* next job to pick */
+};
+
+static int verifythread(void *data) {
+  struct verifybatch *batch = data;
+  struct verifyjob *job;
+  struct sokgame *work;
+  struct sokgamestates *states;
+  int i;
+  work = malloc(sizeof(struct sokgame));
+  states = sok_newstates();
+  if ((work == NULL) || (states == NULL)) {
+    if (work != NULL) free(work);
+    if (states != NULL) sok_freestates(states);
+    return(-1);
+  }
+  states->nosave = 1; /* replaying a saved solution should never save it again */
+  for (;;) {
+    i = SDL_AtomicAdd(&(batch->next), 1);
+    if (i >= batch->count) break;
+    job = &(batch->jobs[i]);
+    if (job->game->solution == NULL) {
+      job->result = VERIFY_MISSING;
+      continue;
+    }
+    /* replay on a copy, the level stays as it is for the report */
+    memcpy(work, job->game, sizeof(struct sokgame));
+    sok_resetstates(states);
+    job->badmoves = sok_play(work, states, job->game->solution);
+    job->result = ((job->badmoves == 0) && (work->goalsleft == 0)) ? VERIFY_VALID : VERIFY_INVALID;
+  }
+  sok_freestates(states);
+  free(work);
+  return(0);
+}
+
+/* replays the saved solution of every level of the given files (all bundled sets by default), levels being spread over one thread
+ * per CPU. returns non-zero if any solution is invalid, or could not be checked. */
+static int verify(char **levelfiles, int count) {
+  static char *defaultfiles[] = {"levels/microban.xsb", "levels/sasquatch.xsb", "levels/sasquatch3.xsb"};
+  static char *resultnames[4] = {"valid", "INVALID", "missing", "NOT CHECKED"};
+  struct sokgame **gamelist;
+  struct soklevelset levelset;
+  struct verifybatch batch;
+  int levelscount, f, i, threadcount = 0, gaveup, totals[4] = {0, 0, 0, 0}, filetotals[4];
+  Uint32 start, filestart;
+  if (count == 0) {
+    levelfiles = defaultfiles;
+    count = 3;
+  }
+  start = SDL_GetTicks();
+  for (f = 0; f < count; f++) {
+    filestart = SDL_GetTicks();
+    /* parsing a level looks up its .dat solution by its crc32 */
+    levelscount = loadlevels(&levelset, &gamelist, levelfiles[f]);
+    if (levelscount < 1) continue;
+    memset(&batch, 0, sizeof(batch));
+    batch.jobs = calloc(levelscount, sizeof(struct verifyjob));
+    if (batch.jobs == NULL) {
+      sok_freefile(&levelset);
+      free(gamelist);
+      break;
+    }
+    for (i = 0; i < levelscount; i++) {
+      batch.jobs[i].game = gamelist[i];
+      batch.jobs[i].result = VERIFY_UNCHECKED; /* until a thread gets to it */
+    }
+    batch.count = levelscount;
+    SDL_AtomicSet(&(batch.next), 0);
+    threadcount = runthreads(verifythread, &batch, batch.count, &gaveup);
+    if (gaveup != 0) printf("WARNING: %d of %d thread(s) ran out of memory\n", gaveup, threadcount);
+    filetotals[0] = filetotals[1] = filetotals[2] = filetotals[3] = 0;
+    for (i = 0; i < levelscount; i++) {
+      struct verifyjob *job = &(batch.jobs[i]);
+      filetotals[job->result] += 1;
+      printf("%s level %3d: %s", levelfiles[f], job->game->level, resultnames[job->result]);
+      if (job->result == VERIFY_VALID) printf(" (%ld moves, %ld pushes)", job->game->solutionlen, job->game->solutionpushes);
+      if (job->result == VERIFY_INVALID) printf(" (%d bad moves, %s)", job->badmoves, (job->badmoves == 0) ? "level not solved" : "skipped");
+      puts("");
+    }
+    printf("%s: %d valid, %d invalid, %d missing, %d not checked, %ld ms\n", levelfiles[f], filetotals[0], filetotals[1], filetotals[2], filetotals[3], (long)(SDL_GetTicks() - filestart));
+    for (i = 0; i < 4; i++) totals[i] += filetotals[i];
+    free(batch.jobs);
+    sok_freefile(&levelset);
+    free(gamelist);
+  }
+  printf("total: %d valid, %d invalid, %d missing, %d not checked, %ld ms on %d thread(s)\n", totals[0], totals[1], totals[2], totals[3], (long)(SDL_GetTicks() - start), threadcount);
+  return((totals[VERIFY_INVALID] != 0) || (totals[VERIFY_UNCHECKED] != 0));
+}
+
+/* the measures of one level */
+struct profilejob {
+  struct sokgame *game;
+  int atoms;
+  int area;               /* tiles the player could walk on if there were no atoms */
+  int dead;               /* dead squares of that area */
+  enum SOKSOLVE result;
+  long pushes;
+  long nodes;             /* positions expanded by the solver to its first solution (or until it gave up) */
+  long ms;
+};
+
+struct profilebatch {
+  struct profilejob *jobs;
+  int count;
+  long maxnodes;
+  SDL_atomic_t next;      /* next job to pick */
+};
+
+static int popcount64(uint64_t word) {
+  int res = 0;
+  for (; word != 0; word &= word - 1) res += 1;
+  return(res);
+}
+
+static int profilethread(void *data) {
+  struct profilebatch *batch = data;
+  struct profilejob *job;
+  struct soksolveparams params;
+  struct soksolvestats stats;
+  struct sokgame *empty;
+  uint64_t reach[64];
+  char *solution;
+  int i, tile;
+  empty = malloc(sizeof(struct sokgame));
+  if (empty == NULL) return(-1);
+  sok_solve_defaults(&params);
+  params.maxnodes = batch->maxnodes;
+  params.threads = 1; /* levels are spread over the CPUs already */
+  for (;;) {
+    i = SDL_AtomicAdd(&(batch->next), 1);
+    if (i >= batch->count) break;
+    job = &(batch->jobs[i]);
+    /* static measures, on a copy of the level without its atoms */
+    memcpy(empty, job->game, sizeof(struct sokgame));
+    for (tile = 0; tile < field_tiles; tile++) {
+      if (empty->field[tile] & field_atom) job->atoms += 1;
+      empty->field[tile] &= ~field_atom;
+    }
+    sok_reach(empty, reach);
+    for (tile = 0; tile < 64; tile++) {
+      job->area += popcount64(reach[tile]);
+      job->dead += popcount64(reach[tile] & job->game->deadsquares[tile]);
+    }
+    /* what it takes the solver to find a first solution */
+    solution = sok_solve(job->game, &params, &stats);
+    job->result = stats.result;
+    job->nodes = stats.nodes;
+    job->ms = stats.elapsedms;
+    job->pushes = (solution != NULL) ? sok_history_getpushes(solution) : -1;
+    if (solution != NULL) free(solution);
+  }
+  free(empty);
+  return(0);
+}
+
+/* orders levels by difficulty: solved ones first, by solver nodes then time, then the others. ties keep the order of the set. */
+static int cmpdifficulty(const void *a, const void *b) {
+  const struct profilejob *ja = *(const struct profilejob **)a, *jb = *(const struct profilejob **)b;
+  if ((ja->result == soksolveSOLVED) != (jb->result == soksolveSOLVED)) return((ja->result == soksolveSOLVED) ? -1 : 1);
+  if ((ja->result == soksolveSOLVED) && (ja->nodes != jb->nodes)) return((ja->nodes < jb->nodes) ? -1 : 1);
+  if ((ja->result == soksolveSOLVED) && (ja->ms != jb->ms)) return((ja->ms < jb->ms) ? -1 : 1);
+  return(ja->game->level - jb->game->level);
+}
+
+/* writes a level in the XSB format. rows are written over the whole width of the level, so it loads back with the same size, hence
+ * the same crc32 (and its saved solutions stay attached to it). */
+static void writelevel(FILE *fd, struct sokgame *game) {
+  int x, y, c;
+  for (y = 0; y < game->field_height; y++) {
+    for (x = 0; x < game->field_width; x++) {
+      switch (sok_field(game, x, y) & ~field_floor) {
+        case field_wall:
+          c = '#';
+          break;
+        case (field_atom | field_goal):
+          c = '*';
+          break;
+        case field_atom:
+          c = '$';
+          break;
+        case field_goal:
+          c = ((game->positionx == x) && (game->positiony == y)) ? '+' : '.';
+          break;
+        default:
+          c = ((game->positionx == x) && (game->positiony == y)) ? '@' : ' ';
+          break;
+      }
+      fputc(c, fd);
+    }
+    fputc('\n', fd);
+  }
+}
+
+/* measures every level of a file (levels spread over one thread per CPU), and prints the measures as CSV. if sortedfile is not NULL,
+ * the set is also written there, from the easiest level to the hardest. */
+static int profile(char *levelfile, long maxnodes, char *sortedfile) {
+  struct sokgame **gamelist;
+  struct soklevelset levelset;
+  struct profilebatch batch;
+  struct profilejob **order;
+  char comment[64];
+  int levelscount, i, solved = 0, threadcount, gaveup;
+  Uint32 start;
+  FILE *fd;
+  levelscount = sok_loadfile(&levelset, levelfile, NULL, 0, comment, sizeof(comment), 0);
+  if (levelscount > 0) levelscount = getlevels(&levelset, &gamelist);
+  if (levelscount < 1) {
+    fprintf(stderr, "Failed to load the level file '%s' [%d]: %s\n", levelfile, levelscount, sok_strerr(levelscount));
+    return(1);
+  }
+  memset(&batch, 0, sizeof(batch));
+  batch.jobs = calloc(levelscount, sizeof(struct profilejob));
+  order = malloc(sizeof(struct profilejob *) * levelscount);
+  if ((batch.jobs == NULL) || (order == NULL)) {
+    if (batch.jobs != NULL) free(batch.jobs);
+    if (order != NULL) free(order);
+    sok_freefile(&levelset);
+    free(gamelist);
+    return(1);
+  }
+  for (i = 0; i < levelscount; i++) {
+    batch.jobs[i].game = gamelist[i];
+    batch.jobs[i].result = soksolveERROR; /* until a thread gets to it */
+    order[i] = &(batch.jobs[i]);
+  }
+  batch.count = levelscount;
+  batch.maxnodes = (maxnodes > 0) ? maxnodes : PROFILE_MAXNODES;
+  SDL_AtomicSet(&(batch.next), 0);
+  start = SDL_GetTicks();
+  threadcount = runthreads(profilethread, &batch, batch.count, &gaveup);
+  fprintf(stderr, "%s: %d levels profiled in %ld ms on %d thread(s)\n", levelfile, levelscount, (long)(SDL_GetTicks() - start), threadcount);
+  if (gaveup != 0) fprintf(stderr, "WARNING: %d of %d thread(s) ran out of memory\n", gaveup, threadcount);
+  puts("level,atoms,area,dead_ratio,result,pushes,nodes,ms");
+  for (i = 0; i < levelscount; i++) {
+    struct profilejob *job = &(batch.jobs[i]);
+    printf("%d,%d,%d,%.3f,%s,%ld,%ld,%ld\n", job->game->level, job->atoms, job->area, job->dead / (double)(job->area > 0 ? job->area : 1), sok_solve_strresult(job->result), job->pushes, job->nodes, job->ms);
+    if (job->result == soksolveSOLVED) solved += 1;
+  }
+  if (sortedfile != NULL) {
+    qsort(order, levelscount, sizeof(struct profilejob *), cmpdifficulty);
+    fd = fopen(sortedfile, "wb");
+    if (fd == NULL) {
+        fprintf(stderr, "Failed to create '%s'\n", sortedfile);
+      } else {
+        fprintf(fd, "; %s\n;\n; levels of %s sorted by difficulty (solver nodes to a first solution, %d of them solved within %ld nodes)\n\n", comment, levelfile, solved, batch.maxnodes);
+        for (i = 0; i < levelscount; i++) {
+          writelevel(fd, order[i]->game);
+          fprintf(fd, "; %d\n\n", order[i]->game->level);
+        }
+        fclose(fd);
+        fprintf(stderr, "%d levels written to %s, from the easiest to the hardest\n", levelscount, sortedfile);
+    }
+  }
+  free(order);
+  free(batch.jobs);
+  sok_freefile(&levelset);
+  free(gamelist);
+  return(gaveup == threadcount); /* nobody took the jobs */
+}
+
+/* indexes a large set, made of copies copies of plain level files one after another, with 1, 2, 4, 8 and one thread per CPU, and
+ * checks that all runs find the very same levels */
+static int bench_load(int copies, char **levelfiles, int count) {
+  static char *defaultfiles[] = {"levels/microban.xsb", "levels/sasquatch.xsb", "levels/sasquatch3.xsb"};
+  struct soklevelset levelset;
+  unsigned char *data = NULL, *newdata;
+  unsigned long *reference = NULL;
+  long datalen = 0, filelen, onelen, ms, bestms = 0, refms = 0;
+  int f, i, t, round, levelscount = 0, threadcounts[5] = {1, 2, 4, 8, 0}, mismatches = 0, res = 0;
+  char comment[64];
+  Uint32 start;
+  FILE *fd;
+  if (count == 0) {
+    levelfiles = defaultfiles;
+    count = 3;
+  }
+  if (copies < 1) copies = BENCH_LOAD_COPIES;
+  /* read all files one after another (with a newline in between, in case one doesn't end with one), then copy that copies times */
+  for (f = 0; f < count; f++) {
+    fd = fopen(levelfiles[f], "rb");
+    if (fd == NULL) {
+      printf("Failed to open '%s'\n", levelfiles[f]);
+      if (data != NULL) free(data);
+      return(1);
+    }
+    fseek(fd, 0, SEEK_END);
+    filelen = ftell(fd);
+    rewind(fd);
+    newdata = (filelen >= 0) ? realloc(data, datalen + filelen + 1) : NULL;
+    if ((newdata == NULL) || (fread(newdata + datalen, 1, filelen, fd) != (size_t)filelen)) {
+      printf("Failed to read '%s'\n", levelfiles[f]);
+      fclose(fd);
+      free((newdata != NULL) ? newdata : data);
+      return(1);
+    }
+    fclose(fd);
+    data = newdata;
+    datalen += filelen;
+    data[datalen++] = '\n';
+  }
+  onelen = datalen;
+  newdata = realloc(data, onelen * copies);
+  if (newdata == NULL) {
+    free(data);
+    return(1);
+  }
+  data = newdata;
+  for (i = 1; i < copies; i++) memcpy(data + onelen * i, data, onelen);
+  datalen = onelen * copies;
+
+  threadcounts[4] = SDL_GetCPUCount();
+  for (t = 0; t < 5; t++) {
+    /* the last run uses one thread per CPU, skip it if it has been measured already */
+    if ((t == 4) && ((threadcounts[4] == 1) || (threadcounts[4] == 2) || (threadcounts[4] == 4) || (threadcounts[4] == 8))) break;
+    for (round = 0; round < BENCH_LOAD_ROUNDS; round++) {
+      start = SDL_GetTicks();
+      res = sok_loadfile(&levelset, NULL, data, datalen, comment, sizeof(comment), threadcounts[t]);
+      ms = SDL_GetTicks() - start;
+      if (res < 1) {
+        printf("Failed to load the levels [%d]: %s\n", res, sok_strerr(res));
+        break;
+      }
+      if ((round == 0) || (ms < bestms)) bestms = ms;
+      /* the first run is the reference all others must match */
+      if (reference == NULL) {
+          levelscount = res;
+          reference = malloc(sizeof(unsigned long) * levelscount);
+          if (reference == NULL) {
+            sok_freefile(&levelset);
+            res = 0;
+            break;
+          }
+          for (i = 0; i < levelscount; i++) reference[i] = levelset.levels[i].crc32;
+          printf("%d levels (%ld KiB), %d CPU(s)\n", levelscount, datalen / 1024, threadcounts[4]);
+          printf("threads   best ms     levels/s  speedup\n");
+        } else if (res != levelscount) {
+          mismatches += 1;
+        } else {
+          for (i = 0; i < levelscount; i++) {
+            if (levelset.levels[i].crc32 != reference[i]) break;
+          }
+          if (i < levelscount) mismatches += 1;
+      }
+      sok_freefile(&levelset);
+    }
+    if (res < 1) break;
+    if (t == 0) refms = bestms;
+    printf("%7d %9ld %12.0f %7.2fx\n", threadcounts[t], bestms, levelscount * 1000.0 / (bestms > 0 ? bestms : 1), (double)(refms > 0 ? refms : 1) / (bestms > 0 ? bestms : 1));
+  }
+  if (res >= 1) {
+    if (mismatches != 0) {
+        printf("WARNING: %d run(s) differ from the single-threaded one!\n", mismatches);
+      } else {
+        puts("all runs found the same levels");
+    }
+  }
+  if (reference != NULL) free(reference);
+  free(data);
+  return((res < 1) || (mismatches != 0));
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    help();
+    return(1);
+  }
+  if (strcmp(argv[1], "bench-sweep") == 0) return(bench_sweep((argc > 2) ? argv[2] : DEFAULT_LEVELFILE));
+  if (strcmp(argv[1], "bench-reach") == 0) return(bench_reach());
+  if (strcmp(argv[1], "bench-deadlock") == 0) return(bench_deadlock(argv + 2, argc - 2));
+  if (strcmp(argv[1], "pdb-build") == 0) return(pdb_build((argc > 2) ? argv[2] : DEFAULT_LEVELFILE, (argc > 3) ? atoi(argv[3]) : 0, (argc > 4) ? atol(argv[4]) * 1024 : 0));
+  if (strcmp(argv[1], "bench-pdb") == 0) return(bench_pdb((argc > 2) ? argv[2] : DEFAULT_LEVELFILE, (argc > 3) ? atoi(argv[3]) : 0, (argc > 4) ? atol(argv[4]) : 0));
+  if (strcmp(argv[1], "bench-bound") == 0) return(bench_bound((argc > 2) ? atol(argv[2]) : 0, argv + 3, (argc > 3) ? argc - 3 : 0));
+  if (strcmp(argv[1], "bench-solve") == 0) return(bench_solve((argc > 2) ? argv[2] : DEFAULT_LEVELFILE, (argc > 3) ? atoi(argv[3]) : 0, (argc > 4) ? atol(argv[4]) : 0));
+  if (strcmp(argv[1], "bench-bidir") == 0) return(bench_bidir((argc > 2) ? argv[2] : DEFAULT_LEVELFILE, (argc > 3) ? atoi(argv[3]) : 0, (argc > 4) ? atol(argv[4]) : 0));
+  if (strcmp(argv[1], "bench-macros") == 0) return(bench_macros((argc > 2) ? argv[2] : DEFAULT_LEVELFILE, (argc > 3) ? atoi(argv[3]) : 0, (argc > 4) ? atol(argv[4]) : 0));
+  if (strcmp(argv[1], "solve-disk") == 0) return(solve_disk((argc > 2) ? argv[2] : DEFAULT_LEVELFILE, (argc > 3) ? atoi(argv[3]) : 0, (argc > 4) ? atol(argv[4]) * 1024 : 0, (argc > 5) ? argv[5] : NULL, (argc > 6) ? atol(argv[6]) : 0));
+  if (strcmp(argv[1], "profile") == 0) return(profile((argc > 2) ? argv[2] : DEFAULT_LEVELFILE, (argc > 3) ? atol(argv[3]) : 0, (argc > 4) ? argv[4] : NULL));
+  if (strcmp(argv[1], "verify") == 0) return(verify(argv + 2, argc - 2));
+  if (strcmp(argv[1], "bench-load") == 0) return(bench_load((argc > 2) ? atoi(argv[2]) : 0, argv + 3, (argc > 3) ? argc - 3 : 0));
+  if (strcmp(argv[1], "optimize") == 0) return(optimize((argc > 2) ? argv[2] : DEFAULT_LEVELFILE, (argc > 3) ? atoi(argv[3]) : 0, (argc > 4) ? atoi(argv[4]) : 0, (argc > 5) ? atol(argv[5]) : 0));
+  if (strcmp(argv[1], "solve") == 0) return(solve((argc > 2) ? argv[2] : DEFAULT_LEVELFILE, (argc > 3) ? atoi(argv[3]) : 0, (argc > 4) ? atol(argv[4]) : 0));
+  help();
+  return(1);
+}